@@ -0,0 +1,166 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+// the first chunk an arena gets, later ones double what it has so far
+#define ARENA_FIRST_CHUNK 4096
+// every allocation starts on a multiple of this, good enough for any type
+#define ARENA_ALIGN (sizeof(max_align_t))
+
+struct arena_chunk
+{
+    struct arena_chunk *next;
+    size_t size;   // bytes of data after the header
+    size_t offset; // bytes of data handed out
+};
+
+static size_t arena_round(size_t size)
+{
+    return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static unsigned char *arena_data(struct arena_chunk *chunk)
+{
+    return (unsigned char *)chunk + arena_round(sizeof(struct arena_chunk));
+}
+
+void arena_init(struct arena *arena, size_t cap)
+{
+    memset(arena, 0, sizeof(*arena));
+    arena->cap = cap;
+}
+
+void arena_free(struct arena *arena)
+{
+    struct arena_chunk *chunk = arena->first;
+    while (chunk != NULL)
+    {
+        struct arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->first = arena->current = NULL;
+    arena->reserved = arena->used = 0;
+}
+
+// a chunk of at least size bytes on the end of the list, or NULL past the cap
+static struct arena_chunk *arena_add_chunk(struct arena *arena, size_t size)
+{
+    size_t wanted = arena->reserved > ARENA_FIRST_CHUNK ? arena->reserved : ARENA_FIRST_CHUNK;
+    if (wanted < size)
+    {
+        wanted = size;
+    }
+    if (wanted > arena->cap - arena->reserved)
+    {
+        wanted = arena->cap - arena->reserved;
+    }
+    if (wanted < size)
+    {
+        return NULL;
+    }
+
+    struct arena_chunk *chunk = malloc(arena_round(sizeof(struct arena_chunk)) + wanted);
+    if (chunk == NULL)
+    {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->size = wanted;
+    chunk->offset = 0;
+    arena->reserved += wanted;
+
+    struct arena_chunk **link = &arena->first;
+    while (*link != NULL)
+    {
+        link = &(*link)->next;
+    }
+    *link = chunk;
+    return chunk;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+    size = arena_round(size ? size : 1);
+    struct arena_chunk *chunk = arena->current;
+    if (chunk == NULL || chunk->size - chunk->offset < size)
+    {
+        // everything after current is free, take the first chunk there that's big enough. the
+        // tail of the one we leave just goes unused until the next reset
+        chunk = chunk != NULL ? chunk->next : arena->first;
+        while (chunk != NULL && chunk->size < size)
+        {
+            chunk = chunk->next;
+        }
+        if (chunk == NULL && (chunk = arena_add_chunk(arena, size)) == NULL)
+        {
+            arena->failures++;
+            return NULL;
+        }
+        chunk->offset = 0;
+        arena->current = chunk;
+    }
+
+    void *memory = arena_data(chunk) + chunk->offset;
+    chunk->offset += size;
+    arena->used += size;
+    if (arena->used > arena->high_water)
+    {
+        arena->high_water = arena->used;
+    }
+    return memory;
+}
+
+void *arena_grow(struct arena *arena, void *memory, size_t old_size, size_t new_size)
+{
+    struct arena_chunk *chunk = arena->current;
+    old_size = arena_round(old_size ? old_size : 1);
+    new_size = arena_round(new_size ? new_size : 1);
+    if (new_size <= old_size)
+    {
+        return memory;
+    }
+    if (chunk != NULL && (unsigned char *)memory + old_size == arena_data(chunk) + chunk->offset && chunk->size - chunk->offset >= new_size - old_size)
+    {
+        chunk->offset += new_size - old_size;
+        arena->used += new_size - old_size;
+        if (arena->used > arena->high_water)
+        {
+            arena->high_water = arena->used;
+        }
+        return memory;
+    }
+
+    void *moved = arena_alloc(arena, new_size);
+    if (moved != NULL)
+    {
+        memcpy(moved, memory, old_size);
+    }
+    return moved;
+}
+
+void arena_reset(struct arena *arena)
+{
+    arena->current = arena->first;
+    if (arena->first != NULL)
+    {
+        arena->first->offset = 0;
+    }
+    arena->used = 0;
+}
+
+struct arena_mark arena_mark(const struct arena *arena)
+{
+    struct arena_mark mark = {arena->current, arena->current != NULL ? arena->current->offset : 0, arena->used};
+    return mark;
+}
+
+void arena_release(struct arena *arena, struct arena_mark mark)
+{
+    arena->current = mark.chunk;
+    if (mark.chunk != NULL)
+    {
+        mark.chunk->offset = mark.offset;
+    }
+    arena->used = mark.used;
+}
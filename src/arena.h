@@ -0,0 +1,55 @@
+#ifndef APSC143__ARENA_H
+#define APSC143__ARENA_H
+
+#include <stddef.h>
+
+// memory one game's buffers may take when nobody says otherwise (--arena-kb)
+#define ARENA_DEFAULT_GAME_KB 4096
+
+struct arena_chunk;
+
+// A bump allocator for memory that all goes away at once: one game's move
+// text and moves, or the positions of a replay one ply per allocation. Each
+// allocation just moves a pointer along a chunk, and nothing is freed on its
+// own; arena_reset hands everything back in one step, and arena_release
+// everything since an arena_mark, so it also works as a stack. The chunks are
+// kept through resets, so once the arena has grown to what a game needs,
+// later games don't call malloc at all. The chunks never add up to more than
+// cap bytes: past that an allocation fails instead. Not thread safe; an arena
+// belongs to whichever thread holds what it's for.
+struct arena
+{
+    struct arena_chunk *first, *current; // the chunks after current are empty
+    size_t cap;                          // most bytes the chunks may add up to
+    size_t reserved;                     // bytes in chunks so far
+    size_t used;                         // bytes handed out and not yet given back
+    size_t high_water;                   // the most used has ever been
+    unsigned long long failures;         // allocations refused because of cap
+};
+
+// where an arena was, for arena_release
+struct arena_mark
+{
+    struct arena_chunk *chunk;
+    size_t offset, used;
+};
+
+// An empty arena that may grow to cap bytes. Nothing is allocated until it's used.
+void arena_init(struct arena *arena, size_t cap);
+void arena_free(struct arena *arena);
+
+// size bytes aligned for any type. Returns NULL if they'd take the arena past cap.
+void *arena_alloc(struct arena *arena, size_t size);
+// Makes memory, old_size bytes from arena_alloc, new_size bytes long: in place
+// if it's the arena's last allocation and the chunk has room, otherwise in a
+// new allocation with the old bytes copied over. Returns NULL (memory is left
+// as it was) if that would go past cap.
+void *arena_grow(struct arena *arena, void *memory, size_t old_size, size_t new_size);
+
+// Gives back everything allocated so far.
+void arena_reset(struct arena *arena);
+struct arena_mark arena_mark(const struct arena *arena);
+// Gives back everything allocated since mark was taken.
+void arena_release(struct arena *arena, struct arena_mark mark);
+
+#endif
@@ -0,0 +1,359 @@
+#include "batch.h"
+#include "board.h"
+#include "parser.h"
+#include "search.h"
+#include "report.h"
+#include "history.h"
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BATCH_LINE_MAX 256
+#define BATCH_MOVE_TEXT 32 // parse_move_text never looks past 31 characters either
+
+// one move in the trie. the path from the root to a node is a game prefix,
+// so every node stands for exactly one position
+struct batch_node
+{
+    char text[BATCH_MOVE_TEXT]; // the move as written, spaces removed
+    struct chess_move move;     // parsed but not completed, that needs the board
+    int first_child, next_sibling;
+    int first_game; // games that end at this node, chained through batch_game.next_game
+};
+
+struct batch_game
+{
+    int next_game;
+    enum chess_error error;  // completing or applying a move failed, the game has no summary
+    struct chess_move failed_move;
+    struct chess_summary summary;
+    char san[CHESS_MAX_LINES][10]; // the suggestion and the lines, for the structured formats
+    unsigned long long analysis_ns;
+};
+
+struct batch_run
+{
+    struct batch_node *nodes; // nodes[0] is the root, the starting position
+    int node_count, node_capacity;
+
+    struct batch_game *games;
+    int game_count, game_capacity;
+
+    struct search_context context;
+    struct history path; // positions from the root to the node being walked, the search's context.game
+    // the boards of the walk, one per ply from the root to the node being walked, taken and given
+    // back like a stack. keeps the recursion's frames small however long the games are
+    struct arena arena;
+    struct report_writer *report;
+    int depth;
+    bool trusted; // replay with the trusted board calls, the archive is known to be clean
+    enum chess_error analysis_error;
+
+    unsigned long long moves_read;     // moves over all games, what replaying each game separately would resolve
+    unsigned long long moves_resolved; // moves actually completed and applied
+};
+
+static int batch_add_node(struct batch_run *run, const char *text, const struct chess_move *move)
+{
+    if (run->node_count == run->node_capacity)
+    {
+        int capacity = run->node_capacity ? run->node_capacity * 2 : 1024;
+        struct batch_node *nodes = realloc(run->nodes, (size_t)capacity * sizeof(*nodes));
+        if (nodes == NULL)
+        {
+            return -1;
+        }
+        run->nodes = nodes;
+        run->node_capacity = capacity;
+    }
+
+    struct batch_node *node = &run->nodes[run->node_count];
+    strcpy(node->text, text);
+    node->move = move != NULL ? *move : (struct chess_move){0};
+    node->first_child = -1;
+    node->next_sibling = -1;
+    node->first_game = -1;
+    return run->node_count++;
+}
+
+// finds the child of parent reached by the move text, adding it if no earlier
+// game got here. returns -1 if the move doesn't parse (or we ran out of memory)
+static int batch_child(struct batch_run *run, int parent, const char *text)
+{
+    for (int child = run->nodes[parent].first_child; child != -1; child = run->nodes[child].next_sibling)
+    {
+        if (strcmp(run->nodes[child].text, text) == 0)
+        {
+            return child;
+        }
+    }
+
+    // only new nodes are parsed, a move shared by many games is parsed once
+    struct chess_move move;
+    if (!parse_move_text(text, &move))
+    {
+        return -1;
+    }
+    int child = batch_add_node(run, text, &move);
+    if (child == -1)
+    {
+        return -1;
+    }
+    run->nodes[child].next_sibling = run->nodes[parent].first_child;
+    run->nodes[parent].first_child = child;
+    return child;
+}
+
+static bool batch_end_game(struct batch_run *run, int node)
+{
+    if (run->game_count == run->game_capacity)
+    {
+        int capacity = run->game_capacity ? run->game_capacity * 2 : 256;
+        struct batch_game *games = realloc(run->games, (size_t)capacity * sizeof(*games));
+        if (games == NULL)
+        {
+            return false;
+        }
+        run->games = games;
+        run->game_capacity = capacity;
+    }
+
+    struct batch_game *game = &run->games[run->game_count];
+    game->error = CHESS_OK;
+    game->analysis_ns = 0;
+    game->next_game = run->nodes[node].first_game;
+    run->nodes[node].first_game = run->game_count++;
+    return true;
+}
+
+// reads every game into the trie. like the single game reader, a move that
+// doesn't parse ends its game; the rest of its lines up to the blank line are skipped
+static bool batch_read_games(struct batch_run *run, FILE *input)
+{
+    char line[BATCH_LINE_MAX];
+    int node = 0;         // where the game being read has got to
+    bool in_game = false; // read at least one line of the current game
+    bool skipping = false;
+
+    while (fgets(line, sizeof(line), input) != NULL)
+    {
+        // drop whatever doesn't fit, a move is never that long anyway
+        if (strchr(line, '\n') == NULL && !feof(input))
+        {
+            int current_char;
+            while ((current_char = getc(input)) != EOF && current_char != '\n')
+            {
+            }
+        }
+
+        char text[BATCH_MOVE_TEXT];
+        int length = 0;
+        for (int i = 0; line[i] != '\0' && line[i] != '\n' && line[i] != '\r'; i++)
+        {
+            if (line[i] != ' ' && line[i] != '\t' && length < BATCH_MOVE_TEXT - 1)
+            {
+                text[length++] = line[i];
+            }
+        }
+        text[length] = '\0';
+
+        if (length == 0) // blank line, the game is over
+        {
+            if (in_game && !batch_end_game(run, node))
+            {
+                return false;
+            }
+            node = 0;
+            in_game = false;
+            skipping = false;
+            continue;
+        }
+
+        in_game = true;
+        if (skipping)
+        {
+            continue;
+        }
+        int child = batch_child(run, node, text);
+        if (child == -1)
+        {
+            skipping = true;
+            continue;
+        }
+        node = child;
+        run->moves_read++;
+    }
+
+    return !in_game || batch_end_game(run, node);
+}
+
+// every game ending in the subtree under node failed on the move into it
+static void batch_fail_subtree(struct batch_run *run, int node, enum chess_error error, const struct chess_move *move)
+{
+    for (int game = run->nodes[node].first_game; game != -1; game = run->games[game].next_game)
+    {
+        run->games[game].error = error;
+        run->games[game].failed_move = *move;
+    }
+    for (int child = run->nodes[node].first_child; child != -1; child = run->nodes[child].next_sibling)
+    {
+        batch_fail_subtree(run, child, error, move);
+    }
+}
+
+// depth first walk. board is the position at node; each child gets its own
+// copy, so siblings all branch from the same saved position
+static void batch_walk(struct batch_run *run, int node, const struct chess_board *board)
+{
+    struct arena_mark mark = arena_mark(&run->arena);
+    int first_game = run->nodes[node].first_game;
+    if (first_game != -1) // duplicate games end at the same node, the position is only analysed once
+    {
+        struct batch_game *analysed = &run->games[first_game];
+        unsigned long long start = search_now_ns();
+        const struct chess_board *position = board;
+        if (run->trusted) // the trusted calls leave the attack maps behind
+        {
+            struct chess_board *attacked = arena_alloc(&run->arena, sizeof(*attacked));
+            if (attacked == NULL)
+            {
+                batch_fail_subtree(run, node, CHESS_ERROR_OUT_OF_MEMORY, &run->nodes[node].move);
+                return;
+            }
+            *attacked = *board;
+            board_update_attacks(attacked);
+            position = attacked;
+        }
+        enum chess_error error = board_analyze(position, &run->context, run->depth, &analysed->summary);
+        if (error && !run->analysis_error)
+        {
+            run->analysis_error = error;
+        }
+        if (run->report->format != REPORT_TEXT)
+        {
+            report_format_san(position, &analysed->summary, analysed->san);
+        }
+        arena_release(&run->arena, mark);
+        analysed->analysis_ns = search_now_ns() - start;
+        for (int game = analysed->next_game; game != -1; game = run->games[game].next_game)
+        {
+            run->games[game].summary = analysed->summary;
+            memcpy(run->games[game].san, analysed->san, sizeof(analysed->san));
+            run->games[game].analysis_ns = analysed->analysis_ns;
+        }
+    }
+
+    // one board for the children in turn, given back once they're all walked
+    struct chess_board *child_board = run->nodes[node].first_child != -1 ? arena_alloc(&run->arena, sizeof(*child_board)) : NULL;
+    for (int child = run->nodes[node].first_child; child != -1; child = run->nodes[child].next_sibling)
+    {
+        struct chess_move move = run->nodes[child].move;
+        if (child_board == NULL) // deeper than --arena-kb leaves room for
+        {
+            batch_fail_subtree(run, child, CHESS_ERROR_OUT_OF_MEMORY, &move);
+            continue;
+        }
+        *child_board = *board;
+
+        run->moves_resolved++;
+        enum chess_error error;
+        if (run->trusted)
+        {
+            error = board_complete_move_trusted(child_board, &move);
+            if (!error)
+            {
+                board_apply_move_trusted(child_board, &move);
+            }
+        }
+        else
+        {
+            error = board_complete_move(child_board, &move);
+            if (!error)
+            {
+                error = board_apply_move(child_board, &move);
+            }
+        }
+        if (!error && !history_push(&run->path, child_board, &move))
+        {
+            error = CHESS_ERROR_OUT_OF_MEMORY;
+        }
+        if (error)
+        {
+            batch_fail_subtree(run, child, error, &move);
+            continue;
+        }
+        batch_walk(run, child, child_board);
+        history_pop(&run->path);
+    }
+    arena_release(&run->arena, mark);
+}
+
+static int batch_analyze(struct batch_run *run, bool print_stats)
+{
+    // the table stays warm from one game to the next, games that share an opening share positions too
+    struct chess_board board;
+    board_initialize(&board);
+    history_reset(&run->path, &board);
+    batch_walk(run, 0, &board);
+
+    int exit_code = 0;
+    for (int i = 0; i < run->game_count; i++)
+    {
+        const struct batch_game *game = &run->games[i];
+        struct report_record record = {(size_t)i + 1, game->error, game->failed_move, &game->summary, game->san, game->analysis_ns};
+        report_write(run->report, &record);
+        if (game->error)
+        {
+            exit_code = 1;
+        }
+    }
+    if (run->analysis_error)
+    {
+        fprintf(stderr, "move completion error: %s\n", chess_error_string(run->analysis_error));
+        exit_code = 1;
+    }
+
+    if (print_stats)
+    {
+        fprintf(stderr, "games %d moves %llu resolved %llu trie nodes %d\n", run->game_count, run->moves_read, run->moves_resolved, run->node_count);
+        fprintf(stderr, "replay arena reserved %zu KB, most used %zu KB of %zu KB, too deep %llu\n", run->arena.reserved / 1024, run->arena.high_water / 1024,
+                run->arena.cap / 1024, run->arena.failures);
+    }
+    return exit_code;
+}
+
+int batch_main(FILE *input, struct report_writer *report, int depth, int multi_pv, bool trusted, int table_mb, int arena_kb, int threads, const struct search_pruning *pruning, const struct tablebase *tablebase, const struct eval_weights *weights, struct cache *cache, bool print_stats)
+{
+    struct batch_run run = {0};
+    run.report = report;
+    run.depth = depth;
+    run.trusted = trusted;
+    arena_init(&run.arena, (size_t)(arena_kb > 0 ? arena_kb : 1) * 1024);
+
+    int exit_code = 1;
+    if (batch_add_node(&run, "", NULL) == -1 || !batch_read_games(&run, input))
+    {
+        fprintf(stderr, "out of memory\n");
+    }
+    else if (!search_context_init(&run.context, (size_t)table_mb) || !search_context_set_threads(&run.context, threads) || !history_init(&run.path, HISTORY_GAME_PLIES))
+    {
+        fprintf(stderr, "out of memory\n");
+    }
+    else
+    {
+        run.context.tablebase = tablebase;
+        run.context.pruning = *pruning;
+        search_context_set_weights(&run.context, weights);
+        run.context.cache = cache;
+        run.context.multi_pv = multi_pv;
+        run.context.game = &run.path;
+        exit_code = batch_analyze(&run, print_stats);
+        search_context_free(&run.context);
+    }
+
+    history_free(&run.path);
+    arena_free(&run.arena);
+    free(run.nodes);
+    free(run.games);
+    return exit_code;
+}
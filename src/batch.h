@@ -0,0 +1,25 @@
+#ifndef APSC143__BATCH_H
+#define APSC143__BATCH_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "search.h"
+#include "tablebase.h"
+#include "report.h"
+#include "cache.h"
+
+// Analyzes many games in one run. Games are read from input one move per line,
+// separated by blank lines, and each game's result is written through report
+// in input order. The games are first gathered into a move trie, so a prefix that
+// several games share (usually the opening) is completed and applied once and
+// every game branches off the saved position instead of replaying it from the
+// start. Each search runs on threads threads with pruning and ranks multi_pv
+// moves (search_context.pruning and multi_pv). Final positions already in cache
+// (may be NULL) aren't searched again. Leaves are evaluated with weights
+// (NULL for the compiled-in ones). trusted replays the moves with the
+// trusted board calls (see board_apply_move_trusted). The positions along the
+// walk come from an arena of at most arena_kb kilobytes; games deeper than it
+// allows fail as out of memory. Returns the process exit code.
+int batch_main(FILE *input, struct report_writer *report, int depth, int multi_pv, bool trusted, int table_mb, int arena_kb, int threads, const struct search_pruning *pruning, const struct tablebase *tablebase, const struct eval_weights *weights, struct cache *cache, bool print_stats);
+
+#endif
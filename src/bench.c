@@ -0,0 +1,167 @@
+#include "bench.h"
+#include "board.h"
+#include "parser.h"
+#include "eval.h"
+#include "evalbatch.h"
+#include "rules.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const bench_positions[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+    "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP3PPP/R1BQKB1R w KQ - 0 8",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "2r3k1/pp3ppp/4p3/3pP3/3P4/P4N2/1P3PPP/2R3K1 w - - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "8/8/4k3/8/2P5/4K3/8/8 w - - 0 1",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1", // back rank mate
+    "r1b1kb1r/pppp1ppp/5q2/4n3/3KP3/2N3PN/PPP4P/R1BQ1B1R b kq - 0 1", // white king walked out
+};
+
+int bench_main(int depth, int table_mb, int threads, const struct search_pruning *pruning, const struct eval_weights *weights)
+{
+    struct search_context context;
+    if (!search_context_init(&context, (size_t)table_mb) || !search_context_set_threads(&context, threads))
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    context.pruning = *pruning;
+    search_context_set_weights(&context, weights);
+
+    struct search_stats total = {0};
+    long long total_ms = 0;
+    int count = (int)(sizeof(bench_positions) / sizeof(bench_positions[0]));
+    for (int i = 0; i < count; i++)
+    {
+        struct chess_board board;
+        if (board_set_fen(&board, bench_positions[i]) != CHESS_OK)
+        {
+            fprintf(stderr, "bench position %d: %s\n", i + 1, chess_error_string(CHESS_ERROR_BAD_FEN));
+            search_context_free(&context);
+            return 1;
+        }
+
+        search_context_clear(&context); // every position starts from nothing, so runs compare fairly
+        long long start = search_now_ms();
+        struct chess_move best_move;
+        int score = 0;
+        char text[10] = "-";
+        if (search_best_move(&context, &board, depth, &best_move, &score))
+        {
+            format_move_san(&board, &best_move, text);
+        }
+        long long elapsed = search_now_ms() - start;
+
+        const struct search_stats *stats = &context.stats;
+        printf("%2d  %-7s score %6d  nodes %10llu  qnodes %10llu  %6lld ms\n", i + 1, text, score, stats->nodes, stats->qnodes, elapsed);
+        total.nodes += stats->nodes;
+        total.qnodes += stats->qnodes;
+        total.null_move_cutoffs += stats->null_move_cutoffs;
+        total.late_move_reductions += stats->late_move_reductions;
+        total.late_move_researches += stats->late_move_researches;
+        total.futility_prunes += stats->futility_prunes;
+        total_ms += elapsed;
+    }
+
+    unsigned long long all_nodes = total.nodes + total.qnodes;
+    printf("depth %d  threads %d  nodes %llu  qnodes %llu  time %lld ms  %.0f nodes/s\n", depth, threads < 1 ? 1 : threads, total.nodes, total.qnodes, total_ms,
+           total_ms > 0 ? 1000.0 * (double)all_nodes / (double)total_ms : 0.0);
+    printf("null move %s cutoffs %llu  late move reductions %s %llu researched %llu  futility %s pruned %llu\n", pruning->null_move ? "on" : "off", total.null_move_cutoffs,
+           pruning->late_move_reductions ? "on" : "off", total.late_move_reductions, total.late_move_researches, pruning->futility ? "on" : "off", total.futility_prunes);
+
+    search_context_free(&context);
+    return 0;
+}
+
+// xorshift, so the random games come out the same on every run and every machine
+static uint64_t bench_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+int bench_eval_main(int positions, const struct eval_weights *weights)
+{
+    if (positions < 1)
+    {
+        positions = BENCH_DEFAULT_EVAL_POSITIONS;
+    }
+    struct evalbatch batch;
+    int32_t *expected = malloc((size_t)positions * sizeof(int32_t));
+    int32_t *scalar_scores = malloc((size_t)positions * sizeof(int32_t));
+    int32_t *scalar_mobility = malloc((size_t)positions * sizeof(int32_t));
+    if (expected == NULL || scalar_scores == NULL || scalar_mobility == NULL || !evalbatch_init(&batch, (size_t)positions))
+    {
+        fprintf(stderr, "out of memory\n");
+        free(expected);
+        free(scalar_scores);
+        free(scalar_mobility);
+        return 1;
+    }
+    evalbatch_load_weights(&batch, weights);
+
+    // random games of up to 80 plies, starting again from the next bench position when one ends
+    uint64_t state = 0x2545F4914F6CDD1Dull;
+    int position_count = (int)(sizeof(bench_positions) / sizeof(bench_positions[0]));
+    int next_position = 0;
+    struct chess_board board;
+    int plies = 0;
+    struct chess_move moves[RULES_MAX_MOVES];
+    while (batch.count < (size_t)positions)
+    {
+        if (plies == 0)
+        {
+            board_set_fen(&board, bench_positions[next_position]);
+            eval_reset(&board, weights);
+            next_position = (next_position + 1) % position_count;
+        }
+        expected[batch.count] = eval_board(&board);
+        evalbatch_add(&batch, &board);
+
+        int move_count = rules_generate_legal_moves(&board, moves);
+        if (move_count == 0 || ++plies == 80)
+        {
+            plies = 0;
+            continue;
+        }
+        board_apply_move(&board, &moves[bench_random(&state) % (uint64_t)move_count]);
+    }
+
+    unsigned long long start = search_now_ns();
+    evalbatch_run(&batch, EVALBATCH_SCALAR);
+    unsigned long long scalar_ns = search_now_ns() - start;
+    memcpy(scalar_scores, batch.scores, (size_t)positions * sizeof(int32_t));
+    memcpy(scalar_mobility, batch.mobility, (size_t)positions * sizeof(int32_t));
+
+    start = search_now_ns();
+    enum evalbatch_kernel kernel = evalbatch_run(&batch, EVALBATCH_AUTO);
+    unsigned long long fast_ns = search_now_ns() - start;
+
+    int wrong_scores = 0, disagreements = 0;
+    for (int i = 0; i < positions; i++)
+    {
+        if (scalar_scores[i] != expected[i] || batch.scores[i] != expected[i])
+        {
+            wrong_scores++;
+        }
+        if (batch.mobility[i] != scalar_mobility[i])
+        {
+            disagreements++;
+        }
+    }
+
+    printf("positions %d  scalar %.1f ns/position  %s %.1f ns/position\n", positions, (double)scalar_ns / positions, evalbatch_kernel_name(kernel), (double)fast_ns / positions);
+    printf("scores not matching eval_board %d  mobility disagreements %d\n", wrong_scores, disagreements);
+
+    evalbatch_free(&batch);
+    free(expected);
+    free(scalar_scores);
+    free(scalar_mobility);
+    return (wrong_scores || disagreements) ? 1 : 0;
+}
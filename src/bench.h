@@ -0,0 +1,28 @@
+#ifndef APSC143__BENCH_H
+#define APSC143__BENCH_H
+
+#include "search.h"
+
+// how deep the bench searches when it isn't told otherwise
+#define BENCH_DEFAULT_DEPTH 6
+
+// Searches a fixed suite of positions (openings, middlegames, endgames and a
+// couple of tactics) from a cleared table each time, and prints the best
+// move, nodes and time for each, then the totals and what each kind of
+// pruning did. The suite never changes, so runs with different pruning
+// switches, builds or weights (NULL for the compiled-in ones) can be compared
+// node for node. Returns the process exit code.
+int bench_main(int depth, int table_mb, int threads, const struct search_pruning *pruning, const struct eval_weights *weights);
+
+// how many positions the evaluation bench scores when it isn't told otherwise
+#define BENCH_DEFAULT_EVAL_POSITIONS 200000
+
+// Plays random games out from the bench positions (the same ones every run)
+// and scores every position passed on the way with evalbatch, once with the
+// scalar kernel and once with the fastest one available. Prints the time per
+// position for each, and checks that every score matches eval_board and that
+// the kernels agree on mobility too, all with weights (NULL for the
+// compiled-in ones). Returns 1 if anything disagreed.
+int bench_eval_main(int positions, const struct eval_weights *weights);
+
+#endif
@@ -1,5 +1,13 @@
 #include "board.h"
+#include "rules.h"
+#include "eval.h"
+#include "search.h"
+#include "tablebase.h"
+#include "cache.h"
+#include "history.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 const char *player_string(enum chess_player player)
 {
@@ -119,10 +127,10 @@ bool board_diagonal_check(const struct chess_board *board, int from_row, int fro
     return true;
 }
 
-bool board_can_pawn_reach(const enum chess_player player, const struct chess_board *board, int from_row, int from_col, int to_row, int to_col)
+BOARD_SPECIALISE bool board_pawn_reach_as(const struct chess_board *board, int from_row, int from_col, int to_row, int to_col, const enum chess_player player)
 {
-    int forward_direction = (player == PLAYER_WHITE) ? -1 : +1;
-    int start_row_index = (player == PLAYER_WHITE) ? 6 : 1;
+    const int forward_direction = BOARD_FORWARD(player);
+    const int start_row_index = BOARD_PAWN_START_ROW(player);
 
     int delta_row = to_row - from_row;
     int delta_col = to_col - from_col;
@@ -146,6 +154,11 @@ bool board_can_pawn_reach(const enum chess_player player, const struct chess_boa
     return false;
 }
 
+bool board_can_pawn_reach(const enum chess_player player, const struct chess_board *board, int from_row, int from_col, int to_row, int to_col)
+{
+    return (player == PLAYER_WHITE) ? board_pawn_reach_as(board, from_row, from_col, to_row, to_col, PLAYER_WHITE) : board_pawn_reach_as(board, from_row, from_col, to_row, to_col, PLAYER_BLACK);
+}
+
 bool board_is_legal_move(const struct chess_board *board, int from_row, int from_col, int to_row, int to_col)
 {
     if (to_row < 0 || to_row >= BOARD_SIZE || to_col < 0 || to_col >= BOARD_SIZE) // are we in bounds
@@ -218,280 +231,226 @@ bool board_is_legal_move(const struct chess_board *board, int from_row, int from
     return is_legal;
 }
 
-bool board_in_check(const struct chess_board *board)
+// adds every square a sliding piece hits along one ray, stopping at (and including) the first piece in the way
+static uint64_t board_ray_attacks(const struct chess_board *board, int row, int col, int row_step, int col_step)
 {
-    for (int row = 0; row < BOARD_SIZE; row++)
+    uint64_t attacked = 0;
+    int r = row + row_step;
+    int c = col + col_step;
+
+    while (r >= 0 && r < BOARD_SIZE && c >= 0 && c < BOARD_SIZE)
     {
-        for (int col = 0; col < BOARD_SIZE; col++)
+        attacked |= BOARD_SQUARE_BIT(r, c);
+        if (board->squares[r][c].has_piece) // the ray is blocked here
         {
-            if (board->squares[row][col].has_piece && board->squares[row][col].owner == board->next_move_player && board->squares[row][col].piece == PIECE_KING) // if the square holds the current player's king
-            {
-                // store the king's position
-                int king_row = row;
-                int king_col = col;
-
-                for (int from_row = 0; from_row < BOARD_SIZE; from_row++)
-                {
-                    for (int from_col = 0; from_col < BOARD_SIZE; from_col++)
-                    {
-                        const struct square *source_square = &board->squares[from_row][from_col]; // get the current square we are checking
-                        if (!source_square->has_piece)                                            // skip empty squares
-                        {
-                            continue;
-                        }
-                        if (source_square->owner == board->next_move_player) // skip all of our own pieces THUS we are checking all of the opponent's pieces to see if they can legally "take" our king
-                        {
-                            continue;
-                        }
-                        if (board_is_legal_move(board, from_row, from_col, king_row, king_col)) // if any opponent piece can legally move to the king's square, we are in check
-                        {
-                            return true;
-                        }
-                    }
-                }
-            }
+            break;
         }
+        r += row_step;
+        c += col_step;
     }
-    return false;
+
+    return attacked;
 }
 
-bool board_in_checkmate(const struct chess_board *board)
+// adds a single square if it is on the board (used for the pawn, knight and king patterns)
+static uint64_t board_step_attack(int row, int col)
 {
-    if (!board_in_check(board))
+    if (row < 0 || row >= BOARD_SIZE || col < 0 || col >= BOARD_SIZE)
     {
-        return false;
+        return 0;
     }
+    return BOARD_SQUARE_BIT(row, col);
+}
+
+static const int board_knight_offsets[8][2] = {{-2, -1}, {-2, 1}, {-1, -2}, {-1, 2}, {1, -2}, {1, 2}, {2, -1}, {2, 1}};
+static const int board_king_offsets[8][2] = {{-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1}};
+
+// every square the piece on (row, col) attacks. unlike board_is_legal_move this ignores what is on the
+// destination, so squares holding our own pieces (defended squares) and empty pawn diagonals count too
+uint64_t board_piece_attacks(const struct chess_board *board, int row, int col)
+{
+    const struct square *square = &board->squares[row][col];
+    uint64_t attacked = 0;
 
-    for (int from_row = 0; from_row < BOARD_SIZE; from_row++)
+    switch (square->piece)
     {
-        for (int from_col = 0; from_col < BOARD_SIZE; from_col++)
+    case PIECE_PAWN:
+        attacked = board_pawn_attacks(BOARD_SQUARE_BIT(row, col), square->owner);
+        break;
+
+    case PIECE_KNIGHT:
+        for (int i = 0; i < 8; i++)
         {
-            const struct square *src = &board->squares[from_row][from_col];
+            attacked |= board_step_attack(row + board_knight_offsets[i][0], col + board_knight_offsets[i][1]);
+        }
+        break;
 
-            if (!src->has_piece || src->owner != board->next_move_player)
-            {
-                continue;
-            }
+    case PIECE_KING:
+        for (int i = 0; i < 8; i++)
+        {
+            attacked |= board_step_attack(row + board_king_offsets[i][0], col + board_king_offsets[i][1]);
+        }
+        break;
 
-            for (int to_row = 0; to_row < BOARD_SIZE; to_row++)
-            {
-                for (int to_col = 0; to_col < BOARD_SIZE; to_col++)
-                {
-                    const struct square *dst = &board->squares[to_row][to_col];
-
-                    if (dst->has_piece && dst->owner == board->next_move_player)
-                    {
-                        continue;
-                    }
-
-                    if (!board_is_legal_move(board, from_row, from_col, to_row, to_col))
-                    {
-                        continue;
-                    }
-
-                    struct chess_move test_move = {0};
-
-                    test_move.player = board->next_move_player;
-                    test_move.piece_type = src->piece;
-                    test_move.from_row = from_row;
-                    test_move.from_col = from_col;
-                    test_move.to_row = to_row;
-                    test_move.to_col = to_col;
-                    test_move.is_capture = (dst->has_piece && dst->owner != board->next_move_player);
-                    test_move.is_promotion = false;
-
-                    if (test_move.piece_type == PIECE_PAWN)
-                    {
-                        if ((board->next_move_player == PLAYER_WHITE && to_row == 0) ||
-                            (board->next_move_player == PLAYER_BLACK && to_row == 7))
-                        {
-                            test_move.is_promotion = true;
-                            test_move.promo_piece = PIECE_QUEEN;
-                        }
-                    }
-
-                    struct chess_board test = *board;
-                    board_apply_move(&test, &test_move);
-
-                    test.next_move_player = test_move.player;
-
-                    if (!board_in_check(&test))
-                    {
-                        return false;
-                    }
-                }
-            }
+    case PIECE_BISHOP:
+    case PIECE_ROOK:
+    case PIECE_QUEEN:
+        if (square->piece != PIECE_ROOK) // diagonals for bishops and queens
+        {
+            attacked |= board_ray_attacks(board, row, col, -1, -1);
+            attacked |= board_ray_attacks(board, row, col, -1, 1);
+            attacked |= board_ray_attacks(board, row, col, 1, -1);
+            attacked |= board_ray_attacks(board, row, col, 1, 1);
         }
+        if (square->piece != PIECE_BISHOP) // straight lines for rooks and queens
+        {
+            attacked |= board_ray_attacks(board, row, col, -1, 0);
+            attacked |= board_ray_attacks(board, row, col, 1, 0);
+            attacked |= board_ray_attacks(board, row, col, 0, -1);
+            attacked |= board_ray_attacks(board, row, col, 0, 1);
+        }
+        break;
     }
 
-    return true;
+    return attacked;
 }
 
-bool board_in_stalemate(const struct chess_board *board)
+void board_reset_pieces(struct chess_board *board)
 {
-    if (board_in_check(board))
-    {
-        return false;
-    }
-    for (int from_row = 0; from_row < BOARD_SIZE; from_row++)
+    memset(board->pieces, 0, sizeof(board->pieces));
+    for (int row = 0; row < BOARD_SIZE; row++)
     {
-        for (int from_col = 0; from_col < BOARD_SIZE; from_col++)
+        for (int col = 0; col < BOARD_SIZE; col++)
         {
-            const struct square *src = &board->squares[from_row][from_col];
-            if (!src->has_piece || src->owner != board->next_move_player)
-            {
-                continue;
-            }
-
-            for (int to_row = 0; to_row < BOARD_SIZE; to_row++)
+            const struct square *square = &board->squares[row][col];
+            if (square->has_piece)
             {
-                for (int to_col = 0; to_col < BOARD_SIZE; to_col++)
-                {
-                    const struct square *dst = &board->squares[to_row][to_col];
-                    if (dst->has_piece && dst->owner == board->next_move_player)
-                    {
-                        continue;
-                    }
-
-                    if (!board_is_legal_move(board, from_row, from_col, to_row, to_col))
-                    {
-                        continue;
-                    }
-
-                    struct chess_move test_move = {0};
-
-                    test_move.player = board->next_move_player;
-                    test_move.piece_type = src->piece;
-                    test_move.from_row = from_row;
-                    test_move.from_col = from_col;
-                    test_move.to_row = to_row;
-                    test_move.to_col = to_col;
-                    test_move.is_capture = (dst->has_piece && dst->owner != board->next_move_player);
-                    test_move.is_promotion = false;
-
-                    if (test_move.piece_type == PIECE_PAWN)
-                    {
-                        if ((board->next_move_player == PLAYER_WHITE && to_row == 0) ||
-                            (board->next_move_player == PLAYER_BLACK && to_row == 7))
-                        {
-                            test_move.is_promotion = true;
-                            test_move.promo_piece = PIECE_QUEEN;
-                        }
-                    }
-
-                    struct chess_board test = *board;
-                    board_apply_move(&test, &test_move);
-                    test.next_move_player = test_move.player;
-
-                    if (!board_in_check(&test))
-                    {
-                        return false;
-                    }
-                }
+                board->pieces[square->owner][square->piece] |= BOARD_SQUARE_BIT(row, col);
             }
         }
     }
-    return true;
 }
 
-bool board_can_castle(const struct chess_board *board, bool kingside)
+BOARD_SPECIALISE void board_update_side(struct chess_board *board, const enum chess_player player)
 {
-    int row = (board->next_move_player == PLAYER_WHITE) ? 7 : 0;
-    if (board->next_move_player == PLAYER_WHITE)
+    const uint64_t *pieces = board->pieces[player];
+
+    // pawns all at once, everything else one piece at a time
+    uint64_t attacked = board_pawn_attacks(pieces[PIECE_PAWN], player);
+    uint64_t occupied = pieces[PIECE_PAWN];
+    for (int piece = PIECE_KNIGHT; piece <= PIECE_KING; piece++)
     {
-        if (kingside && !board->rights.white_kingside)
+        occupied |= pieces[piece];
+        for (uint64_t remaining = pieces[piece]; remaining; remaining &= remaining - 1)
         {
-            return false;
-        }
-        if (!kingside && !board->rights.white_queenside)
-        {
-            return false;
+            int square_index = board_lowest_square(remaining);
+            attacked |= board_piece_attacks(board, square_index / BOARD_SIZE, square_index % BOARD_SIZE);
         }
     }
-    else
+    board->attacks[player] = attacked;
+    board->occupied[player] = occupied;
+
+    // remember where the king is so check is a single lookup
+    uint64_t king = pieces[PIECE_KING];
+    board->king_row[player] = king ? board_lowest_square(king) / BOARD_SIZE : -1;
+    board->king_col[player] = king ? board_lowest_square(king) % BOARD_SIZE : -1;
+}
+
+void board_update_attacks(struct chess_board *board)
+{
+    board_update_side(board, PLAYER_WHITE);
+    board_update_side(board, PLAYER_BLACK);
+}
+
+bool board_square_attacked(const struct chess_board *board, enum chess_player attacker, int row, int col)
+{
+    return (board->attacks[attacker] & BOARD_SQUARE_BIT(row, col)) != 0;
+}
+
+bool board_in_check(const struct chess_board *board)
+{
+    enum chess_player player = board->next_move_player;
+    enum chess_player opponent = (player == PLAYER_WHITE) ? PLAYER_BLACK : PLAYER_WHITE;
+
+    if (board->king_row[player] < 0) // no king on the board, nothing to be in check
     {
-        if (kingside && !board->rights.black_kingside)
-        {   
-            return false;
-        }
-        if (!kingside && !board->rights.black_queenside)
-        {
-            return false;
-        }
+        return false;
     }
 
-    int king_from_col = 4;
-    int rook_col = kingside ? 7 : 0;
-    int king_to_col = kingside ? 6 : 2;
-
-    const struct square *king_square = &board->squares[row][king_from_col];
-    const struct square *rook_square = &board->squares[row][rook_col];
+    // we are in check if the king's square is one the opponent attacks
+    return board_square_attacked(board, opponent, board->king_row[player], board->king_col[player]);
+}
 
-    if (!king_square->has_piece || king_square->owner != board->next_move_player || king_square->piece != PIECE_KING)
+bool board_in_checkmate(const struct chess_board *board)
+{
+    if (!board_in_check(board))
     {
         return false;
     }
 
-    if (!rook_square->has_piece || rook_square->owner != board->next_move_player || rook_square->piece != PIECE_ROOK)
+    struct chess_move moves[RULES_MAX_MOVES];
+    return rules_generate_legal_moves(board, moves) == 0; // in check with nowhere to go
+}
+
+bool board_in_stalemate(const struct chess_board *board)
+{
+    if (board_in_check(board))
     {
         return false;
     }
 
-    if (kingside)
+    struct chess_move moves[RULES_MAX_MOVES];
+    return rules_generate_legal_moves(board, moves) == 0; // not in check but nothing legal to play
+}
+
+// everything about castling but check: the right, king and rook at home and nothing in between
+BOARD_SPECIALISE bool board_castle_path_clear_as(const struct chess_board *board, bool kingside, const enum chess_player player)
+{
+    const int row = BOARD_BACK_ROW(player);
+
+    bool has_right;
+    if (player == PLAYER_WHITE)
     {
-        if (board->squares[row][5].has_piece || board->squares[row][6].has_piece)
-        {
-            return false;
-        }
+        has_right = kingside ? board->rights.white_kingside : board->rights.white_queenside;
     }
     else
     {
-        if (board->squares[row][1].has_piece || board->squares[row][2].has_piece || board->squares[row][3].has_piece)
-        {
-            return false;
-        }
+        has_right = kingside ? board->rights.black_kingside : board->rights.black_queenside;
     }
-
-    if (board_in_check(board))
+    if (!has_right)
     {
         return false;
     }
 
-    struct chess_board test_board = *board;
-    struct chess_move test_move = {0};
-    test_move.player = board->next_move_player;
-    test_move.piece_type = PIECE_KING;
-    test_move.is_castle = false;
-    test_move.is_capture = false;
-    test_move.is_promotion = false;
-
-    int step = (king_to_col > king_from_col) ? 1 : -1;
-    int king_col = king_from_col;
-
-    while (king_col != king_to_col)
+    // king and rook still at home
+    if (!(board->pieces[player][PIECE_KING] & BOARD_SQUARE_BIT(row, 4)) || !(board->pieces[player][PIECE_ROOK] & BOARD_SQUARE_BIT(row, kingside ? 7 : 0)))
     {
-        int next_col = king_col + step;
-
-        test_move.from_row = row;
-        test_move.from_col = king_col;
-        test_move.to_row = row;
-        test_move.to_col = next_col;
-
-        board_apply_move(&test_board, &test_move);
-
-        // board_apply_move flips next_move_player;
-        // we want to check the king that just moved.
-        test_board.next_move_player = test_move.player;
+        return false;
+    }
 
-        king_col = next_col;
+    // nothing in between
+    uint64_t between = kingside ? BOARD_SQUARE_BIT(row, 5) | BOARD_SQUARE_BIT(row, 6) : BOARD_SQUARE_BIT(row, 1) | BOARD_SQUARE_BIT(row, 2) | BOARD_SQUARE_BIT(row, 3);
+    return !((board->occupied[PLAYER_WHITE] | board->occupied[PLAYER_BLACK]) & between);
+}
 
-        if (board_in_check(&test_board))
-        {
-            return false;
-        }
+BOARD_SPECIALISE bool board_can_castle_as(const struct chess_board *board, bool kingside, const enum chess_player player)
+{
+    const int row = BOARD_BACK_ROW(player);
+    const enum chess_player opponent = BOARD_OPPONENT(player);
+    if (!board_castle_path_clear_as(board, kingside, player))
+    {
+        return false;
     }
 
-    return true;
+    // the king can't castle out of check, or pass through or land on a square the opponent attacks. the
+    // squares it crosses are empty, so moving the king along the rank doesn't change which of them are attacked
+    uint64_t king_path = kingside ? BOARD_SQUARE_BIT(row, 4) | BOARD_SQUARE_BIT(row, 5) | BOARD_SQUARE_BIT(row, 6) : BOARD_SQUARE_BIT(row, 4) | BOARD_SQUARE_BIT(row, 3) | BOARD_SQUARE_BIT(row, 2);
+    return !(board->attacks[opponent] & king_path);
+}
+
+bool board_can_castle(const struct chess_board *board, bool kingside)
+{
+    return (board->next_move_player == PLAYER_WHITE) ? board_can_castle_as(board, kingside, PLAYER_WHITE) : board_can_castle_as(board, kingside, PLAYER_BLACK);
 }
 
 void board_initialize(struct chess_board *board)
@@ -533,42 +492,211 @@ void board_initialize(struct chess_board *board)
     board->squares[7][6] = (struct square){true, PIECE_KNIGHT, PLAYER_WHITE};
     board->squares[7][7] = (struct square){true, PIECE_ROOK, PLAYER_WHITE};
 
+    // nobody has moved a king or rook yet
+    board->rights = (struct castling_rights){true, true, true, true};
+
     // set next move player
     board->next_move_player = PLAYER_WHITE;
+
+    board_reset_pieces(board);
+    eval_reset(board, NULL);
+    board_update_attacks(board);
+    board->hash = board_compute_hash(board);
+    board->pawn_hash = board_compute_pawn_hash(board);
 }
 
-void board_complete_move(const struct chess_board *board, struct chess_move *move)
+// piece letters as they appear in FEN, white's upper case
+static bool board_piece_from_letter(char letter, enum chess_piece *piece, enum chess_player *owner)
 {
-    move->player = board->next_move_player; // set the player making the move
+    static const char letters[] = "pnbrqk";
 
-    if (move->is_castle)
+    *owner = (letter >= 'A' && letter <= 'Z') ? PLAYER_WHITE : PLAYER_BLACK;
+    char lower = (*owner == PLAYER_WHITE) ? (char)(letter - 'A' + 'a') : letter;
+
+    for (int i = 0; i < 6; i++)
     {
-        if (!board_can_castle(board, move->castle_kingside))
+        if (letters[i] == lower)
         {
-            panicf("move completion error: illegal castling by %s\n", player_string(move->player));
+            *piece = (enum chess_piece)i;
+            return true;
         }
+    }
+    return false;
+}
 
-        int row = (move->player == PLAYER_WHITE) ? 7 : 0;
+enum chess_error board_set_fen(struct chess_board *board, const char *fen)
+{
+    struct chess_board result;
+    board_initialize(&result); // start from something valid, then wipe the squares
+
+    for (int row = 0; row < BOARD_SIZE; row++)
+    {
+        for (int col = 0; col < BOARD_SIZE; col++)
+        {
+            result.squares[row][col].has_piece = false;
+            result.squares[row][col].owner = PLAYER_WHITE;
+        }
+    }
+
+    // piece placement, rank 8 first, which is row 0 for us
+    const char *cursor = fen;
+    int row = 0;
+    int col = 0;
+    while (*cursor != '\0' && *cursor != ' ')
+    {
+        char letter = *cursor++;
+        if (letter == '/')
+        {
+            if (col != BOARD_SIZE)
+            {
+                return CHESS_ERROR_BAD_FEN;
+            }
+            row++;
+            col = 0;
+        }
+        else if (letter >= '1' && letter <= '8')
+        {
+            col += letter - '0';
+        }
+        else
+        {
+            enum chess_piece piece;
+            enum chess_player owner;
+            if (!board_piece_from_letter(letter, &piece, &owner) || row >= BOARD_SIZE || col >= BOARD_SIZE)
+            {
+                return CHESS_ERROR_BAD_FEN;
+            }
+            result.squares[row][col] = (struct square){true, piece, owner, col, row};
+            col++;
+        }
+
+        if (col > BOARD_SIZE)
+        {
+            return CHESS_ERROR_BAD_FEN;
+        }
+    }
+    if (row != BOARD_SIZE - 1 || col != BOARD_SIZE)
+    {
+        return CHESS_ERROR_BAD_FEN;
+    }
+
+    // side to move
+    while (*cursor == ' ')
+    {
+        cursor++;
+    }
+    if (*cursor == 'w' || *cursor == 'b')
+    {
+        result.next_move_player = (*cursor == 'w') ? PLAYER_WHITE : PLAYER_BLACK;
+        cursor++;
+    }
+    else if (*cursor != '\0')
+    {
+        return CHESS_ERROR_BAD_FEN;
+    }
+
+    // castling rights, anything after them (en passant square, move counters) we don't track
+    while (*cursor == ' ')
+    {
+        cursor++;
+    }
+    result.rights = (struct castling_rights){false, false, false, false};
+    while (*cursor != '\0' && *cursor != ' ')
+    {
+        switch (*cursor++)
+        {
+        case 'K':
+            result.rights.white_kingside = true;
+            break;
+        case 'Q':
+            result.rights.white_queenside = true;
+            break;
+        case 'k':
+            result.rights.black_kingside = true;
+            break;
+        case 'q':
+            result.rights.black_queenside = true;
+            break;
+        case '-':
+            break;
+        default:
+            return CHESS_ERROR_BAD_FEN;
+        }
+    }
+
+    board_reset_pieces(&result);
+
+    // only positions a game can reach: one king each, no pawn on the first or last rank
+    uint64_t back_ranks = (uint64_t)0xFF | (uint64_t)0xFF << ((BOARD_SIZE - 1) * BOARD_SIZE);
+    for (int player = PLAYER_WHITE; player <= PLAYER_BLACK; player++)
+    {
+        if (board_count_squares(result.pieces[player][PIECE_KING]) != 1 || (result.pieces[player][PIECE_PAWN] & back_ranks) != 0)
+        {
+            return CHESS_ERROR_BAD_FEN;
+        }
+    }
+
+    // a right is only worth keeping while the king and that rook are still at home
+    uint64_t white_king = result.pieces[PLAYER_WHITE][PIECE_KING], white_rooks = result.pieces[PLAYER_WHITE][PIECE_ROOK];
+    uint64_t black_king = result.pieces[PLAYER_BLACK][PIECE_KING], black_rooks = result.pieces[PLAYER_BLACK][PIECE_ROOK];
+    bool white_home = (white_king & BOARD_SQUARE_BIT(7, 4)) != 0, black_home = (black_king & BOARD_SQUARE_BIT(0, 4)) != 0;
+    result.rights.white_kingside = result.rights.white_kingside && white_home && (white_rooks & BOARD_SQUARE_BIT(7, 7));
+    result.rights.white_queenside = result.rights.white_queenside && white_home && (white_rooks & BOARD_SQUARE_BIT(7, 0));
+    result.rights.black_kingside = result.rights.black_kingside && black_home && (black_rooks & BOARD_SQUARE_BIT(0, 7));
+    result.rights.black_queenside = result.rights.black_queenside && black_home && (black_rooks & BOARD_SQUARE_BIT(0, 0));
+
+    board_update_attacks(&result);
+    // the side that just moved can't have left its king attacked
+    enum chess_player waiting = (result.next_move_player == PLAYER_WHITE) ? PLAYER_BLACK : PLAYER_WHITE;
+    if (board_square_attacked(&result, result.next_move_player, result.king_row[waiting], result.king_col[waiting]))
+    {
+        return CHESS_ERROR_BAD_FEN;
+    }
+
+    eval_reset(&result, NULL);
+    result.hash = board_compute_hash(&result);
+    result.pawn_hash = board_compute_pawn_hash(&result);
+
+    *board = result;
+    return CHESS_OK;
+}
 
-        move->from_row = row;
-        move->from_col = 4;
-        move->to_row = row;
-        move->to_col = move->castle_kingside ? 6 : 2;
+// the king's squares for a castle, once we know it may castle
+static void board_fill_castle(struct chess_move *move)
+{
+    int row = (move->player == PLAYER_WHITE) ? 7 : 0;
+
+    move->from_row = row;
+    move->from_col = 4;
+    move->to_row = row;
+    move->to_col = move->castle_kingside ? 6 : 2;
+
+    move->piece_type = PIECE_KING;
+    move->is_capture = false;
+    move->is_promotion = false;
+}
 
-        move->piece_type = PIECE_KING;
-        move->is_capture = false;
-        move->is_promotion = false;
+enum chess_error board_complete_move(const struct chess_board *board, struct chess_move *move)
+{
+    move->player = board->next_move_player; // set the player making the move
 
-        return;
+    if (move->is_castle)
+    {
+        if (!board_can_castle(board, move->castle_kingside))
+        {
+            return CHESS_ERROR_ILLEGAL_CASTLE;
+        }
+        board_fill_castle(move);
+        return CHESS_OK;
     }
 
     if (move->to_row < 0 || move->to_row >= BOARD_SIZE || move->to_col < 0 || move->to_col >= BOARD_SIZE) // are we in bounds
     {
-        panicf("move completion error: %s %s to %c%c\n", player_string(move->player), piece_string(move->piece_type), 'a' + move->to_col, '1' + (8 - move->to_row - 1));
+        return CHESS_ERROR_ILLEGAL_MOVE;
     }
     if (board->squares[move->to_row][move->to_col].has_piece && board->squares[move->to_row][move->to_col].owner == move->player) // if our destination has our OWN piece, we can't move there.
     {
-        panicf("move completion error: %s %s to %c%c\n", player_string(move->player), piece_string(move->piece_type), 'a' + move->to_col, '1' + (8 - move->to_row - 1));
+        return CHESS_ERROR_ILLEGAL_MOVE;
     }
 
     // we use arrays to store possible source squares. one for rows and one for columns
@@ -577,54 +705,41 @@ void board_complete_move(const struct chess_board *board, struct chess_move *mov
     int possible_cols[16];
     int possible_moves = 0;
 
-    for (int from_row = 0; from_row < BOARD_SIZE; from_row++)
+    // only the squares that actually hold one of our pieces of this type
+    for (uint64_t candidates = board->pieces[move->player][move->piece_type]; candidates; candidates &= candidates - 1)
     {
-        for (int from_col = 0; from_col < BOARD_SIZE; from_col++)
-        {
-            const struct square *source_square = &board->squares[from_row][from_col]; // current square
-            if (!source_square->has_piece)
-            {
-                continue;
-            }
-            if (source_square->owner != move->player)
-            {
-                continue;
-            }
-            if (source_square->piece != move->piece_type)
-            {
-                continue;
-            }
+        int from_row = board_lowest_square(candidates) / BOARD_SIZE;
+        int from_col = board_lowest_square(candidates) % BOARD_SIZE;
 
-            if (move->from_row != -1 && move->from_row != from_row)
-            {
-                continue;
-            }
-            if (move->from_col != -1 && move->from_col != from_col)
-            {
-                continue;
-            }
+        if (move->from_row != -1 && move->from_row != from_row)
+        {
+            continue;
+        }
+        if (move->from_col != -1 && move->from_col != from_col)
+        {
+            continue;
+        }
 
-            if (!board_is_legal_move(board, from_row, from_col, move->to_row, move->to_col))
-            {
-                continue;
-            }
+        if (!board_is_legal_move(board, from_row, from_col, move->to_row, move->to_col))
+        {
+            continue;
+        }
 
-            if (possible_moves < (int)(sizeof(possible_rows) / sizeof(possible_rows[0]))) // check if we have space to store another possible move
-            {
-                possible_rows[possible_moves] = from_row;
-                possible_cols[possible_moves] = from_col;
-                possible_moves++; // increment the count of possible moves
-            }
+        if (possible_moves < (int)(sizeof(possible_rows) / sizeof(possible_rows[0]))) // check if we have space to store another possible move
+        {
+            possible_rows[possible_moves] = from_row;
+            possible_cols[possible_moves] = from_col;
+            possible_moves++; // increment the count of possible moves
         }
     }
 
     if (possible_moves == 0) // if we found no possible moves, the move is invalid
     {
-        panicf("move completion error: %s %s to %c%c\n", player_string(move->player), piece_string(move->piece_type), 'a' + move->to_col, '1' + (8 - move->to_row - 1));
+        return CHESS_ERROR_ILLEGAL_MOVE;
     }
     else if (possible_moves > 1) // if we found multiple possible moves, the move is ambiguous
     {
-        panicf("parse error: ambiguous move\n"); // ambiguous move panic statement not outlined in rubric??? i will keep for my own sanity
+        return CHESS_ERROR_AMBIGUOUS_MOVE; // ambiguous move panic statement not outlined in rubric??? i will keep for my own sanity
     }
 
     // set the source square of the move
@@ -645,378 +760,684 @@ void board_complete_move(const struct chess_board *board, struct chess_move *mov
             move->is_promotion = false;
         }
     }
+
+    return CHESS_OK;
 }
 
-void board_apply_move(struct chess_board *board, const struct chess_move *move)
+// the squares holding player's pieces of this type that could move to (row, col). instead of trying
+// every piece of the type like board_complete_move, look outwards from the target the way the piece
+// moves: whatever we run into first along each ray or step is the only thing that can come from there
+static uint64_t board_movers_to(const struct chess_board *board, enum chess_player player, enum chess_piece piece, int row, int col)
 {
-    if (move->from_row < 0 || move->from_row >= BOARD_SIZE || move->from_col < 0 || move->from_col >= BOARD_SIZE || move->to_row < 0 || move->to_row >= BOARD_SIZE || move->to_col < 0 || move->to_col >= BOARD_SIZE)
-    {
-        panicf("move completion error: %s %s to %c%c\n", player_string(move->player), piece_string(move->piece_type), 'a' + move->to_col, '1' + (8 - move->to_row - 1));
-    }
-
-    // get the source and destination squares
-    struct square *src = &board->squares[move->from_row][move->from_col];
-    struct square *dst = &board->squares[move->to_row][move->to_col];
+    const uint64_t ours = board->pieces[player][piece];
+    uint64_t reach = 0;
 
-    if (!src->has_piece || src->owner != move->player || src->piece != move->piece_type) // if our source square does not have a piece or the owner if the source square is not the current player or the source piece does not equal the move piece type
+    switch (piece)
     {
-        panicf("move completion error: %s %s to %c%c\n", player_string(move->player), piece_string(move->piece_type), 'a' + move->to_col, '1' + (8 - move->to_row - 1));
+    case PIECE_PAWN:
+    {
+        if (board->squares[row][col].has_piece) // pawns only capture diagonally, from where an enemy pawn on the target would attack
+        {
+            return board_pawn_attacks(BOARD_SQUARE_BIT(row, col), BOARD_OPPONENT(player)) & ours;
+        }
+        // a push comes from one square behind, or two from the starting row over an empty square
+        int behind = row - BOARD_FORWARD(player);
+        if (behind < 0 || behind >= BOARD_SIZE)
+        {
+            return 0;
+        }
+        if (board->squares[behind][col].has_piece)
+        {
+            return ours & BOARD_SQUARE_BIT(behind, col);
+        }
+        int start = behind - BOARD_FORWARD(player);
+        return start == BOARD_PAWN_START_ROW(player) ? ours & BOARD_SQUARE_BIT(start, col) : 0;
     }
 
-    if (move->is_castle)
-    {
-        // castle logic
-        int row = (move->player == PLAYER_WHITE) ? 7 : 0;
+    case PIECE_KNIGHT:
+        for (int i = 0; i < 8; i++)
+        {
+            reach |= board_step_attack(row + board_knight_offsets[i][0], col + board_knight_offsets[i][1]);
+        }
+        break;
 
-        struct square *rook_src;
-        struct square *rook_dst;
+    case PIECE_KING:
+        for (int i = 0; i < 8; i++)
+        {
+            reach |= board_step_attack(row + board_king_offsets[i][0], col + board_king_offsets[i][1]);
+        }
+        break;
 
-        if (move->castle_kingside)
+    case PIECE_BISHOP:
+    case PIECE_ROOK:
+    case PIECE_QUEEN:
+        if (piece != PIECE_ROOK)
         {
-            rook_src = &board->squares[row][7];
-            rook_dst = &board->squares[row][5];
+            reach |= board_ray_attacks(board, row, col, -1, -1);
+            reach |= board_ray_attacks(board, row, col, -1, 1);
+            reach |= board_ray_attacks(board, row, col, 1, -1);
+            reach |= board_ray_attacks(board, row, col, 1, 1);
         }
-        else
+        if (piece != PIECE_BISHOP)
         {
-            rook_src = &board->squares[row][0];
-            rook_dst = &board->squares[row][3];
+            reach |= board_ray_attacks(board, row, col, -1, 0);
+            reach |= board_ray_attacks(board, row, col, 1, 0);
+            reach |= board_ray_attacks(board, row, col, 0, -1);
+            reach |= board_ray_attacks(board, row, col, 0, 1);
         }
+        break;
+    }
 
-        if (!rook_src->has_piece || rook_src->owner != move->player || rook_src->piece != PIECE_ROOK)
+    return reach & ours;
+}
+
+static enum chess_error board_resolve_move(const struct chess_board *board, struct chess_move *move)
+{
+    move->player = board->next_move_player;
+
+    // the archive says the castle was legal, so skip the attack maps and only make sure the pieces are
+    // where castling needs them. they are cheap to look at, and a replay gone wrong stops here
+    if (move->is_castle)
+    {
+        bool clear = move->player == PLAYER_WHITE ? board_castle_path_clear_as(board, move->castle_kingside, PLAYER_WHITE)
+                                                  : board_castle_path_clear_as(board, move->castle_kingside, PLAYER_BLACK);
+        if (!clear)
         {
-            panicf("move completion error: %s %s to %c%c\n", player_string(move->player), piece_string(move->piece_type), 'a' + move->to_col, '1' + (8 - move->to_row - 1));
+            return CHESS_ERROR_ILLEGAL_CASTLE;
         }
+        board_fill_castle(move);
+        return CHESS_OK;
+    }
 
-        *rook_dst = *rook_src;
-        rook_src->has_piece = false;
+    if (move->to_row < 0 || move->to_row >= BOARD_SIZE || move->to_col < 0 || move->to_col >= BOARD_SIZE || (unsigned)move->piece_type > PIECE_KING)
+    {
+        return board_complete_move(board, move);
+    }
+    const struct square *dst = &board->squares[move->to_row][move->to_col];
+    if (dst->has_piece && dst->owner == move->player)
+    {
+        return board_complete_move(board, move);
     }
 
-    *dst = *src; // apply the move by copying the struct from source to destination
+    uint64_t movers = board_movers_to(board, move->player, move->piece_type, move->to_row, move->to_col);
+    if (move->from_row != -1)
+    {
+        movers &= (uint64_t)0xFF << (move->from_row * BOARD_SIZE);
+    }
+    if (move->from_col != -1)
+    {
+        movers &= BOARD_FILE_A << move->from_col;
+    }
+    if (movers == 0 || (movers & (movers - 1)) != 0) // no mover or several: let the full path say which error it is
+    {
+        return board_complete_move(board, move);
+    }
 
-    if (move->is_promotion)
+    move->from_row = board_lowest_square(movers) / BOARD_SIZE;
+    move->from_col = board_lowest_square(movers) % BOARD_SIZE;
+    move->is_capture = dst->has_piece;
+    if (move->piece_type == PIECE_PAWN)
     {
-        dst->piece = move->promo_piece; // promote the pawn to the specified piece (PARSER WILL SET THIS LATER)
+        move->is_promotion = move->to_row == BOARD_PROMOTION_ROW(move->player);
     }
+    return CHESS_OK;
+}
 
-    src->has_piece = false; // empty the source square
+#ifdef CHESS_CHECK_TRUSTED
+static bool board_same_move(const struct chess_move *a, const struct chess_move *b)
+{
+    return a->player == b->player && a->piece_type == b->piece_type && a->from_row == b->from_row && a->from_col == b->from_col &&
+           a->to_row == b->to_row && a->to_col == b->to_col && a->is_capture == b->is_capture && a->is_promotion == b->is_promotion &&
+           a->promo_piece == b->promo_piece && a->is_castle == b->is_castle && a->castle_kingside == b->castle_kingside;
+}
 
-    board->next_move_player = (board->next_move_player == PLAYER_WHITE) ? PLAYER_BLACK : PLAYER_WHITE; // switch the next move player
+// a trusted call disagreed with the checked one: the archive wasn't as clean as we were told, or the
+// fast path has a bug. either way carrying on would give wrong answers, so stop right here
+static void board_trusted_mismatch(const char *what, const struct chess_move *move)
+{
+    fprintf(stderr, "trusted %s disagrees with the checked one: %s %s to %c%d\n", what, player_string(move->player),
+            piece_string(move->piece_type), 'a' + move->to_col, BOARD_SIZE - move->to_row);
+    abort();
 }
+#endif
 
-int board_score_move(const struct chess_board *board, const struct chess_move *move)
+enum chess_error board_complete_move_trusted(const struct chess_board *board, struct chess_move *move)
+{
+#ifdef CHESS_CHECK_TRUSTED
+    // the checked path may look at the attack maps (castling), which a trusted replay lets go stale
+    struct chess_board checked_board = *board;
+    board_update_attacks(&checked_board);
+    struct chess_move checked = *move;
+    enum chess_error expected = board_complete_move(&checked_board, &checked);
+
+    enum chess_error error = board_resolve_move(board, move);
+    if (error != expected || (!error && !board_same_move(move, &checked)))
+    {
+        board_trusted_mismatch("completion", move);
+    }
+    return error;
+#else
+    return board_resolve_move(board, move);
+#endif
+}
+
+// splitmix64 finaliser: turns a small index into a well mixed 64 bit key, so the zobrist keys need
+// no random table to be set up (and shared) before the first board exists
+static uint64_t board_zobrist_mix(uint64_t value)
+{
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+uint64_t board_zobrist_piece(enum chess_piece piece, enum chess_player owner, int row, int col)
 {
-    int score = 0;
+    return board_zobrist_mix(1 + (uint64_t)((owner * 6 + piece) * 64 + row * BOARD_SIZE + col));
+}
 
-    if (move->piece_type == PIECE_KING && !move->is_castle)
+uint64_t board_zobrist_rights(const struct castling_rights *rights)
+{
+    int index = rights->white_kingside | rights->white_queenside << 1 | rights->black_kingside << 2 | rights->black_queenside << 3;
+    return board_zobrist_mix(0x1000 + index);
+}
+
+uint64_t board_zobrist_side(void)
+{
+    return board_zobrist_mix(0x2000);
+}
+
+uint64_t board_compute_hash(const struct chess_board *board)
+{
+    uint64_t hash = board_zobrist_rights(&board->rights);
+    if (board->next_move_player == PLAYER_BLACK)
     {
-        score -= 20;
+        hash ^= board_zobrist_side();
     }
-    if (move->is_castle)
+
+    for (int player = PLAYER_WHITE; player <= PLAYER_BLACK; player++)
     {
-        score += 1000;
+        for (int piece = PIECE_PAWN; piece <= PIECE_KING; piece++)
+        {
+            for (uint64_t remaining = board->pieces[player][piece]; remaining; remaining &= remaining - 1)
+            {
+                int square_index = board_lowest_square(remaining);
+                hash ^= board_zobrist_piece((enum chess_piece)piece, (enum chess_player)player, square_index / BOARD_SIZE, square_index % BOARD_SIZE);
+            }
+        }
     }
 
-    // capturing a piece affects the suggested move
-    if (move->is_capture)
+    return hash;
+}
+
+uint64_t board_compute_pawn_hash(const struct chess_board *board)
+{
+    uint64_t hash = 0;
+    for (int player = PLAYER_WHITE; player <= PLAYER_BLACK; player++)
     {
-        const struct square *dst = &board->squares[move->to_row][move->to_col];
-        switch (dst->piece)
+        for (uint64_t remaining = board->pieces[player][PIECE_PAWN]; remaining; remaining &= remaining - 1)
         {
-        case PIECE_PAWN:
-            score += 100;
-            break;
-        case PIECE_KNIGHT:
-            score += 300;
-            break;
-        case PIECE_BISHOP:
-            score += 300;
-            break;
-        case PIECE_ROOK:
-            score += 500;
-            break;
-        case PIECE_QUEEN:
-            score += 900;
-            break;
-        case PIECE_KING:
-            score += 10000;
-            break;
+            int square_index = board_lowest_square(remaining);
+            hash ^= board_zobrist_piece(PIECE_PAWN, (enum chess_player)player, square_index / BOARD_SIZE, square_index % BOARD_SIZE);
         }
     }
-    // center advantage
-    if ((move->to_row == 3 || move->to_row == 4) && (move->to_col == 3 || move->to_col == 4))
+    return hash;
+}
+
+// every piece leaving or landing on a square in board_apply_move goes through these two, so the
+// running state (piece sets, evaluation totals, hashes) stays in step with the squares
+static void board_piece_added(struct chess_board *board, enum chess_piece piece, enum chess_player owner, int row, int col)
+{
+    uint64_t key = board_zobrist_piece(piece, owner, row, col);
+    board->pieces[owner][piece] |= BOARD_SQUARE_BIT(row, col);
+    eval_add_piece(board, piece, owner, row, col);
+    board->hash ^= key;
+    if (piece == PIECE_PAWN)
     {
-        score += 30;
+        board->pawn_hash ^= key;
     }
-    // moving pawns forward
-    if (move->piece_type == PIECE_PAWN)
+}
+
+static void board_piece_removed(struct chess_board *board, enum chess_piece piece, enum chess_player owner, int row, int col)
+{
+    uint64_t key = board_zobrist_piece(piece, owner, row, col);
+    board->pieces[owner][piece] &= ~BOARD_SQUARE_BIT(row, col);
+    eval_remove_piece(board, piece, owner, row, col);
+    board->hash ^= key;
+    if (piece == PIECE_PAWN)
     {
-        int direction = (move->player == PLAYER_WHITE) ? (7 - move->to_row) : move->to_row;
-        score += direction * 5;
+        board->pawn_hash ^= key;
     }
-    // getting ur knights and bishops in the game
-    if (move->piece_type == PIECE_KNIGHT || move->piece_type == PIECE_BISHOP)
+}
+
+// once anything moves from or to a rook's starting corner, castling on that side is gone for good
+static void board_clear_corner_rights(struct chess_board *board, int row, int col)
+{
+    if (row == 7 && col == 7)
     {
-        int start_row = (move->player == PLAYER_WHITE) ? 7 : 0;
-        if (move->from_row == start_row)
-        {
-            score += 20;
-        }
+        board->rights.white_kingside = false;
+    }
+    else if (row == 7 && col == 0)
+    {
+        board->rights.white_queenside = false;
+    }
+    else if (row == 0 && col == 7)
+    {
+        board->rights.black_kingside = false;
+    }
+    else if (row == 0 && col == 0)
+    {
+        board->rights.black_queenside = false;
     }
-    return score;
 }
 
-void board_recommend_move(const struct chess_board *board, struct chess_move *recommended_move)
+// the part of a move every caller needs: pieces, running totals, castling rights and side to move.
+// the attack maps, occupied sets and king squares are left for the caller
+static void board_move_pieces(struct chess_board *board, const struct chess_move *move)
 {
-    //the difference between a safe move and a legal move is that a safe move is legal and cannot force the player into checkmate on the next turn
-    bool can_make_safe_move = false; // flag to track if we can make a safe move
-    struct chess_move safe_move = {0};
+    // get the source and destination squares
+    struct square *src = &board->squares[move->from_row][move->from_col];
+    struct square *dst = &board->squares[move->to_row][move->to_col];
+
+    if (move->is_castle)
+    {
+        // castle logic
+        int row = (move->player == PLAYER_WHITE) ? 7 : 0;
+        int rook_from_col = move->castle_kingside ? 7 : 0;
+        int rook_to_col = move->castle_kingside ? 5 : 3;
+
+        board->squares[row][rook_to_col] = board->squares[row][rook_from_col];
+        board->squares[row][rook_from_col].has_piece = false;
+
+        board_piece_removed(board, PIECE_ROOK, move->player, row, rook_from_col);
+        board_piece_added(board, PIECE_ROOK, move->player, row, rook_to_col);
+    }
+
+    if (dst->has_piece) // whatever we land on is captured
+    {
+        board_piece_removed(board, dst->piece, dst->owner, move->to_row, move->to_col);
+    }
+    board_piece_removed(board, src->piece, src->owner, move->from_row, move->from_col);
+
+    *dst = *src; // apply the move by copying the struct from source to destination
+
+    if (move->is_promotion)
+    {
+        dst->piece = move->promo_piece; // promote the pawn to the specified piece (PARSER WILL SET THIS LATER)
+    }
 
-    bool legal_move_exists = false; // flag we use as a fallback if no checkmate move is found
-    struct chess_move legal_move = {0};
+    board_piece_added(board, dst->piece, dst->owner, move->to_row, move->to_col);
 
-    int score_legal = -100000;
-    int best_safe_score = -100000;
+    src->has_piece = false; // empty the source square
 
-    // try castling moves explicitly
-    for (int side = 0; side < 2; side++)
+    // moving a king, moving a rook off its corner or capturing a rook in its corner loses that castling right
+    board->hash ^= board_zobrist_rights(&board->rights);
+    if (move->piece_type == PIECE_KING)
     {
-        bool kingside = (side == 0);
-        if (!board_can_castle(board, kingside))
+        if (move->player == PLAYER_WHITE)
         {
-            continue;
+            board->rights.white_kingside = false;
+            board->rights.white_queenside = false;
         }
+        else
+        {
+            board->rights.black_kingside = false;
+            board->rights.black_queenside = false;
+        }
+    }
+    board_clear_corner_rights(board, move->from_row, move->from_col);
+    board_clear_corner_rights(board, move->to_row, move->to_col);
+    board->hash ^= board_zobrist_rights(&board->rights);
+
+    board->next_move_player = (board->next_move_player == PLAYER_WHITE) ? PLAYER_BLACK : PLAYER_WHITE; // switch the next move player
+    board->hash ^= board_zobrist_side();
+}
 
-        struct chess_move move = {0};
-        move.player = board->next_move_player;
-        move.piece_type = PIECE_KING;
-        move.is_castle = true;
-        move.castle_kingside = kingside;
-        move.is_capture = false;
-        move.is_promotion = false;
+enum chess_error board_apply_move(struct chess_board *board, const struct chess_move *move)
+{
+    if (move->from_row < 0 || move->from_row >= BOARD_SIZE || move->from_col < 0 || move->from_col >= BOARD_SIZE || move->to_row < 0 || move->to_row >= BOARD_SIZE || move->to_col < 0 || move->to_col >= BOARD_SIZE)
+    {
+        return CHESS_ERROR_ILLEGAL_MOVE;
+    }
 
-        struct chess_board castle_board_copy = *board;
-        board_complete_move(&castle_board_copy, &move);
-        board_apply_move(&castle_board_copy, &move);
+    const struct square *src = &board->squares[move->from_row][move->from_col];
+    if (!src->has_piece || src->owner != move->player || src->piece != move->piece_type) // if our source square does not have a piece or the owner if the source square is not the current player or the source piece does not equal the move piece type
+    {
+        return CHESS_ERROR_ILLEGAL_MOVE;
+    }
 
-        castle_board_copy.next_move_player = move.player;
-        if (board_in_check(&castle_board_copy))
+    if (move->is_castle)
+    {
+        int row = (move->player == PLAYER_WHITE) ? 7 : 0;
+        const struct square *rook_src = &board->squares[row][move->castle_kingside ? 7 : 0];
+        if (!rook_src->has_piece || rook_src->owner != move->player || rook_src->piece != PIECE_ROOK)
         {
-            continue;
+            return CHESS_ERROR_ILLEGAL_MOVE;
         }
+    }
 
-        int current_move_score = board_score_move(board, &move);
+    board_move_pieces(board, move);
+    board_update_attacks(board); // pieces moved so the attack maps are stale
+    return CHESS_OK;
+}
 
-        if (!legal_move_exists || current_move_score > score_legal)
+// board_move_pieces plus the occupied sets and king squares, which are cheap. the attack maps are
+// what costs, and nothing in a replay looks at them
+static void board_apply_move_unchecked(struct chess_board *board, const struct chess_move *move)
+{
+    board_move_pieces(board, move);
+    for (int player = PLAYER_WHITE; player <= PLAYER_BLACK; player++)
+    {
+        const uint64_t *pieces = board->pieces[player];
+        board->occupied[player] = pieces[PIECE_PAWN] | pieces[PIECE_KNIGHT] | pieces[PIECE_BISHOP] | pieces[PIECE_ROOK] | pieces[PIECE_QUEEN] | pieces[PIECE_KING];
+        uint64_t king = pieces[PIECE_KING];
+        board->king_row[player] = king ? board_lowest_square(king) / BOARD_SIZE : -1;
+        board->king_col[player] = king ? board_lowest_square(king) % BOARD_SIZE : -1;
+    }
+}
+
+#ifdef CHESS_CHECK_TRUSTED
+// everything but the attack maps, which the trusted path leaves alone
+static bool board_same_position(const struct chess_board *a, const struct chess_board *b)
+{
+    for (int row = 0; row < BOARD_SIZE; row++)
+    {
+        for (int col = 0; col < BOARD_SIZE; col++)
         {
-            score_legal = current_move_score;
-            legal_move = move;
-            legal_move_exists = true;
+            const struct square *x = &a->squares[row][col];
+            const struct square *y = &b->squares[row][col];
+            if (x->has_piece != y->has_piece || (x->has_piece && (x->piece != y->piece || x->owner != y->owner)))
+            {
+                return false;
+            }
         }
+    }
+    return memcmp(a->pieces, b->pieces, sizeof(a->pieces)) == 0 && memcmp(a->occupied, b->occupied, sizeof(a->occupied)) == 0 &&
+           a->hash == b->hash && a->pawn_hash == b->pawn_hash && a->eval_mg == b->eval_mg && a->eval_eg == b->eval_eg && a->eval_phase == b->eval_phase &&
+           a->next_move_player == b->next_move_player && a->rights.white_kingside == b->rights.white_kingside &&
+           a->rights.white_queenside == b->rights.white_queenside && a->rights.black_kingside == b->rights.black_kingside &&
+           a->rights.black_queenside == b->rights.black_queenside && a->king_row[0] == b->king_row[0] && a->king_col[0] == b->king_col[0] &&
+           a->king_row[1] == b->king_row[1] && a->king_col[1] == b->king_col[1];
+}
+#endif
 
-        castle_board_copy.next_move_player = (move.player == PLAYER_WHITE) ? PLAYER_BLACK : PLAYER_WHITE;
-        if (board_in_checkmate(&castle_board_copy))
+void board_apply_move_trusted(struct chess_board *board, const struct chess_move *move)
+{
+#ifdef CHESS_CHECK_TRUSTED
+    struct chess_board checked = *board;
+    enum chess_error error = board_apply_move(&checked, move);
+    board_apply_move_unchecked(board, move);
+    if (error || !board_same_position(board, &checked))
+    {
+        board_trusted_mismatch("move", move);
+    }
+#else
+    board_apply_move_unchecked(board, move);
+#endif
+}
+
+void board_apply_null_move(struct chess_board *board)
+{
+    // nothing moved, so the attack maps and the evaluation totals still hold
+    board->next_move_player = (board->next_move_player == PLAYER_WHITE) ? PLAYER_BLACK : PLAYER_WHITE;
+    board->hash ^= board_zobrist_side();
+}
+
+int board_score_move(const struct chess_board *board, const struct chess_move *move)
+{
+    // how good the position after the move is for the player making it (material + piece-square tables)
+    return eval_after_move(board, move);
+}
+
+enum chess_error board_recommend_move(const struct chess_board *board, struct chess_move *recommended_move)
+{
+    return board_recommend_move_search(board, NULL, SEARCH_DEFAULT_DEPTH, recommended_move);
+}
+
+enum chess_error board_recommend_move_search(const struct chess_board *board, struct search_context *context, int depth, struct chess_move *recommended_move)
+{
+    struct search_context local_context;
+    if (context == NULL) // one off recommendation, bring our own tables
+    {
+        if (!search_context_init(&local_context, SEARCH_DEFAULT_TABLE_MB))
         {
-            *recommended_move = move;
-            return;
+            return CHESS_ERROR_OUT_OF_MEMORY;
         }
+        context = &local_context;
+    }
 
-        if (!can_make_safe_move || current_move_score > best_safe_score)
+    // alpha-beta finds mates for us and won't walk into one, so no need for the old safe move scan
+    int score;
+    bool found = search_best_move(context, board, depth, recommended_move, &score);
+
+    if (context == &local_context)
+    {
+        search_context_free(&local_context);
+    }
+    return found ? CHESS_OK : CHESS_ERROR_NO_LEGAL_MOVES;
+}
+
+static enum chess_error board_analyze_position(const struct chess_board *board, struct search_context *context, int depth, struct chess_summary *summary)
+{
+    summary->has_suggestion = false;
+    summary->has_tablebase_result = false;
+    summary->line_count = 0;
+    summary->winner = PLAYER_WHITE;
+    summary->next_move_player = board->next_move_player;
+
+    if (board_in_checkmate(board))
+    {
+        summary->status = STATUS_CHECKMATE;
+        summary->winner = (board->next_move_player == PLAYER_WHITE) ? PLAYER_BLACK : PLAYER_WHITE;
+        return CHESS_OK;
+    }
+    if (board_in_stalemate(board))
+    {
+        summary->status = STATUS_STALEMATE;
+        return CHESS_OK;
+    }
+    if (context != NULL && context->game != NULL && context->game->count > 0)
+    {
+        if (history_repetitions(context->game) >= 2)
+        {
+            summary->status = STATUS_REPETITION;
+            return CHESS_OK;
+        }
+        if (history_fifty_moves(context->game))
         {
-            can_make_safe_move = true;
-            best_safe_score = current_move_score;
-            safe_move = move;
+            summary->status = STATUS_FIFTY_MOVES;
+            return CHESS_OK;
         }
     }
 
-    // function is o(n^8) but whatever for now
-    // MAIN SEARCH
-    for (int from_row = 0; from_row < BOARD_SIZE; from_row++)
+    summary->status = STATUS_INCOMPLETE;
+    enum tablebase_outcome outcome;
+    int plies;
+    if (context != NULL && context->tablebase != NULL && tablebase_probe(context->tablebase, board, &outcome, &plies))
     {
-        for (int from_col = 0; from_col < BOARD_SIZE; from_col++)
+        summary->has_tablebase_result = true;
+        summary->tablebase_plies = (outcome == TABLEBASE_OUTCOME_LOSS) ? -plies : plies;
+    }
+
+    if (context != NULL && context->multi_pv > 1) // the alternatives come out of the same search
+    {
+        struct search_line lines[CHESS_MAX_LINES];
+        summary->line_count = search_best_lines(context, board, depth, lines, context->multi_pv);
+        for (int i = 0; i < summary->line_count; i++)
+        {
+            summary->lines[i] = lines[i].move;
+            summary->line_scores[i] = lines[i].score;
+        }
+        summary->has_suggestion = summary->line_count > 0;
+        if (summary->has_suggestion)
         {
-            const struct square *src = &board->squares[from_row][from_col];
+            summary->suggestion = lines[0].move;
+        }
+        return summary->has_suggestion ? CHESS_OK : CHESS_ERROR_NO_LEGAL_MOVES;
+    }
 
-            if (!src->has_piece || src->owner != board->next_move_player)
-            {
-                continue;
-            }
+    enum chess_error error = board_recommend_move_search(board, context, depth, &summary->suggestion);
+    summary->has_suggestion = (error == CHESS_OK);
+    return error;
+}
 
-            for (int to_row = 0; to_row < BOARD_SIZE; to_row++)
-            {
-                for (int to_col = 0; to_col < BOARD_SIZE; to_col++)
-                {
-                    const struct square *dst = &board->squares[to_row][to_col];
-
-                    if (dst->has_piece && dst->owner == board->next_move_player)
-                    {
-                        continue;
-                    }
-
-                    if (!board_is_legal_move(board, from_row, from_col, to_row, to_col))
-                    {
-                        continue;
-                    }
-
-                    struct chess_move move = {0}; // anti garbage
-                    move.player = board->next_move_player;
-                    move.piece_type = src->piece;
-                    move.from_row = from_row;
-                    move.from_col = from_col;
-                    move.to_row = to_row;
-                    move.to_col = to_col;
-                    move.is_capture = (dst->has_piece && dst->owner != board->next_move_player);
-                    move.is_castle = false;
-                    move.is_promotion = false;
-
-                    if (move.piece_type == PIECE_PAWN)
-                    {
-                        if ((move.player == PLAYER_WHITE && to_row == 0) || (move.player == PLAYER_BLACK && to_row == 7))
-                        {
-                            move.is_promotion = true;
-                            move.promo_piece = PIECE_QUEEN;
-                        }
-                    }
-
-                    struct chess_board board_copy = *board;
-                    board_apply_move(&board_copy, &move);
-
-                    board_copy.next_move_player = move.player;
-
-                    if (board_in_check(&board_copy))
-                    {
-                        continue;
-                    }
-                    int current_move_score = board_score_move(board, &move);
-                    if (!legal_move_exists || current_move_score > score_legal)
-                    {
-                        score_legal = current_move_score;
-                        legal_move = move;
-                        legal_move_exists = true;
-                    }
-
-                    board_copy.next_move_player = (move.player == PLAYER_WHITE) ? PLAYER_BLACK : PLAYER_WHITE;
-                    if (board_in_checkmate(&board_copy))
-                    {
-                        *recommended_move = move;
-                        return;
-                    }
-
-                    bool enemy_mate = false;
-                    struct chess_board enemy_board = board_copy;
-
-                    for (int enemy_from_row = 0; enemy_from_row < BOARD_SIZE && !enemy_mate; enemy_from_row++)
-                    {
-                        for (int enemy_from_column = 0; enemy_from_column < BOARD_SIZE && !enemy_mate; enemy_from_column++)
-                        {
-                            const struct square *enemy_src = &enemy_board.squares[enemy_from_row][enemy_from_column];
-                            if (!enemy_src->has_piece || enemy_src->owner != enemy_board.next_move_player)
-                            {
-                                continue;
-                            }
-
-                            for (int enemy_to_row = 0; enemy_to_row < BOARD_SIZE && !enemy_mate; enemy_to_row++)
-                            {
-                                for (int enemy_to_column = 0; enemy_to_column < BOARD_SIZE && !enemy_mate; enemy_to_column++)
-                                {
-                                    const struct square *enemy_dst = &enemy_board.squares[enemy_to_row][enemy_to_column];
-
-                                    if (enemy_dst->has_piece && enemy_dst->owner == enemy_board.next_move_player)
-                                    {
-                                        continue;
-                                    }
-
-                                    if (!board_is_legal_move(&enemy_board, enemy_from_row, enemy_from_column, enemy_to_row, enemy_to_column))
-                                    {
-                                        continue;
-                                    }
-
-                                    struct chess_move enemy_move = {0};
-
-                                    enemy_move.player = enemy_board.next_move_player;
-                                    enemy_move.piece_type = enemy_src->piece;
-                                    enemy_move.from_row = enemy_from_row;
-                                    enemy_move.from_col = enemy_from_column;
-                                    enemy_move.to_row = enemy_to_row;
-                                    enemy_move.to_col = enemy_to_column;
-                                    enemy_move.is_capture = (enemy_dst->has_piece && enemy_dst->owner != enemy_board.next_move_player);
-                                    enemy_move.is_castle = false;
-                                    enemy_move.is_promotion = false;
-
-                                    if (enemy_move.piece_type == PIECE_PAWN)
-                                    {
-                                        if ((enemy_move.player == PLAYER_WHITE && enemy_to_row == 0) || (enemy_move.player == PLAYER_BLACK && enemy_to_row == 7))
-                                        {
-                                            enemy_move.is_promotion = true;
-                                            enemy_move.promo_piece = PIECE_QUEEN; // lets just promote to the queen to simplify
-                                        }
-                                    }
-
-                                    struct chess_board reply = enemy_board; // Simulate enemy move on a copy to test for checkmate
-                                    board_apply_move(&reply, &enemy_move);
-
-                                    reply.next_move_player = enemy_move.player;
-                                    if (board_in_check(&reply))
-                                    {
-                                        continue;
-                                    }
-
-                                    reply.next_move_player = (enemy_move.player == PLAYER_WHITE) ? PLAYER_BLACK : PLAYER_WHITE;
-
-                                    if (board_in_checkmate(&reply))
-                                    {
-                                        enemy_mate = true;
-                                    }
-                                }
-                            }
-                        }
-                    }
-
-                    if (!enemy_mate)
-                    {
-                        if (!can_make_safe_move || current_move_score > best_safe_score) // !can_make_safe_move is for the first safe move we find
-                        {
-                            can_make_safe_move = true;
-                            best_safe_score = current_move_score;
-                            safe_move = move;
-                        }
-                    }
-                }
-            }
-        }
+enum chess_error board_analyze(const struct chess_board *board, struct search_context *context, int depth, struct chess_summary *summary)
+{
+    struct cache *cache = context != NULL ? context->cache : NULL;
+    if (cache == NULL || context->multi_pv > 1) // the cache only has room for the suggestion, not the other lines
+    {
+        return board_analyze_position(board, context, depth, summary);
     }
 
-    if (can_make_safe_move)
+    const struct search_pruning *pruning = &context->pruning;
+    unsigned settings = (context->tablebase != NULL) | pruning->null_move << 1 | pruning->late_move_reductions << 2 | pruning->futility << 3;
+    uint64_t key = cache_key(board, depth, settings) ^ context->weights_key; // other weights, other answers
+    if (context->game != NULL && context->game->count > 0) // nor is the search blind to how the game got here
     {
-        *recommended_move = safe_move;
+        key ^= history_key(context->game);
+        // the clock only matters once the fifty-move rule can come due within the search
+        int clock = context->game->entries[context->game->count - 1].halfmove_clock;
+        if (clock + depth >= HISTORY_FIFTY_MOVE_PLIES)
+        {
+            key ^= (uint64_t)((clock < HISTORY_FIFTY_MOVE_PLIES ? clock : HISTORY_FIFTY_MOVE_PLIES) + 1) * 0xC2B2AE3D27D4EB4Full;
+        }
     }
-    else if (legal_move_exists)
+    if (cache_probe(cache, key, summary))
     {
-        *recommended_move = legal_move;
+        return CHESS_OK;
     }
-    else
+    enum chess_error error = board_analyze_position(board, context, depth, summary);
+    // a search cut short isn't the answer the next lookup wants, and draws by rule are found
+    // quicker than looked up (the cache has no room for them either)
+    if (!error && !context->aborted && summary->status != STATUS_REPETITION && summary->status != STATUS_FIFTY_MOVES)
     {
-        panicf("move completion error: no legal moves\n");
+        cache_store(cache, key, summary);
     }
+    return error;
 }
 
-void board_summarize(const struct chess_board *board)
+static void board_print_move(FILE *out, const struct chess_move *move)
 {
-    if (board_in_checkmate(board))
+    fprintf(out, "%s %s from %c%c to %c%c", player_string(move->player), piece_string(move->piece_type), 'a' + move->from_col, '1' + (8 - move->from_row - 1), 'a' + move->to_col, '1' + (8 - move->to_row - 1));
+}
+
+void board_print_summary(FILE *out, const struct chess_summary *summary)
+{
+    switch (summary->status)
     {
-        enum chess_player loser = board->next_move_player;
-        enum chess_player winner = (loser == PLAYER_WHITE) ? PLAYER_BLACK : PLAYER_WHITE;
-        printf("%s wins by checkmate\n", player_string(winner));
+    case STATUS_CHECKMATE:
+        fprintf(out, "%s wins by checkmate\n", player_string(summary->winner));
+        break;
+
+    case STATUS_STALEMATE:
+        fprintf(out, "draw by stalemate\n");
+        break;
+
+    case STATUS_REPETITION:
+        fprintf(out, "draw by threefold repetition\n");
+        break;
+
+    case STATUS_FIFTY_MOVES:
+        fprintf(out, "draw by the fifty-move rule\n");
+        break;
+
+    case STATUS_INCOMPLETE:
+        fprintf(out, "game incomplete\n");
+        if (summary->has_suggestion)
+        {
+            fprintf(out, "suggest: ");
+            board_print_move(out, &summary->suggestion);
+            fprintf(out, "\n");
+        }
+        for (int i = 0; i < summary->line_count && summary->line_count > 1; i++) // the ranked alternatives, with what each is worth
+        {
+            fprintf(out, "line %d: ", i + 1);
+            board_print_move(out, &summary->lines[i]);
+            int mate = search_mate_moves(summary->line_scores[i]);
+            if (mate > 0)
+            {
+                fprintf(out, ", mate in %d\n", mate);
+            }
+            else if (mate < 0)
+            {
+                fprintf(out, ", mated in %d\n", -mate);
+            }
+            else
+            {
+                fprintf(out, ", score %d\n", summary->line_scores[i]);
+            }
+        }
+        if (summary->has_tablebase_result)
+        {
+            int plies = summary->tablebase_plies;
+            if (plies == 0)
+            {
+                fprintf(out, "tablebase: draw\n");
+            }
+            else
+            {
+                enum chess_player winner = (plies > 0) ? summary->next_move_player : (summary->next_move_player == PLAYER_WHITE) ? PLAYER_BLACK : PLAYER_WHITE;
+                int moves = (get_absolute_value(plies) + 1) / 2; // counting the winner's moves
+                fprintf(out, "tablebase: %s mates in %d\n", player_string(winner), moves);
+            }
+        }
+        break;
     }
+}
+
+enum chess_error board_summarize(const struct chess_board *board)
+{
+    struct chess_summary summary;
+    enum chess_error error = board_analyze(board, NULL, SEARCH_DEFAULT_DEPTH, &summary);
+    board_print_summary(stdout, &summary);
+    return error;
+}
 
-    else if (board_in_stalemate(board))
+void chess_describe_move_error(char *text, size_t size, enum chess_error error, const struct chess_move *move)
+{
+    switch (error)
     {
-        printf("draw by stalemate\n");
+    case CHESS_ERROR_ILLEGAL_CASTLE:
+        snprintf(text, size, "move completion error: illegal castling by %s", player_string(move->player));
+        break;
+    case CHESS_ERROR_AMBIGUOUS_MOVE:
+        snprintf(text, size, "parse error: ambiguous move");
+        break;
+    case CHESS_ERROR_ILLEGAL_MOVE:
+        snprintf(text, size, "move completion error: %s %s to %c%c", player_string(move->player), piece_string(move->piece_type), 'a' + move->to_col, '1' + (8 - move->to_row - 1));
+        break;
+    default:
+        snprintf(text, size, "move completion error: %s", chess_error_string(error));
+        break;
     }
-    else
+}
+
+const char *chess_error_string(enum chess_error error)
+{
+    switch (error)
     {
-        printf("game incomplete\n");
-        struct chess_move recommended_move;
-        board_recommend_move(board, &recommended_move);
-        printf("suggest: %s %s from %c%c to %c%c\n", player_string(recommended_move.player), piece_string(recommended_move.piece_type), 'a' + recommended_move.from_col, '1' + (8 - recommended_move.from_row - 1), 'a' + recommended_move.to_col, '1' + (8 - recommended_move.to_row - 1));
+    case CHESS_OK:
+        return "ok";
+    case CHESS_ERROR_ILLEGAL_MOVE:
+        return "illegal move";
+    case CHESS_ERROR_ILLEGAL_CASTLE:
+        return "illegal castling";
+    case CHESS_ERROR_AMBIGUOUS_MOVE:
+        return "ambiguous move";
+    case CHESS_ERROR_NO_LEGAL_MOVES:
+        return "no legal moves";
+    case CHESS_ERROR_OUT_OF_MEMORY:
+        return "out of memory";
+    case CHESS_ERROR_BAD_FEN:
+        return "malformed FEN";
+    case CHESS_ERROR_BAD_TABLEBASE:
+        return "bad endgame table";
+    case CHESS_ERROR_BAD_CACHE:
+        return "bad result cache";
+    case CHESS_ERROR_BAD_WEIGHTS:
+        return "bad evaluation weights";
+    case CHESS_ERROR_BAD_DATABASE:
+        return "bad position database";
     }
-}
\ No newline at end of file
+    return "unknown error";
+}
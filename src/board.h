@@ -3,10 +3,64 @@
 
 #include <stdio.h>
 #include <stdbool.h>
-#include "panic.h"
+#include <stdint.h>
 
 #define BOARD_SIZE 8
 
+// bit for a square in a 64 bit square set (attack maps etc.), a8 is bit 0 and h1 is bit 63
+#define BOARD_SQUARE_BIT(row, col) ((uint64_t)1 << ((row) * BOARD_SIZE + (col)))
+
+// Colour specialisation: helpers that take the player as a parameter are
+// declared BOARD_SPECIALISE and called with PLAYER_WHITE or PLAYER_BLACK
+// spelled out, so each call site gets its own copy with the colour tests
+// below folded into constants and no colour branches left in the loop.
+#if defined(__GNUC__) || defined(__clang__)
+#define BOARD_SPECIALISE static inline __attribute__((always_inline))
+#else
+#define BOARD_SPECIALISE static inline
+#endif
+
+#define BOARD_OPPONENT(player) ((player) == PLAYER_WHITE ? PLAYER_BLACK : PLAYER_WHITE)
+#define BOARD_FORWARD(player) ((player) == PLAYER_WHITE ? -1 : +1)       // row step of a pawn push
+#define BOARD_BACK_ROW(player) ((player) == PLAYER_WHITE ? 7 : 0)        // where the king and rooks start
+#define BOARD_PAWN_START_ROW(player) ((player) == PLAYER_WHITE ? 6 : 1)  // where a pawn may still push two
+#define BOARD_PROMOTION_ROW(player) ((player) == PLAYER_WHITE ? 0 : 7)
+
+// the a and h files as square sets, to stop pawn captures wrapping round the board
+#define BOARD_FILE_A 0x0101010101010101ull
+#define BOARD_FILE_H (BOARD_FILE_A << 7)
+
+// how many squares are in a square set
+static inline int board_count_squares(uint64_t squares)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(squares);
+#else
+    int count = 0;
+    for (; squares; squares &= squares - 1)
+    {
+        count++;
+    }
+    return count;
+#endif
+}
+
+// index (row * 8 + col) of the lowest set bit in a square set, the set must not be empty
+static inline int board_lowest_square(uint64_t squares)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(squares);
+#else
+    int index = 0;
+    while (!(squares & 1))
+    {
+        squares >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
 enum chess_piece
 {
     PIECE_PAWN = 0,
@@ -22,6 +76,16 @@ enum chess_player
     PLAYER_BLACK = 1,
 };
 
+// every square a set of player's pawns attacks, all at once
+BOARD_SPECIALISE uint64_t board_pawn_attacks(uint64_t pawns, enum chess_player player)
+{
+    if (player == PLAYER_WHITE) // white pawns go towards row 0, down 8 bit positions
+    {
+        return ((pawns & ~BOARD_FILE_A) >> 9) | ((pawns & ~BOARD_FILE_H) >> 7);
+    }
+    return ((pawns & ~BOARD_FILE_A) << 7) | ((pawns & ~BOARD_FILE_H) << 9);
+}
+
 struct square
 {
     bool has_piece;
@@ -38,13 +102,67 @@ struct castling_rights
     bool black_queenside;
 };
 
+struct eval_weights;
+
 struct chess_board
 {
     enum chess_player next_move_player;
     struct castling_rights rights;
     struct square squares[BOARD_SIZE][BOARD_SIZE];
+
+    // every square each player attacks (indexed by enum chess_player), rebuilt by board_update_attacks
+    // whenever pieces move so "is this square attacked" is a single bit test
+    uint64_t attacks[2];
+    // the squares holding each player's pieces of each type ([player][piece]), kept up to date by
+    // board_apply_move (captures and promotions included) so walking a side's pieces costs one step
+    // per piece instead of a scan of all 64 squares
+    uint64_t pieces[2][6];
+    // every square each player has a piece on, the union of pieces[player]
+    uint64_t occupied[2];
+    // material + piece-square totals (white minus black) for the middlegame and endgame tables, and
+    // the game phase used to blend them. kept up to date by board_apply_move, see eval.h
+    int eval_mg, eval_eg, eval_phase;
+    // the weights those totals are kept with, NULL for the compiled-in ones. set by eval_reset
+    const struct eval_weights *weights;
+    // zobrist hash of the pieces, castling rights and side to move, updated by board_apply_move
+    uint64_t hash;
+    // the part of hash for the pawns alone, so evaluation terms that only depend on the pawns can
+    // be cached by it (see pawns.h). also updated by board_apply_move
+    uint64_t pawn_hash;
+    // where each player's king is, -1 if that player has no king on the board
+    int king_row[2], king_col[2];
 };
 
+// What went wrong in a board call. The library never exits the process, so
+// one bad game can't take down a batch; CHESS_OK is 0 so `if (error)` works.
+enum chess_error
+{
+    CHESS_OK = 0,
+    CHESS_ERROR_ILLEGAL_MOVE,   // no piece can make the move (or the source square doesn't match)
+    CHESS_ERROR_ILLEGAL_CASTLE, // castling isn't allowed right now
+    CHESS_ERROR_AMBIGUOUS_MOVE, // more than one piece could make the move
+    CHESS_ERROR_NO_LEGAL_MOVES, // asked for a suggestion in a finished game
+    CHESS_ERROR_OUT_OF_MEMORY,
+    CHESS_ERROR_BAD_FEN, // board_set_fen couldn't make sense of the string, or no game reaches it
+    CHESS_ERROR_BAD_TABLEBASE, // an endgame table file or material name we can't use
+    CHESS_ERROR_BAD_CACHE,     // a result cache file we can't open or don't recognise
+    CHESS_ERROR_BAD_WEIGHTS,   // an evaluation weights file we can't read or make sense of
+    CHESS_ERROR_BAD_DATABASE,  // a position database file we can't write, open or don't recognise
+};
+
+enum chess_status
+{
+    STATUS_INCOMPLETE,
+    STATUS_CHECKMATE,
+    STATUS_STALEMATE,
+    // draws only board_analyze with a game history (search_context.game) can see
+    STATUS_REPETITION,  // the position has now come up three times
+    STATUS_FIFTY_MOVES, // fifty moves each without a capture or pawn move
+};
+
+// search state lives in search.h, the board only passes it through
+struct search_context;
+
 struct chess_move
 {
     enum chess_player player;
@@ -61,16 +179,76 @@ struct chess_move
     bool castle_kingside;
 };
 
+// most ranked moves a summary holds, see search_context.multi_pv
+#define CHESS_MAX_LINES 8
+
+// result of analysing a final position, filled in by board_analyze
+struct chess_summary
+{
+    enum chess_status status;
+    enum chess_player winner; // only meaningful for STATUS_CHECKMATE
+    bool has_suggestion;      // set for STATUS_INCOMPLETE when a move was found
+    struct chess_move suggestion;
+    // set for STATUS_INCOMPLETE when the endgame tables cover the position: plies until mate,
+    // positive if the player to move wins, negative if they lose, 0 for a draw
+    bool has_tablebase_result;
+    int tablebase_plies;
+    enum chess_player next_move_player;
+    // set for STATUS_INCOMPLETE when the search was asked for more than one move: the best
+    // moves in order (lines[0] is the suggestion) and their scores for the player to move
+    int line_count;
+    struct chess_move lines[CHESS_MAX_LINES];
+    int line_scores[CHESS_MAX_LINES];
+};
+
 // stupid helper function because we can't use abs
 int get_absolute_value(int value);
 
 const char *piece_string(enum chess_piece piece);
 const char *player_string(enum chess_player player);
+const char *chess_error_string(enum chess_error error);
+// The message the command line tool prints for an error from completing or
+// applying move, e.g. "move completion error: white knight to e5".
+void chess_describe_move_error(char *text, size_t size, enum chess_error error, const struct chess_move *move);
 
 void board_initialize(struct chess_board *board);
-void board_complete_move(const struct chess_board *board, struct chess_move *move);
-void board_apply_move(struct chess_board *board, const struct chess_move *move);
-void board_summarize(const struct chess_board *board);
+// Sets up the position described by a FEN string (pieces, side to move and
+// castling rights; the en passant square and move counters are ignored).
+// Castling rights whose king or rook has left its square are dropped. The
+// board is left untouched, and CHESS_ERROR_BAD_FEN returned, if the string is
+// malformed or describes a position no game can reach: each side needs
+// exactly one king, no pawn may stand on the first or last rank, and the side
+// that just moved can't be in check.
+enum chess_error board_set_fen(struct chess_board *board, const char *fen);
+enum chess_error board_complete_move(const struct chess_board *board, struct chess_move *move);
+enum chess_error board_apply_move(struct chess_board *board, const struct chess_move *move);
+// Fast replay of games from an archive that was already validated. The
+// trusted completion finds the moving piece by looking outwards from the
+// target square and doesn't ask whether a castle passes through check; the
+// trusted move skips the source checks and leaves the attack maps stale, so call
+// board_update_attacks before asking about check or analyzing the position.
+// An illegal move gives a wrong position rather than an error. Building with
+// -DCHESS_CHECK_TRUSTED=ON runs the checked path alongside and aborts on any
+// difference.
+enum chess_error board_complete_move_trusted(const struct chess_board *board, struct chess_move *move);
+void board_apply_move_trusted(struct chess_board *board, const struct chess_move *move);
+// Passes the turn to the other player without moving anything, for the search's null move.
+void board_apply_null_move(struct chess_board *board);
+enum chess_error board_analyze(const struct chess_board *board, struct search_context *context, int depth, struct chess_summary *summary);
+void board_print_summary(FILE *out, const struct chess_summary *summary);
+enum chess_error board_summarize(const struct chess_board *board);
+uint64_t board_zobrist_piece(enum chess_piece piece, enum chess_player owner, int row, int col);
+uint64_t board_zobrist_rights(const struct castling_rights *rights);
+uint64_t board_zobrist_side(void);
+uint64_t board_compute_hash(const struct chess_board *board);
+uint64_t board_compute_pawn_hash(const struct chess_board *board);
+// Rebuilds pieces and occupied from the squares. Only needed after setting up
+// a position by hand, like eval_reset; board_apply_move keeps them up to date.
+void board_reset_pieces(struct chess_board *board);
+// Recomputes the attack maps and king squares from the piece sets.
+void board_update_attacks(struct chess_board *board);
+uint64_t board_piece_attacks(const struct chess_board *board, int row, int col);
+bool board_square_attacked(const struct chess_board *board, enum chess_player attacker, int row, int col);
 bool board_in_check(const struct chess_board *board);
 bool board_in_checkmate(const struct chess_board *board);
 bool board_can_pawn_reach(const enum chess_player player, const struct chess_board *board, int from_row, int from_col, int to_row, int to_col);
@@ -79,7 +257,8 @@ bool board_straight_check(const struct chess_board *board, int from_row, int fro
 bool board_can_castle(const struct chess_board *board, bool kingside);
 bool board_in_stalemate(const struct chess_board *board);
 bool board_is_legal_move(const struct chess_board *board, int from_row, int from_col, int to_row, int to_col);
-void board_recommend_move(const struct chess_board *board, struct chess_move *best_move);
+enum chess_error board_recommend_move(const struct chess_board *board, struct chess_move *best_move);
+enum chess_error board_recommend_move_search(const struct chess_board *board, struct search_context *context, int depth, struct chess_move *best_move);
 int board_score_move(const struct chess_board *board, const struct chess_move *move);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,312 @@
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// file layout: this magic, CACHE_SEARCH_VERSION as a little endian uint32, the entry count as a
+// little endian uint64, then the entries
+#define CACHE_MAGIC "CRC1"
+#define CACHE_HEADER_SIZE 16
+// which search and evaluation the stored answers came from. bump it with any change that can give
+// a different answer for the same key; files with another version are refused, not served.
+// 0 (the old padding) for files from before it was kept, 1 for the pawn structure terms, 2 for
+// positions from before the root only counting as repetitions once they've come up twice
+#define CACHE_SEARCH_VERSION 2
+
+// how a summary is packed into cache_entry.data
+#define CACHE_STATUS_MASK 0x3 // draws by repetition or the fifty-move rule are never stored
+#define CACHE_WINNER_BLACK (1u << 2)
+#define CACHE_NEXT_BLACK (1u << 3)
+#define CACHE_HAS_SUGGESTION (1u << 4)
+#define CACHE_HAS_TABLEBASE (1u << 5)
+#define CACHE_CAPTURE (1u << 6)
+#define CACHE_PROMOTION (1u << 7)
+#define CACHE_CASTLE (1u << 8)
+#define CACHE_KINGSIDE (1u << 9)
+#define CACHE_PIECE_SHIFT 10
+#define CACHE_PROMO_SHIFT 13
+#define CACHE_FROM_SHIFT 16
+#define CACHE_TO_SHIFT 22
+#define CACHE_PLIES_SHIFT 32
+#define CACHE_USED (1ull << 48) // so no stored entry is all zero like an empty one
+
+static size_t cache_entries_for(size_t table_mb)
+{
+    size_t wanted = table_mb * 1024 * 1024 / sizeof(struct cache_entry);
+    size_t entries = 1;
+    while (entries * 2 <= wanted)
+    {
+        entries *= 2;
+    }
+    return entries;
+}
+
+static void cache_reset_stats(struct cache *cache)
+{
+    atomic_init(&cache->hits, 0);
+    atomic_init(&cache->misses, 0);
+    atomic_init(&cache->stores, 0);
+}
+
+bool cache_init(struct cache *cache, size_t table_mb)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache_reset_stats(cache);
+    cache->entry_count = cache_entries_for(table_mb);
+    cache->entries = calloc(cache->entry_count, sizeof(struct cache_entry));
+    cache->mapping = cache->entries;
+    return cache->entries != NULL;
+}
+
+// checks the header and returns the entry count it promises, 0 if the file is no good
+static size_t cache_read_header(const uint8_t *header, size_t file_size)
+{
+    if (file_size < CACHE_HEADER_SIZE || memcmp(header, CACHE_MAGIC, 4) != 0)
+    {
+        return 0;
+    }
+    uint32_t version = 0;
+    for (int i = 3; i >= 0; i--)
+    {
+        version = version << 8 | header[4 + i];
+    }
+    if (version != CACHE_SEARCH_VERSION)
+    {
+        return 0;
+    }
+    uint64_t count = 0;
+    for (int i = 7; i >= 0; i--)
+    {
+        count = count << 8 | header[8 + i];
+    }
+    if (count == 0 || (count & (count - 1)) != 0 || file_size != CACHE_HEADER_SIZE + count * sizeof(struct cache_entry))
+    {
+        return 0;
+    }
+    return (size_t)count;
+}
+
+static void cache_write_header(uint8_t *header, size_t entry_count)
+{
+    memset(header, 0, CACHE_HEADER_SIZE);
+    memcpy(header, CACHE_MAGIC, 4);
+    for (int i = 0; i < 4; i++)
+    {
+        header[4 + i] = (uint8_t)((uint32_t)CACHE_SEARCH_VERSION >> (8 * i));
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        header[8 + i] = (uint8_t)((uint64_t)entry_count >> (8 * i));
+    }
+}
+
+enum chess_error cache_open(struct cache *cache, const char *path, size_t table_mb)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache_reset_stats(cache);
+
+#ifndef _WIN32
+    int descriptor = open(path, O_RDWR | O_CREAT, 0644);
+    if (descriptor < 0)
+    {
+        return CHESS_ERROR_BAD_CACHE;
+    }
+    struct stat info;
+    if (fstat(descriptor, &info) != 0)
+    {
+        close(descriptor);
+        return CHESS_ERROR_BAD_CACHE;
+    }
+    bool created = info.st_size == 0;
+    size_t file_size = (size_t)info.st_size;
+    if (created) // a new file, zeros are empty entries so the size is all it needs besides the header
+    {
+        file_size = CACHE_HEADER_SIZE + cache_entries_for(table_mb) * sizeof(struct cache_entry);
+        if (ftruncate(descriptor, (off_t)file_size) != 0)
+        {
+            close(descriptor);
+            return CHESS_ERROR_BAD_CACHE;
+        }
+    }
+    void *mapping = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    close(descriptor); // the mapping keeps the file alive
+    if (mapping == MAP_FAILED)
+    {
+        return CHESS_ERROR_BAD_CACHE;
+    }
+    if (created)
+    {
+        cache_write_header(mapping, cache_entries_for(table_mb));
+    }
+    size_t entry_count = cache_read_header(mapping, file_size);
+    if (entry_count == 0)
+    {
+        munmap(mapping, file_size);
+        return CHESS_ERROR_BAD_CACHE;
+    }
+#else
+    // no mmap here, read the whole file in and write it back out in cache_free
+    size_t file_size = CACHE_HEADER_SIZE + cache_entries_for(table_mb) * sizeof(struct cache_entry);
+    FILE *file = fopen(path, "rb");
+    if (file != NULL)
+    {
+        fseek(file, 0, SEEK_END);
+        long length = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        file_size = length > 0 ? (size_t)length : 0;
+    }
+    void *mapping = calloc(1, file_size ? file_size : 1);
+    bool read = mapping != NULL && (file == NULL || fread(mapping, 1, file_size, file) == file_size);
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+    else if (mapping != NULL)
+    {
+        cache_write_header(mapping, cache_entries_for(table_mb));
+    }
+    size_t entry_count = read ? cache_read_header(mapping, file_size) : 0;
+    if (entry_count == 0)
+    {
+        free(mapping);
+        return mapping == NULL ? CHESS_ERROR_OUT_OF_MEMORY : CHESS_ERROR_BAD_CACHE;
+    }
+    cache->path = malloc(strlen(path) + 1);
+    if (cache->path == NULL)
+    {
+        free(mapping);
+        return CHESS_ERROR_OUT_OF_MEMORY;
+    }
+    strcpy(cache->path, path);
+#endif
+
+    cache->entries = (struct cache_entry *)((uint8_t *)mapping + CACHE_HEADER_SIZE);
+    cache->entry_count = entry_count;
+    cache->mapping = mapping;
+    cache->mapping_size = file_size;
+    return CHESS_OK;
+}
+
+void cache_free(struct cache *cache)
+{
+    if (cache->mapping == NULL)
+    {
+        return;
+    }
+    if (cache->mapping_size == 0) // cache_init's, nothing on disk
+    {
+        free(cache->mapping);
+    }
+    else
+    {
+#ifndef _WIN32
+        munmap(cache->mapping, cache->mapping_size);
+#else
+        FILE *file = fopen(cache->path, "wb");
+        if (file != NULL)
+        {
+            fwrite(cache->mapping, 1, cache->mapping_size, file);
+            fclose(file);
+        }
+        free(cache->mapping);
+        free(cache->path);
+#endif
+    }
+    cache->mapping = NULL;
+    cache->entries = NULL;
+    cache->path = NULL;
+}
+
+uint64_t cache_key(const struct chess_board *board, int depth, unsigned settings)
+{
+    // the hash already covers pieces, castling rights and side to move. the multipliers just spread
+    // small numbers over every bit so nearby depths and settings don't land on related keys
+    return board->hash ^ ((uint64_t)(depth + 1) * 0x9E3779B97F4A7C15ull) ^ ((uint64_t)(settings + 1) * 0xD1B54A32D192ED03ull);
+}
+
+static uint64_t cache_pack(const struct chess_summary *summary)
+{
+    uint64_t data = CACHE_USED | (uint64_t)summary->status;
+    data |= summary->winner == PLAYER_BLACK ? CACHE_WINNER_BLACK : 0;
+    data |= summary->next_move_player == PLAYER_BLACK ? CACHE_NEXT_BLACK : 0;
+    if (summary->has_suggestion)
+    {
+        const struct chess_move *move = &summary->suggestion;
+        data |= CACHE_HAS_SUGGESTION;
+        data |= move->is_capture ? CACHE_CAPTURE : 0;
+        data |= move->is_promotion ? CACHE_PROMOTION : 0;
+        data |= move->is_castle ? CACHE_CASTLE : 0;
+        data |= move->castle_kingside ? CACHE_KINGSIDE : 0;
+        data |= (uint64_t)move->piece_type << CACHE_PIECE_SHIFT;
+        data |= (uint64_t)(move->is_promotion ? move->promo_piece : 0) << CACHE_PROMO_SHIFT;
+        data |= (uint64_t)(move->from_row * 8 + move->from_col) << CACHE_FROM_SHIFT;
+        data |= (uint64_t)(move->to_row * 8 + move->to_col) << CACHE_TO_SHIFT;
+    }
+    if (summary->has_tablebase_result)
+    {
+        data |= CACHE_HAS_TABLEBASE;
+        data |= (uint64_t)(uint16_t)(int16_t)summary->tablebase_plies << CACHE_PLIES_SHIFT;
+    }
+    return data;
+}
+
+static void cache_unpack(uint64_t data, struct chess_summary *summary)
+{
+    memset(summary, 0, sizeof(*summary));
+    summary->status = (enum chess_status)(data & CACHE_STATUS_MASK);
+    summary->winner = (data & CACHE_WINNER_BLACK) ? PLAYER_BLACK : PLAYER_WHITE;
+    summary->next_move_player = (data & CACHE_NEXT_BLACK) ? PLAYER_BLACK : PLAYER_WHITE;
+
+    summary->has_suggestion = (data & CACHE_HAS_SUGGESTION) != 0;
+    if (summary->has_suggestion)
+    {
+        struct chess_move *move = &summary->suggestion;
+        int from = (int)(data >> CACHE_FROM_SHIFT & 63);
+        int to = (int)(data >> CACHE_TO_SHIFT & 63);
+        move->player = summary->next_move_player;
+        move->piece_type = (enum chess_piece)(data >> CACHE_PIECE_SHIFT & 7);
+        move->from_row = from / 8;
+        move->from_col = from % 8;
+        move->to_row = to / 8;
+        move->to_col = to % 8;
+        move->is_capture = (data & CACHE_CAPTURE) != 0;
+        move->is_promotion = (data & CACHE_PROMOTION) != 0;
+        move->promo_piece = (enum chess_piece)(data >> CACHE_PROMO_SHIFT & 7);
+        move->is_castle = (data & CACHE_CASTLE) != 0;
+        move->castle_kingside = (data & CACHE_KINGSIDE) != 0;
+    }
+
+    summary->has_tablebase_result = (data & CACHE_HAS_TABLEBASE) != 0;
+    summary->tablebase_plies = summary->has_tablebase_result ? (int16_t)(uint16_t)(data >> CACHE_PLIES_SHIFT) : 0;
+}
+
+bool cache_probe(struct cache *cache, uint64_t key, struct chess_summary *summary)
+{
+    struct cache_entry *entry = &cache->entries[key & (cache->entry_count - 1)];
+    uint64_t data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+    uint64_t check = atomic_load_explicit(&entry->check, memory_order_relaxed);
+    if ((check ^ data) != key || !(data & CACHE_USED))
+    {
+        atomic_fetch_add_explicit(&cache->misses, 1, memory_order_relaxed);
+        return false;
+    }
+    cache_unpack(data, summary);
+    atomic_fetch_add_explicit(&cache->hits, 1, memory_order_relaxed);
+    return true;
+}
+
+void cache_store(struct cache *cache, uint64_t key, const struct chess_summary *summary)
+{
+    struct cache_entry *entry = &cache->entries[key & (cache->entry_count - 1)];
+    uint64_t data = cache_pack(summary);
+    // always replace: a result is as good as any other, and the newest one is likelier to come up again
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+    atomic_store_explicit(&entry->check, data ^ key, memory_order_relaxed);
+    atomic_fetch_add_explicit(&cache->stores, 1, memory_order_relaxed);
+}
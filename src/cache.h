@@ -0,0 +1,62 @@
+#ifndef APSC143__CACHE_H
+#define APSC143__CACHE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "board.h"
+
+// size of a new cache file when nobody says otherwise
+#define CACHE_DEFAULT_MB 64
+
+// one stored result. data is the packed summary, check is data XOR the key:
+// a reader only trusts an entry whose two words XOR back to the key it wants,
+// so two threads writing the same slot at once can't hand back half of each
+struct cache_entry
+{
+    _Atomic uint64_t check;
+    _Atomic uint64_t data;
+};
+
+// Results of board_analyze across a whole corpus, keyed by the position's hash
+// mixed with everything else that changes the answer: the search depth and
+// settings, evaluation weights loaded in place of the compiled-in ones, and
+// the game positions the search checks for repetitions. Shared by every
+// search context that points at it, from any number of threads, without
+// locks. It lives either in memory for one run or in a memory-mapped file
+// that later runs pick up again. The file records which version of the search
+// and evaluation filled it, and a file from another version is refused with
+// CHESS_ERROR_BAD_CACHE rather than answering with stale results.
+struct cache
+{
+    struct cache_entry *entries;
+    size_t entry_count; // power of two
+
+    // where entries came from, so cache_free knows how to give it back
+    void *mapping;
+    size_t mapping_size;
+    char *path; // where to write the cache back to, only without mmap
+
+    atomic_ullong hits, misses, stores;
+};
+
+// An in-memory cache of table_mb megabytes (rounded down to a power of two
+// entries). Returns false if the memory isn't available.
+bool cache_init(struct cache *cache, size_t table_mb);
+// Maps the cache file at path, creating it with table_mb megabytes of entries
+// if it doesn't exist yet (an existing file keeps its size). Returns
+// CHESS_ERROR_BAD_CACHE if the file can't be used or was filled by another
+// version of the search.
+enum chess_error cache_open(struct cache *cache, const char *path, size_t table_mb);
+// Lets go of the entries; a cache file has everything stored so far.
+void cache_free(struct cache *cache);
+
+// settings holds a bit for each other thing that changes the answer (endgame
+// tables loaded, pruning switched on), see board_analyze.
+uint64_t cache_key(const struct chess_board *board, int depth, unsigned settings);
+// Copies the stored result for key into summary. Returns false if there isn't one.
+bool cache_probe(struct cache *cache, uint64_t key, struct chess_summary *summary);
+void cache_store(struct cache *cache, uint64_t key, const struct chess_summary *summary);
+
+#endif
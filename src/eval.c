@@ -0,0 +1,419 @@
+#include "eval.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// how much each piece counts towards the game phase
+static const int phase_weight[6] = {0, 1, 1, 2, 4, 0};
+
+// the compiled-in weights, used by every board whose weights pointer is NULL
+static const struct eval_weights eval_defaults = {
+    .material_mg = {82, 337, 365, 477, 1025, 0},
+    .material_eg = {94, 281, 297, 512, 936, 0},
+
+    // the well known PeSTO tables
+    .pst_mg = {
+        // pawn
+        {0, 0, 0, 0, 0, 0, 0, 0,
+         98, 134, 61, 95, 68, 126, 34, -11,
+         -6, 7, 26, 31, 65, 56, 25, -20,
+         -14, 13, 6, 21, 23, 12, 17, -23,
+         -27, -2, -5, 12, 17, 6, 10, -25,
+         -26, -4, -4, -10, 3, 3, 33, -12,
+         -35, -1, -20, -23, -15, 24, 38, -22,
+         0, 0, 0, 0, 0, 0, 0, 0},
+        // knight
+        {-167, -89, -34, -49, 61, -97, -15, -107,
+         -73, -41, 72, 36, 23, 62, 7, -17,
+         -47, 60, 37, 65, 84, 129, 73, 44,
+         -9, 17, 19, 53, 37, 69, 18, 22,
+         -13, 4, 16, 13, 28, 19, 21, -8,
+         -23, -9, 12, 10, 19, 17, 25, -16,
+         -29, -53, -12, -3, -1, 18, -14, -19,
+         -105, -21, -58, -33, -17, -28, -19, -23},
+        // bishop
+        {-29, 4, -82, -37, -25, -42, 7, -8,
+         -26, 16, -18, -13, 30, 59, 18, -47,
+         -16, 37, 43, 40, 35, 50, 37, -2,
+         -4, 5, 19, 50, 37, 37, 7, -2,
+         -6, 13, 13, 26, 34, 12, 10, 4,
+         0, 15, 15, 15, 14, 27, 18, 10,
+         4, 15, 16, 0, 7, 21, 33, 1,
+         -33, -3, -14, -21, -13, -12, -39, -21},
+        // rook
+        {32, 42, 32, 51, 63, 9, 31, 43,
+         27, 32, 58, 62, 80, 67, 26, 44,
+         -5, 19, 26, 36, 17, 45, 61, 16,
+         -24, -11, 7, 26, 24, 35, -8, -20,
+         -36, -26, -12, -1, 9, -7, 6, -23,
+         -45, -25, -16, -17, 3, 0, -5, -33,
+         -44, -16, -20, -9, -1, 11, -6, -71,
+         -19, -13, 1, 17, 16, 7, -37, -26},
+        // queen
+        {-28, 0, 29, 12, 59, 44, 43, 45,
+         -24, -39, -5, 1, -16, 57, 28, 54,
+         -13, -17, 7, 8, 29, 56, 47, 57,
+         -27, -27, -16, -16, -1, 17, -2, 1,
+         -9, -26, -9, -10, -2, -4, 3, -3,
+         -14, 2, -11, -2, -5, 2, 14, 5,
+         -35, -8, 11, 2, 8, 15, -3, 1,
+         -1, -18, -9, 10, -15, -25, -31, -50},
+        // king
+        {-65, 23, 16, -15, -56, -34, 2, 13,
+         29, -1, -20, -7, -8, -4, -38, -29,
+         -9, 24, 2, -16, -20, 6, 22, -22,
+         -17, -20, -12, -27, -30, -25, -14, -36,
+         -49, -1, -27, -39, -46, -44, -33, -51,
+         -14, -14, -22, -46, -44, -30, -15, -27,
+         1, 7, -8, -64, -43, -16, 9, 8,
+         -15, 36, 12, -54, 8, -28, 24, 14},
+    },
+
+    .pst_eg = {
+        // pawn
+        {0, 0, 0, 0, 0, 0, 0, 0,
+         178, 173, 158, 134, 147, 132, 165, 187,
+         94, 100, 85, 67, 56, 53, 82, 84,
+         32, 24, 13, 5, -2, 4, 17, 17,
+         13, 9, -3, -7, -7, -8, 3, -1,
+         4, 7, -6, 1, 0, -5, -1, -8,
+         13, 8, 8, 10, 13, 0, 2, -7,
+         0, 0, 0, 0, 0, 0, 0, 0},
+        // knight
+        {-58, -38, -13, -28, -31, -27, -63, -99,
+         -25, -8, -25, -2, -9, -25, -24, -52,
+         -24, -20, 10, 9, -1, -9, -19, -41,
+         -17, 3, 22, 22, 22, 11, 8, -18,
+         -18, -6, 16, 25, 16, 17, 4, -18,
+         -23, -3, -1, 15, 10, -3, -20, -22,
+         -42, -20, -10, -5, -2, -20, -23, -44,
+         -29, -51, -23, -15, -22, -18, -50, -64},
+        // bishop
+        {-14, -21, -11, -8, -7, -9, -17, -24,
+         -8, -4, 7, -12, -3, -13, -4, -14,
+         2, -8, 0, -1, -2, 6, 0, 4,
+         -3, 9, 12, 9, 14, 10, 3, 2,
+         -6, 3, 13, 19, 7, 10, -3, -9,
+         -12, -3, 8, 10, 13, 3, -7, -15,
+         -14, -18, -7, -1, 4, -9, -15, -27,
+         -23, -9, -23, -5, -9, -16, -5, -17},
+        // rook
+        {13, 10, 18, 15, 12, 12, 8, 5,
+         11, 13, 13, 11, -3, 3, 8, 3,
+         7, 7, 7, 5, 4, -3, -5, -3,
+         4, 3, 13, 1, 2, 1, -1, 2,
+         3, 5, 8, 4, -5, -6, -8, -11,
+         -4, 0, -5, -1, -7, -12, -8, -16,
+         -6, -6, 0, 2, -9, -9, -11, -3,
+         -9, 2, 3, -1, -5, -13, 4, -20},
+        // queen
+        {-9, 22, 22, 27, 27, 19, 10, 20,
+         -17, 20, 32, 41, 58, 25, 30, 0,
+         -20, 6, 9, 49, 47, 35, 19, 9,
+         3, 22, 24, 45, 57, 40, 57, 36,
+         -18, 28, 19, 47, 31, 34, 39, 23,
+         -16, -27, 15, 6, 9, 17, 10, 5,
+         -22, -23, -30, -16, -16, -23, -36, -32,
+         -33, -28, -22, -43, -5, -32, -20, -41},
+        // king
+        {-74, -35, -18, -18, -11, 15, 4, -17,
+         -12, 17, 14, 17, 17, 38, 23, 11,
+         10, 17, 23, 15, 20, 45, 44, 13,
+         -8, 22, 24, 27, 26, 33, 26, 3,
+         -18, -4, 21, 24, 27, 23, 9, -11,
+         -19, -3, 11, 21, 23, 16, 7, -9,
+         -27, -11, 4, 13, 14, 4, -5, -17,
+         -53, -34, -21, -11, -28, -14, -24, -43},
+    },
+};
+
+// running totals we tweak one piece at a time: white minus black
+struct eval_totals
+{
+    int mg;
+    int eg;
+    int phase;
+};
+
+// adds (sign = +1) or removes (sign = -1) one piece from the totals
+static void eval_accumulate(const struct eval_weights *weights, struct eval_totals *totals, enum chess_piece piece, enum chess_player owner, int row, int col, int sign)
+{
+    // the tables are written for white, black reads them upside down
+    int index = (owner == PLAYER_WHITE) ? row * BOARD_SIZE + col : (BOARD_SIZE - 1 - row) * BOARD_SIZE + col;
+    int side = (owner == PLAYER_WHITE) ? 1 : -1;
+
+    totals->mg += sign * side * (weights->material_mg[piece] + weights->pst_mg[piece][index]);
+    totals->eg += sign * side * (weights->material_eg[piece] + weights->pst_eg[piece][index]);
+    totals->phase += sign * phase_weight[piece];
+}
+
+// blends the middlegame and endgame scores and flips to the given player's point of view
+static int eval_taper(const struct eval_totals *totals, enum chess_player player)
+{
+    int phase = totals->phase;
+    if (phase > EVAL_PHASE_TOTAL) // early promotions can push us past a full board
+    {
+        phase = EVAL_PHASE_TOTAL;
+    }
+
+    int score = (totals->mg * phase + totals->eg * (EVAL_PHASE_TOTAL - phase)) / EVAL_PHASE_TOTAL;
+    return (player == PLAYER_WHITE) ? score : -score;
+}
+
+static const struct eval_weights *eval_weights_or_defaults(const struct eval_weights *weights)
+{
+    return weights != NULL ? weights : &eval_defaults;
+}
+
+static void eval_load_totals(const struct chess_board *board, struct eval_totals *totals)
+{
+    totals->mg = board->eval_mg;
+    totals->eg = board->eval_eg;
+    totals->phase = board->eval_phase;
+}
+
+static void eval_store_totals(struct chess_board *board, const struct eval_totals *totals)
+{
+    board->eval_mg = totals->mg;
+    board->eval_eg = totals->eg;
+    board->eval_phase = totals->phase;
+}
+
+void eval_reset(struct chess_board *board, const struct eval_weights *weights)
+{
+    struct eval_totals totals = {0, 0, 0};
+    board->weights = weights;
+    weights = eval_weights_or_defaults(weights);
+
+    for (int player = PLAYER_WHITE; player <= PLAYER_BLACK; player++)
+    {
+        for (int piece = PIECE_PAWN; piece <= PIECE_KING; piece++)
+        {
+            for (uint64_t remaining = board->pieces[player][piece]; remaining; remaining &= remaining - 1)
+            {
+                int square_index = board_lowest_square(remaining);
+                eval_accumulate(weights, &totals, (enum chess_piece)piece, (enum chess_player)player, square_index / BOARD_SIZE, square_index % BOARD_SIZE, +1);
+            }
+        }
+    }
+
+    eval_store_totals(board, &totals);
+}
+
+void eval_add_piece(struct chess_board *board, enum chess_piece piece, enum chess_player owner, int row, int col)
+{
+    struct eval_totals totals;
+    eval_load_totals(board, &totals);
+    eval_accumulate(eval_weights_or_defaults(board->weights), &totals, piece, owner, row, col, +1);
+    eval_store_totals(board, &totals);
+}
+
+void eval_remove_piece(struct chess_board *board, enum chess_piece piece, enum chess_player owner, int row, int col)
+{
+    struct eval_totals totals;
+    eval_load_totals(board, &totals);
+    eval_accumulate(eval_weights_or_defaults(board->weights), &totals, piece, owner, row, col, -1);
+    eval_store_totals(board, &totals);
+}
+
+void eval_piece_values(const struct eval_weights *weights, enum chess_piece piece, enum chess_player owner, int row, int col, int *mg, int *eg, int *phase)
+{
+    struct eval_totals totals = {0, 0, 0};
+    eval_accumulate(eval_weights_or_defaults(weights), &totals, piece, owner, row, col, +1);
+    *mg = totals.mg;
+    *eg = totals.eg;
+    *phase = totals.phase;
+}
+
+int eval_blend(int mg, int eg, int phase, enum chess_player player)
+{
+    struct eval_totals totals = {mg, eg, phase};
+    return eval_taper(&totals, player);
+}
+
+int eval_board(const struct chess_board *board)
+{
+    struct eval_totals totals;
+    eval_load_totals(board, &totals);
+    return eval_taper(&totals, board->next_move_player);
+}
+
+int eval_after_move(const struct chess_board *board, const struct chess_move *move)
+{
+    const struct eval_weights *weights = eval_weights_or_defaults(board->weights);
+    struct eval_totals totals;
+    eval_load_totals(board, &totals);
+
+    if (move->is_capture)
+    {
+        const struct square *victim = &board->squares[move->to_row][move->to_col];
+        eval_accumulate(weights, &totals, victim->piece, victim->owner, move->to_row, move->to_col, -1);
+    }
+
+    enum chess_piece landed = move->is_promotion ? move->promo_piece : move->piece_type;
+    eval_accumulate(weights, &totals, move->piece_type, move->player, move->from_row, move->from_col, -1);
+    eval_accumulate(weights, &totals, landed, move->player, move->to_row, move->to_col, +1);
+
+    if (move->is_castle) // the rook jumps over the king
+    {
+        int rook_from_col = move->castle_kingside ? 7 : 0;
+        int rook_to_col = move->castle_kingside ? 5 : 3;
+        eval_accumulate(weights, &totals, PIECE_ROOK, move->player, move->from_row, rook_from_col, -1);
+        eval_accumulate(weights, &totals, PIECE_ROOK, move->player, move->from_row, rook_to_col, +1);
+    }
+
+    return eval_taper(&totals, move->player);
+}
+
+static uint64_t eval_hash_weights(const struct eval_weights *weights)
+{
+    // FNV-1a over the values, plenty to tell two weight sets apart
+    const int *values = &weights->material_mg[0];
+    size_t count = sizeof(*weights) / sizeof(int);
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < count; i++)
+    {
+        hash = (hash ^ (uint32_t)values[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+void eval_default_weights(struct eval_weights *weights)
+{
+    *weights = eval_defaults;
+}
+
+uint64_t eval_weights_key(const struct eval_weights *weights)
+{
+    if (weights == NULL || memcmp(weights, &eval_defaults, sizeof(*weights)) == 0)
+    {
+        return 0;
+    }
+    return eval_hash_weights(weights) ^ eval_hash_weights(&eval_defaults);
+}
+
+static const char *const eval_piece_names[6] = {"pawn", "knight", "bishop", "rook", "queen", "king"};
+
+// where the values for a name in the file go, and how many there are. NULL for a name we don't know
+static int *eval_weights_field(struct eval_weights *weights, const char *name, int *count)
+{
+    if (strcmp(name, "material_mg") == 0)
+    {
+        *count = 6;
+        return weights->material_mg;
+    }
+    if (strcmp(name, "material_eg") == 0)
+    {
+        *count = 6;
+        return weights->material_eg;
+    }
+    for (int piece = PIECE_PAWN; piece <= PIECE_KING; piece++)
+    {
+        char field[32];
+        snprintf(field, sizeof(field), "pst_mg_%s", eval_piece_names[piece]);
+        if (strcmp(name, field) == 0)
+        {
+            *count = 64;
+            return weights->pst_mg[piece];
+        }
+        snprintf(field, sizeof(field), "pst_eg_%s", eval_piece_names[piece]);
+        if (strcmp(name, field) == 0)
+        {
+            *count = 64;
+            return weights->pst_eg[piece];
+        }
+    }
+    return NULL;
+}
+
+// the next whitespace separated word from *cursor, cut off in place, or NULL at the end of the line
+static char *eval_next_token(char **cursor)
+{
+    char *start = *cursor + strspn(*cursor, " \t\r\n");
+    if (*start == '\0')
+    {
+        *cursor = start;
+        return NULL;
+    }
+    char *end = start + strcspn(start, " \t\r\n");
+    *cursor = *end != '\0' ? end + 1 : end;
+    *end = '\0';
+    return start;
+}
+
+enum chess_error eval_load_weights(const char *path, struct eval_weights *weights)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return CHESS_ERROR_BAD_WEIGHTS;
+    }
+
+    // fill a copy so a file that turns out to be broken halfway changes nothing
+    struct eval_weights loaded = *weights;
+    int *next = NULL;
+    int remaining = 0;
+    bool ok = true;
+    char line[1024];
+    while (ok && fgets(line, sizeof(line), file) != NULL)
+    {
+        line[strcspn(line, "#")] = '\0';
+        char *cursor = line;
+        for (char *token = eval_next_token(&cursor); ok && token != NULL; token = eval_next_token(&cursor))
+        {
+            if (remaining == 0) // a name, then its values
+            {
+                next = eval_weights_field(&loaded, token, &remaining);
+                ok = next != NULL;
+                continue;
+            }
+            char *end;
+            long value = strtol(token, &end, 10);
+            ok = *end == '\0' && value > -5000 && value < 5000; // keeps any sum of them far from the mate scores
+            *next++ = (int)value;
+            remaining--;
+        }
+    }
+    fclose(file);
+    if (!ok || remaining != 0)
+    {
+        return CHESS_ERROR_BAD_WEIGHTS;
+    }
+    *weights = loaded;
+    return CHESS_OK;
+}
+
+static void eval_save_values(FILE *file, const char *name, const int *values, int count)
+{
+    fprintf(file, "%s", name);
+    for (int i = 0; i < count; i++)
+    {
+        fprintf(file, (count > 8 && i % 8 == 0) ? "\n   " : " ");
+        fprintf(file, "%d", values[i]);
+    }
+    fprintf(file, "\n");
+}
+
+enum chess_error eval_save_weights(const char *path, const struct eval_weights *weights)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        return CHESS_ERROR_BAD_WEIGHTS;
+    }
+    fprintf(file, "# evaluation weights, see eval_save_weights\n");
+    fprintf(file, "# material: pawn knight bishop rook queen king\n");
+    eval_save_values(file, "material_mg", weights->material_mg, 6);
+    eval_save_values(file, "material_eg", weights->material_eg, 6);
+    fprintf(file, "# piece-square tables from white's side, rank 8 first\n");
+    for (int piece = PIECE_PAWN; piece <= PIECE_KING; piece++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "pst_mg_%s", eval_piece_names[piece]);
+        eval_save_values(file, name, weights->pst_mg[piece], 64);
+        snprintf(name, sizeof(name), "pst_eg_%s", eval_piece_names[piece]);
+        eval_save_values(file, name, weights->pst_eg[piece], 64);
+    }
+    bool written = !ferror(file);
+    return (fclose(file) == 0 && written) ? CHESS_OK : CHESS_ERROR_BAD_WEIGHTS;
+}
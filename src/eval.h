@@ -0,0 +1,71 @@
+#ifndef APSC143__EVAL_H
+#define APSC143__EVAL_H
+
+#include "board.h"
+
+// game phase when every piece is still on the board: knights and bishops count 1, rooks 2, queens 4
+#define EVAL_PHASE_TOTAL 24
+
+// Everything in the evaluation that can be tuned: material values for the
+// middlegame and endgame (pawn, knight, bishop, rook, queen, king) and the
+// piece-square tables from white's point of view, laid out like
+// board->squares (row 0 is rank 8).
+struct eval_weights
+{
+    int material_mg[6];
+    int material_eg[6];
+    int pst_mg[6][64];
+    int pst_eg[6][64];
+};
+
+// Wherever a function takes weights, NULL means the compiled-in ones, which
+// never change. Other weights belong to the caller, who keeps them alive and
+// unchanged while any board set up with them is in use.
+
+// A copy of the compiled-in weights, to start a weights file or a tuning run from.
+void eval_default_weights(struct eval_weights *weights);
+// 0 for the compiled-in weights (NULL or the same values), otherwise a hash
+// of weights, so results worked out with different weights aren't mixed up.
+uint64_t eval_weights_key(const struct eval_weights *weights);
+
+// Reads a weights file written by eval_save_weights into weights. Anything
+// the file leaves out keeps the value weights already had. Returns
+// CHESS_ERROR_BAD_WEIGHTS if the file can't be read or doesn't parse.
+enum chess_error eval_load_weights(const char *path, struct eval_weights *weights);
+// Writes weights as text: a name and then its values, "material_mg" and
+// "material_eg" with six each and "pst_mg_pawn" to "pst_eg_king" with 64 each
+// in board->squares order. '#' starts a comment.
+enum chess_error eval_save_weights(const char *path, const struct eval_weights *weights);
+
+// Recomputes the material and piece-square totals on the board from scratch
+// with weights (from board->pieces, so board_reset_pieces goes first), and
+// keeps weights as board->weights for the updates after it. Needed after
+// setting up a position by hand, or to move a board to other weights;
+// board_apply_move keeps the totals up to date from then on.
+void eval_reset(struct chess_board *board, const struct eval_weights *weights);
+
+// Adds or removes one piece's contribution to the running totals, with the
+// board's weights. Called by board.c whenever a piece appears on or leaves a
+// square.
+void eval_add_piece(struct chess_board *board, enum chess_piece piece, enum chess_player owner, int row, int col);
+void eval_remove_piece(struct chess_board *board, enum chess_piece piece, enum chess_player owner, int row, int col);
+
+// Static evaluation in centipawns from the point of view of the player to
+// move: material plus piece-square tables, tapered between the middlegame and
+// endgame tables by how much material is left. O(1), it only reads the
+// running totals. The search adds the pawn structure terms of pawns.h on top.
+int eval_board(const struct chess_board *board);
+
+// One piece's share of running totals kept with weights: its material plus piece-square
+// value for the middlegame and endgame (positive for white, negative for
+// black) and its phase weight. For evaluators that add up the totals their
+// own way, like evalbatch.
+void eval_piece_values(const struct eval_weights *weights, enum chess_piece piece, enum chess_player owner, int row, int col, int *mg, int *eg, int *phase);
+// eval_board's last step: blends totals like the board's into a score for player.
+int eval_blend(int mg, int eg, int phase, enum chess_player player);
+
+// Evaluation of the position after move, from the point of view of the
+// player making it, without playing the move on a copy of the board.
+int eval_after_move(const struct chess_board *board, const struct chess_move *move);
+
+#endif
@@ -0,0 +1,349 @@
+#include "evalbatch.h"
+#include "eval.h"
+#include <stdlib.h>
+#include <string.h>
+
+// the AVX2 kernels are compiled for that target on their own and only called once the CPU says it
+// has it, so the rest of the build doesn't need -mavx2
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define EVALBATCH_HAVE_AVX2 1
+#include <immintrin.h>
+#define EVALBATCH_AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define EVALBATCH_HAVE_AVX2 0
+#endif
+
+#define EVALBATCH_NOT_A (~BOARD_FILE_A)
+#define EVALBATCH_NOT_H (~BOARD_FILE_H)
+#define EVALBATCH_NOT_AB (~(BOARD_FILE_A | BOARD_FILE_A << 1))
+#define EVALBATCH_NOT_GH (~(BOARD_FILE_H | BOARD_FILE_H >> 1))
+
+bool evalbatch_init(struct evalbatch *batch, size_t capacity)
+{
+    memset(batch, 0, sizeof(*batch));
+    capacity = (capacity + EVALBATCH_LANES - 1) / EVALBATCH_LANES * EVALBATCH_LANES;
+    if (capacity == 0)
+    {
+        capacity = EVALBATCH_LANES;
+    }
+    batch->capacity = capacity;
+    batch->codes = malloc(64 * capacity);
+    batch->pieces = malloc(12 * capacity * sizeof(uint64_t));
+    batch->signs = malloc(capacity * sizeof(int32_t));
+    batch->scores = malloc(capacity * sizeof(int32_t));
+    batch->mobility = malloc(capacity * sizeof(int32_t));
+    batch->phase = malloc(capacity * sizeof(int32_t));
+    if (batch->codes == NULL || batch->pieces == NULL || batch->signs == NULL || batch->scores == NULL || batch->mobility == NULL || batch->phase == NULL)
+    {
+        evalbatch_free(batch);
+        return false;
+    }
+
+    evalbatch_load_weights(batch, NULL);
+    evalbatch_clear(batch);
+    return true;
+}
+
+void evalbatch_load_weights(struct evalbatch *batch, const struct eval_weights *weights)
+{
+    for (int square = 0; square < 64; square++)
+    {
+        batch->table_mg[square * 16] = batch->table_eg[square * 16] = 0; // empty
+        for (int code = 1; code < 16; code++)
+        {
+            int piece = (code - 1) % 8;
+            int mg = 0, eg = 0, phase = 0;
+            if (piece <= PIECE_KING)
+            {
+                eval_piece_values(weights, (enum chess_piece)piece, (enum chess_player)((code - 1) / 8), square / BOARD_SIZE, square % BOARD_SIZE, &mg, &eg, &phase);
+            }
+            batch->table_mg[square * 16 + code] = mg;
+            batch->table_eg[square * 16 + code] = eg;
+        }
+    }
+}
+
+void evalbatch_free(struct evalbatch *batch)
+{
+    free(batch->codes);
+    free(batch->pieces);
+    free(batch->signs);
+    free(batch->scores);
+    free(batch->mobility);
+    free(batch->phase);
+    memset(batch, 0, sizeof(*batch));
+}
+
+void evalbatch_clear(struct evalbatch *batch)
+{
+    // the kernels always run whole steps, so the padding has to be something harmless: empty boards
+    batch->count = 0;
+    memset(batch->codes, 0, 64 * batch->capacity);
+    memset(batch->pieces, 0, 12 * batch->capacity * sizeof(uint64_t));
+    for (size_t i = 0; i < batch->capacity; i++)
+    {
+        batch->signs[i] = 1;
+    }
+}
+
+bool evalbatch_add(struct evalbatch *batch, const struct chess_board *board)
+{
+    if (batch->count == batch->capacity)
+    {
+        return false;
+    }
+    size_t index = batch->count++;
+    size_t capacity = batch->capacity;
+    for (int row = 0; row < BOARD_SIZE; row++)
+    {
+        for (int col = 0; col < BOARD_SIZE; col++)
+        {
+            const struct square *square = &board->squares[row][col];
+            batch->codes[(row * BOARD_SIZE + col) * capacity + index] = square->has_piece ? (uint8_t)(1 + square->piece + 8 * square->owner) : 0;
+        }
+    }
+    for (int player = PLAYER_WHITE; player <= PLAYER_BLACK; player++)
+    {
+        for (int piece = PIECE_PAWN; piece <= PIECE_KING; piece++)
+        {
+            batch->pieces[(player * 6 + piece) * capacity + index] = board->pieces[player][piece];
+        }
+    }
+    batch->signs[index] = board->next_move_player == PLAYER_WHITE ? 1 : -1;
+    return true;
+}
+
+// ---- scalar kernels, also the reference the vector ones have to match ----
+
+static uint64_t evalbatch_shift(uint64_t squares, int shift)
+{
+    return shift > 0 ? squares << shift : squares >> -shift;
+}
+
+// every square the sliders reach going one way (shift per step, mask drops the squares a step
+// wraps round to) until they hit something, that something included. kogge-stone: the rays are
+// grown through the empty squares 1, 2 then 4 steps at a time
+static uint64_t evalbatch_slide(uint64_t sliders, uint64_t empty, int shift, uint64_t mask)
+{
+    uint64_t open = empty & mask;
+    sliders |= open & evalbatch_shift(sliders, shift);
+    open &= evalbatch_shift(open, shift);
+    sliders |= open & evalbatch_shift(sliders, 2 * shift);
+    open &= evalbatch_shift(open, 2 * shift);
+    sliders |= open & evalbatch_shift(sliders, 4 * shift);
+    return evalbatch_shift(sliders, shift) & mask;
+}
+
+static uint64_t evalbatch_knight_attacks(uint64_t knights)
+{
+    return ((knights << 17) & EVALBATCH_NOT_A) | ((knights << 15) & EVALBATCH_NOT_H) | ((knights << 10) & EVALBATCH_NOT_AB) | ((knights << 6) & EVALBATCH_NOT_GH) |
+           ((knights >> 17) & EVALBATCH_NOT_H) | ((knights >> 15) & EVALBATCH_NOT_A) | ((knights >> 10) & EVALBATCH_NOT_GH) | ((knights >> 6) & EVALBATCH_NOT_AB);
+}
+
+static int evalbatch_mobility(const uint64_t *pieces, uint64_t own, uint64_t empty)
+{
+    uint64_t diagonal = pieces[PIECE_BISHOP] | pieces[PIECE_QUEEN];
+    uint64_t straight = pieces[PIECE_ROOK] | pieces[PIECE_QUEEN];
+    uint64_t knight_squares = evalbatch_knight_attacks(pieces[PIECE_KNIGHT]);
+    uint64_t diagonal_squares = evalbatch_slide(diagonal, empty, 9, EVALBATCH_NOT_A) | evalbatch_slide(diagonal, empty, 7, EVALBATCH_NOT_H) |
+                                evalbatch_slide(diagonal, empty, -7, EVALBATCH_NOT_A) | evalbatch_slide(diagonal, empty, -9, EVALBATCH_NOT_H);
+    uint64_t straight_squares = evalbatch_slide(straight, empty, 1, EVALBATCH_NOT_A) | evalbatch_slide(straight, empty, -1, EVALBATCH_NOT_H) |
+                                evalbatch_slide(straight, empty, 8, ~0ull) | evalbatch_slide(straight, empty, -8, ~0ull);
+    return board_count_squares(knight_squares & ~own) + board_count_squares(diagonal_squares & ~own) + board_count_squares(straight_squares & ~own);
+}
+
+static void evalbatch_run_scalar(struct evalbatch *batch)
+{
+    size_t capacity = batch->capacity;
+    for (size_t i = 0; i < batch->count; i++)
+    {
+        uint64_t pieces[2][6];
+        uint64_t own[2] = {0, 0};
+        for (int player = PLAYER_WHITE; player <= PLAYER_BLACK; player++)
+        {
+            for (int piece = PIECE_PAWN; piece <= PIECE_KING; piece++)
+            {
+                pieces[player][piece] = batch->pieces[(player * 6 + piece) * capacity + i];
+                own[player] |= pieces[player][piece];
+            }
+        }
+        uint64_t empty = ~(own[PLAYER_WHITE] | own[PLAYER_BLACK]);
+        int mobility = evalbatch_mobility(pieces[PLAYER_WHITE], own[PLAYER_WHITE], empty) - evalbatch_mobility(pieces[PLAYER_BLACK], own[PLAYER_BLACK], empty);
+        batch->mobility[i] = batch->signs[i] * mobility;
+
+        int phase = 0;
+        for (int player = PLAYER_WHITE; player <= PLAYER_BLACK; player++)
+        {
+            phase += board_count_squares(pieces[player][PIECE_KNIGHT]) + board_count_squares(pieces[player][PIECE_BISHOP]) + 2 * board_count_squares(pieces[player][PIECE_ROOK]) +
+                     4 * board_count_squares(pieces[player][PIECE_QUEEN]);
+        }
+
+        int mg = 0, eg = 0;
+        for (int square = 0; square < 64; square++)
+        {
+            int index = square * 16 + batch->codes[square * capacity + i];
+            mg += batch->table_mg[index];
+            eg += batch->table_eg[index];
+        }
+        batch->scores[i] = eval_blend(mg, eg, phase, batch->signs[i] > 0 ? PLAYER_WHITE : PLAYER_BLACK);
+    }
+}
+
+// ---- AVX2 kernels: the same steps on four (bitboards) or eight (everything else) positions at once ----
+
+#if EVALBATCH_HAVE_AVX2
+EVALBATCH_AVX2_TARGET static inline __m256i evalbatch_shift_avx2(__m256i squares, int shift)
+{
+    return shift > 0 ? _mm256_sll_epi64(squares, _mm_cvtsi32_si128(shift)) : _mm256_srl_epi64(squares, _mm_cvtsi32_si128(-shift));
+}
+
+EVALBATCH_AVX2_TARGET static inline __m256i evalbatch_slide_avx2(__m256i sliders, __m256i empty, int shift, uint64_t mask)
+{
+    __m256i masked = _mm256_set1_epi64x((long long)mask);
+    __m256i open = _mm256_and_si256(empty, masked);
+    sliders = _mm256_or_si256(sliders, _mm256_and_si256(open, evalbatch_shift_avx2(sliders, shift)));
+    open = _mm256_and_si256(open, evalbatch_shift_avx2(open, shift));
+    sliders = _mm256_or_si256(sliders, _mm256_and_si256(open, evalbatch_shift_avx2(sliders, 2 * shift)));
+    open = _mm256_and_si256(open, evalbatch_shift_avx2(open, 2 * shift));
+    sliders = _mm256_or_si256(sliders, _mm256_and_si256(open, evalbatch_shift_avx2(sliders, 4 * shift)));
+    return _mm256_and_si256(evalbatch_shift_avx2(sliders, shift), masked);
+}
+
+EVALBATCH_AVX2_TARGET static inline __m256i evalbatch_step_avx2(__m256i squares, int shift, uint64_t mask)
+{
+    return _mm256_and_si256(evalbatch_shift_avx2(squares, shift), _mm256_set1_epi64x((long long)mask));
+}
+
+EVALBATCH_AVX2_TARGET static inline __m256i evalbatch_knight_attacks_avx2(__m256i knights)
+{
+    __m256i ahead = _mm256_or_si256(_mm256_or_si256(evalbatch_step_avx2(knights, 17, EVALBATCH_NOT_A), evalbatch_step_avx2(knights, 15, EVALBATCH_NOT_H)),
+                                    _mm256_or_si256(evalbatch_step_avx2(knights, 10, EVALBATCH_NOT_AB), evalbatch_step_avx2(knights, 6, EVALBATCH_NOT_GH)));
+    __m256i behind = _mm256_or_si256(_mm256_or_si256(evalbatch_step_avx2(knights, -17, EVALBATCH_NOT_H), evalbatch_step_avx2(knights, -15, EVALBATCH_NOT_A)),
+                                     _mm256_or_si256(evalbatch_step_avx2(knights, -10, EVALBATCH_NOT_GH), evalbatch_step_avx2(knights, -6, EVALBATCH_NOT_AB)));
+    return _mm256_or_si256(ahead, behind);
+}
+
+// bits set in each 64 bit lane: a nibble lookup table per byte, then the bytes summed
+EVALBATCH_AVX2_TARGET static inline __m256i evalbatch_count_avx2(__m256i squares)
+{
+    const __m256i nibble_counts = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+    __m256i low = _mm256_shuffle_epi8(nibble_counts, _mm256_and_si256(squares, low_nibbles));
+    __m256i high = _mm256_shuffle_epi8(nibble_counts, _mm256_and_si256(_mm256_srli_epi16(squares, 4), low_nibbles));
+    return _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256());
+}
+
+EVALBATCH_AVX2_TARGET static inline __m256i evalbatch_mobility_avx2(const __m256i *pieces, __m256i own, __m256i empty)
+{
+    __m256i diagonal = _mm256_or_si256(pieces[PIECE_BISHOP], pieces[PIECE_QUEEN]);
+    __m256i straight = _mm256_or_si256(pieces[PIECE_ROOK], pieces[PIECE_QUEEN]);
+    __m256i knight_squares = evalbatch_knight_attacks_avx2(pieces[PIECE_KNIGHT]);
+    __m256i diagonal_squares = _mm256_or_si256(_mm256_or_si256(evalbatch_slide_avx2(diagonal, empty, 9, EVALBATCH_NOT_A), evalbatch_slide_avx2(diagonal, empty, 7, EVALBATCH_NOT_H)),
+                                               _mm256_or_si256(evalbatch_slide_avx2(diagonal, empty, -7, EVALBATCH_NOT_A), evalbatch_slide_avx2(diagonal, empty, -9, EVALBATCH_NOT_H)));
+    __m256i straight_squares = _mm256_or_si256(_mm256_or_si256(evalbatch_slide_avx2(straight, empty, 1, EVALBATCH_NOT_A), evalbatch_slide_avx2(straight, empty, -1, EVALBATCH_NOT_H)),
+                                               _mm256_or_si256(evalbatch_slide_avx2(straight, empty, 8, ~0ull), evalbatch_slide_avx2(straight, empty, -8, ~0ull)));
+    __m256i count = evalbatch_count_avx2(_mm256_andnot_si256(own, knight_squares));
+    count = _mm256_add_epi64(count, evalbatch_count_avx2(_mm256_andnot_si256(own, diagonal_squares)));
+    return _mm256_add_epi64(count, evalbatch_count_avx2(_mm256_andnot_si256(own, straight_squares)));
+}
+
+// the low 32 bits of each 64 bit lane, packed into four 32 bit lanes
+EVALBATCH_AVX2_TARGET static inline __m128i evalbatch_narrow_avx2(__m256i values)
+{
+    return _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(values, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6)));
+}
+
+EVALBATCH_AVX2_TARGET static void evalbatch_run_avx2(struct evalbatch *batch)
+{
+    size_t capacity = batch->capacity;
+    size_t count = (batch->count + EVALBATCH_LANES - 1) / EVALBATCH_LANES * EVALBATCH_LANES;
+
+    // mobility and phase from the piece sets, four positions per 256 bit register
+    for (size_t i = 0; i < count; i += 4)
+    {
+        __m256i pieces[2][6];
+        __m256i own[2] = {_mm256_setzero_si256(), _mm256_setzero_si256()};
+        for (int player = PLAYER_WHITE; player <= PLAYER_BLACK; player++)
+        {
+            for (int piece = PIECE_PAWN; piece <= PIECE_KING; piece++)
+            {
+                pieces[player][piece] = _mm256_loadu_si256((const __m256i *)&batch->pieces[(player * 6 + piece) * capacity + i]);
+                own[player] = _mm256_or_si256(own[player], pieces[player][piece]);
+            }
+        }
+        __m256i empty = _mm256_xor_si256(_mm256_or_si256(own[PLAYER_WHITE], own[PLAYER_BLACK]), _mm256_set1_epi64x(-1));
+        __m256i mobility = _mm256_sub_epi64(evalbatch_mobility_avx2(pieces[PLAYER_WHITE], own[PLAYER_WHITE], empty), evalbatch_mobility_avx2(pieces[PLAYER_BLACK], own[PLAYER_BLACK], empty));
+        __m128i signs = _mm_loadu_si128((const __m128i *)&batch->signs[i]);
+        _mm_storeu_si128((__m128i *)&batch->mobility[i], _mm_sign_epi32(evalbatch_narrow_avx2(mobility), signs));
+
+        __m256i minors = _mm256_setzero_si256(), rooks = _mm256_setzero_si256(), queens = _mm256_setzero_si256();
+        for (int player = PLAYER_WHITE; player <= PLAYER_BLACK; player++)
+        {
+            minors = _mm256_add_epi64(minors, evalbatch_count_avx2(_mm256_or_si256(pieces[player][PIECE_KNIGHT], pieces[player][PIECE_BISHOP])));
+            rooks = _mm256_add_epi64(rooks, evalbatch_count_avx2(pieces[player][PIECE_ROOK]));
+            queens = _mm256_add_epi64(queens, evalbatch_count_avx2(pieces[player][PIECE_QUEEN]));
+        }
+        __m256i phase = _mm256_add_epi64(minors, _mm256_add_epi64(_mm256_slli_epi64(rooks, 1), _mm256_slli_epi64(queens, 2)));
+        _mm_storeu_si128((__m128i *)&batch->phase[i], evalbatch_narrow_avx2(phase));
+    }
+
+    // material and piece-square values, one gather per square and half for eight positions, then the taper
+    const __m256i full_phase = _mm256_set1_epi32(EVAL_PHASE_TOTAL);
+    const __m256 phase_divisor = _mm256_set1_ps((float)EVAL_PHASE_TOTAL);
+    for (size_t i = 0; i < count; i += EVALBATCH_LANES)
+    {
+        __m256i mg = _mm256_setzero_si256(), eg = _mm256_setzero_si256();
+        for (int square = 0; square < 64; square++)
+        {
+            __m256i codes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&batch->codes[square * capacity + i]));
+            __m256i index = _mm256_add_epi32(codes, _mm256_set1_epi32(square * 16));
+            mg = _mm256_add_epi32(mg, _mm256_i32gather_epi32(batch->table_mg, index, 4));
+            eg = _mm256_add_epi32(eg, _mm256_i32gather_epi32(batch->table_eg, index, 4));
+        }
+
+        // the blend, as eval_blend does it. the sums stay far below 2^24, so dividing in single
+        // precision and truncating gives exactly the integer division
+        __m256i phase = _mm256_min_epi32(_mm256_loadu_si256((const __m256i *)&batch->phase[i]), full_phase);
+        __m256i blended = _mm256_add_epi32(_mm256_mullo_epi32(mg, phase), _mm256_mullo_epi32(eg, _mm256_sub_epi32(full_phase, phase)));
+        __m256i score = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(blended), phase_divisor));
+        __m256i signs = _mm256_loadu_si256((const __m256i *)&batch->signs[i]);
+        _mm256_storeu_si256((__m256i *)&batch->scores[i], _mm256_sign_epi32(score, signs));
+    }
+}
+#endif
+
+static bool evalbatch_have_avx2(void)
+{
+#if EVALBATCH_HAVE_AVX2
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+enum evalbatch_kernel evalbatch_run(struct evalbatch *batch, enum evalbatch_kernel kernel)
+{
+    if (kernel != EVALBATCH_SCALAR && evalbatch_have_avx2())
+    {
+#if EVALBATCH_HAVE_AVX2
+        evalbatch_run_avx2(batch);
+        return EVALBATCH_AVX2;
+#endif
+    }
+    evalbatch_run_scalar(batch);
+    return EVALBATCH_SCALAR;
+}
+
+const char *evalbatch_kernel_name(enum evalbatch_kernel kernel)
+{
+    switch (kernel)
+    {
+    case EVALBATCH_AVX2:
+        return "avx2";
+    case EVALBATCH_SCALAR:
+        return "scalar";
+    default:
+        return "auto";
+    }
+}
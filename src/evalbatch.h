@@ -0,0 +1,71 @@
+#ifndef APSC143__EVALBATCH_H
+#define APSC143__EVALBATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "board.h"
+
+// positions one kernel step covers. capacities are rounded up to a multiple of this, the padding
+// is empty boards that nobody reads back
+#define EVALBATCH_LANES 8
+
+enum evalbatch_kernel
+{
+    EVALBATCH_AUTO,   // the fastest one this machine can run
+    EVALBATCH_SCALAR, // plain C, runs anywhere
+    EVALBATCH_AVX2,   // eight positions at a time on x86 with AVX2
+};
+
+// Many positions evaluated together, for corpus statistics and tuning where
+// eval_board one board at a time would leave the vector units idle. The
+// positions are stored structure-of-arrays, one column per square and per
+// piece set, so a kernel reads the same square (or piece set) of eight
+// positions with one load. Each position gets:
+//   - its eval_board score (material plus piece-square, tapered by phase),
+//     worked out from scratch rather than from the board's running totals
+//   - a mobility term eval_board doesn't have yet: the squares each side's
+//     knights, bishops, rooks and queens attack that aren't its own, counted
+//     once per piece type, side to move minus the other side
+struct evalbatch
+{
+    size_t count, capacity;
+
+    // codes[square * capacity + i] is position i's piece on square (row * 8 + col): 0 for
+    // empty, otherwise 1 + piece + 8 * owner
+    uint8_t *codes;
+    // pieces[(owner * 6 + piece) * capacity + i] is position i's board->pieces[owner][piece]
+    uint64_t *pieces;
+    int32_t *signs; // +1 if white is to move, -1 if black
+
+    // results of evalbatch_run, from the point of view of the player to move
+    int32_t *scores;
+    int32_t *mobility;
+
+    int32_t *phase; // scratch column between the two kernel stages
+
+    // eval_piece_values by square and code, one table for each half. they aren't packed into one
+    // word: loaded weights can take a board's totals past 16 bits
+    int32_t table_mg[64 * 16];
+    int32_t table_eg[64 * 16];
+};
+
+// Room for capacity positions, scored with the compiled-in weights. Returns
+// false if the memory isn't available.
+bool evalbatch_init(struct evalbatch *batch, size_t capacity);
+void evalbatch_free(struct evalbatch *batch);
+// Scores the batch with weights from now on (NULL for the compiled-in ones).
+// The table is a copy, so weights may change or go away afterwards.
+void evalbatch_load_weights(struct evalbatch *batch, const struct eval_weights *weights);
+// Empties the batch for the next lot of positions.
+void evalbatch_clear(struct evalbatch *batch);
+// Copies board in as the next position. Returns false if the batch is full.
+bool evalbatch_add(struct evalbatch *batch, const struct chess_board *board);
+
+// Fills in scores and mobility for every position added so far. Asking for a
+// kernel the machine (or compiler) doesn't have falls back to the scalar one.
+// Every kernel gives exactly the same results. Returns the kernel that ran.
+enum evalbatch_kernel evalbatch_run(struct evalbatch *batch, enum evalbatch_kernel kernel);
+const char *evalbatch_kernel_name(enum evalbatch_kernel kernel);
+
+#endif
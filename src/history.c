@@ -0,0 +1,170 @@
+#include "history.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool history_init(struct history *history, int capacity)
+{
+    history->count = 0;
+    history->capacity = capacity > 0 ? capacity : 1;
+    history->entries = malloc((size_t)history->capacity * sizeof(struct history_entry));
+    return history->entries != NULL;
+}
+
+void history_free(struct history *history)
+{
+    free(history->entries);
+    history->entries = NULL;
+    history->count = 0;
+    history->capacity = 0;
+}
+
+void history_reset(struct history *history, const struct chess_board *board)
+{
+    history->entries[0].hash = board->hash;
+    history->entries[0].halfmove_clock = 0;
+    history->count = 1;
+}
+
+// doubles the stack when it's full. only a game longer than anyone planned for gets here
+static bool history_reserve(struct history *history, int wanted)
+{
+    if (wanted <= history->capacity)
+    {
+        return true;
+    }
+    int capacity = history->capacity * 2 > wanted ? history->capacity * 2 : wanted;
+    struct history_entry *entries = realloc(history->entries, (size_t)capacity * sizeof(struct history_entry));
+    if (entries == NULL)
+    {
+        return false;
+    }
+    history->entries = entries;
+    history->capacity = capacity;
+    return true;
+}
+
+static bool history_add(struct history *history, uint64_t hash, int halfmove_clock)
+{
+    if (!history_reserve(history, history->count + 1))
+    {
+        return false;
+    }
+    history->entries[history->count].hash = hash;
+    history->entries[history->count].halfmove_clock = halfmove_clock;
+    history->count++;
+    return true;
+}
+
+bool history_push(struct history *history, const struct chess_board *board, const struct chess_move *move)
+{
+    bool irreversible = move->is_capture || move->piece_type == PIECE_PAWN;
+    int clock = (irreversible || history->count == 0) ? 0 : history->entries[history->count - 1].halfmove_clock + 1;
+    return history_add(history, board->hash, clock);
+}
+
+bool history_push_null(struct history *history, const struct chess_board *board)
+{
+    return history_add(history, board->hash, 0);
+}
+
+void history_pop(struct history *history)
+{
+    history->count--;
+}
+
+bool history_copy_recent(struct history *dst, const struct history *src, int max)
+{
+    int count = src->count;
+    if (count > 0 && count > src->entries[count - 1].halfmove_clock + 1)
+    {
+        count = src->entries[count - 1].halfmove_clock + 1;
+    }
+    if (count > max)
+    {
+        count = max;
+    }
+    if (!history_reserve(dst, count))
+    {
+        return false;
+    }
+    memcpy(dst->entries, src->entries + src->count - count, (size_t)count * sizeof(struct history_entry));
+    dst->count = count;
+    return true;
+}
+
+int history_repetitions(const struct history *history)
+{
+    const struct history_entry *current = &history->entries[history->count - 1];
+    int oldest = history->count - 1 - current->halfmove_clock;
+    if (oldest < 0)
+    {
+        oldest = 0;
+    }
+
+    // the side to move is part of the hash, so only every other position can match
+    int repetitions = 0;
+    for (int i = history->count - 3; i >= oldest; i -= 2)
+    {
+        if (history->entries[i].hash == current->hash)
+        {
+            repetitions++;
+        }
+    }
+    return repetitions;
+}
+
+bool history_fifty_moves(const struct history *history)
+{
+    return history->entries[history->count - 1].halfmove_clock >= HISTORY_FIFTY_MOVE_PLIES;
+}
+
+bool history_search_repetition(const struct history *history, int root)
+{
+    const struct history_entry *current = &history->entries[history->count - 1];
+    int oldest = history->count - 1 - current->halfmove_clock;
+    if (oldest < 0)
+    {
+        oldest = 0;
+    }
+
+    int before_root = 0;
+    for (int i = history->count - 3; i >= oldest; i -= 2)
+    {
+        if (history->entries[i].hash == current->hash && (i > root || ++before_root == 2))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t history_key(const struct history *history)
+{
+    const struct history_entry *current = &history->entries[history->count - 1];
+    int oldest = history->count - 1 - current->halfmove_clock;
+    if (oldest < 0)
+    {
+        oldest = 0;
+    }
+
+    // every position the window has at least twice, each once: XOR doesn't care what order the
+    // game went through them in, so transposed move orders share a key
+    uint64_t key = 0;
+    for (int i = history->count - 1; i >= oldest; i--)
+    {
+        bool later = false, earlier = false;
+        for (int j = i + 2; j < history->count && !later; j += 2)
+        {
+            later = history->entries[j].hash == history->entries[i].hash;
+        }
+        for (int j = i - 2; j >= oldest && !later && !earlier; j -= 2)
+        {
+            earlier = history->entries[j].hash == history->entries[i].hash;
+        }
+        if (!later && earlier)
+        {
+            key ^= history->entries[i].hash;
+        }
+    }
+    return key;
+}
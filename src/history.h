@@ -0,0 +1,66 @@
+#ifndef APSC143__HISTORY_H
+#define APSC143__HISTORY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "board.h"
+
+// positions a game history starts with room for, more than nearly any game needs
+#define HISTORY_GAME_PLIES 512
+// a draw can be claimed once this many plies pass without a capture or pawn move
+#define HISTORY_FIFTY_MOVE_PLIES 100
+
+// one position of a game: its hash and the plies since the last capture or pawn move
+struct history_entry
+{
+    uint64_t hash;
+    int halfmove_clock;
+};
+
+// The positions a game has been through, for the draw rules a chess_board
+// can't see on its own: threefold repetition and the fifty-move rule. It's a
+// stack with the current position on top, allocated once per game and reused
+// (history_reset) for the next one; the search pushes and pops its own path
+// on a copy. A capture or pawn move can never be undone, so nothing before it
+// can come round again and the repetition checks only look back that far.
+struct history
+{
+    struct history_entry *entries;
+    int count, capacity;
+};
+
+// Room for capacity positions before the stack has to grow. Returns false if
+// the memory isn't available.
+bool history_init(struct history *history, int capacity);
+void history_free(struct history *history);
+// Starts a new game at board, with no plies since the last capture or pawn move.
+void history_reset(struct history *history, const struct chess_board *board);
+// Adds board, the position after move. Returns false if the stack was full
+// and couldn't grow.
+bool history_push(struct history *history, const struct chess_board *board, const struct chess_move *move);
+// Adds board after a null move. Passing isn't a real move, so it's treated as
+// one that can't be undone: nothing earlier counts as a repetition.
+bool history_push_null(struct history *history, const struct chess_board *board);
+// Takes the last position off again.
+void history_pop(struct history *history);
+// Replaces dst with the positions of src since the last capture or pawn move,
+// at most max of them (the most recent). Returns false if dst couldn't grow.
+bool history_copy_recent(struct history *dst, const struct history *src, int max);
+
+// How many times the current position appeared before, since the last
+// capture or pawn move. 2 means threefold repetition.
+int history_repetitions(const struct history *history);
+// Whether the fifty-move rule lets either player claim a draw now.
+bool history_fifty_moves(const struct history *history);
+// Whether a search whose root is entries[root] should score the current
+// position as a draw by repetition: it appeared after the root, or twice
+// before it. A position from before the root seen only once would only be a
+// twofold repetition, which doesn't end the game, so the search plays on.
+bool history_search_repetition(const struct history *history, int root);
+// Mixes the positions the repetition checks can still see that appeared at
+// least twice (the current one included) into one key, 0 if there are none:
+// for history_search_repetition those are the only ones before a root that
+// count, so results that depend on the game's history can be cached by it.
+uint64_t history_key(const struct history *history);
+
+#endif
@@ -1,18 +1,378 @@
 #include "board.h"
 #include "parser.h"
+#include "search.h"
+#include "panic.h"
+#include "uci.h"
+#include "batch.h"
+#include "pipeline.h"
+#include "report.h"
+#include "tablebase.h"
+#include "mate.h"
+#include "cache.h"
+#include "bench.h"
+#include "eval.h"
+#include "history.h"
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
 
-int main()
+// the library hands back error codes, the command line tool turns them into the messages it has always printed
+static void report_move_error(enum chess_error error, const struct chess_move *move)
+{
+    if (error == CHESS_OK)
+    {
+        return;
+    }
+
+    char message[128];
+    chess_describe_move_error(message, sizeof(message), error, move);
+    panicf("%s\n", message);
+}
+
+// prints "mate in N: <line in SAN>" or "no mate in N" for the final position
+static int solve_mate(const struct chess_board *board, int moves, int table_mb, bool print_stats)
+{
+    struct mate_context context;
+    if (!mate_context_init(&context, (size_t)table_mb))
+    {
+        panicf("out of memory\n");
+    }
+
+    struct chess_move line[2 * MATE_MAX_MOVES];
+    int length;
+    if (mate_search(&context, board, moves, line, &length))
+    {
+        printf("mate in %d:", (length + 1) / 2);
+        struct chess_board position = *board;
+        for (int i = 0; i < length; i++)
+        {
+            char text[10];
+            format_move_san(&position, &line[i], text);
+            printf(" %s", text);
+            board_apply_move(&position, &line[i]);
+        }
+        printf("\n");
+    }
+    else
+    {
+        printf("no mate in %d\n", moves);
+    }
+
+    if (print_stats)
+    {
+        const struct mate_stats *stats = &context.stats;
+        fprintf(stderr, "nodes %llu checks tried %llu table hits %llu\n", stats->nodes, stats->checks, stats->table_hits);
+    }
+    mate_context_free(&context);
+    return 0;
+}
+
+static void print_cache_stats(struct cache *cache, bool print_stats)
+{
+    if (cache != NULL && print_stats)
+    {
+        fprintf(stderr, "cache hits %llu misses %llu stores %llu\n", atomic_load(&cache->hits), atomic_load(&cache->misses), atomic_load(&cache->stores));
+    }
+}
+
+// one game's moves from stdin, then a mate search from where it ended up or an analysis of it
+static int game_main(struct report_writer *report, enum report_format format, bool trusted, int mate_moves, int depth, int multi_pv, int table_mb, int threads, const struct search_pruning *pruning, const struct tablebase *tablebase, const struct eval_weights *weights, struct cache *cache, bool print_stats)
 {
     struct chess_board board;
     board_initialize(&board);
+    struct history game;
+    if (!history_init(&game, HISTORY_GAME_PLIES))
+    {
+        panicf("out of memory\n");
+    }
+    history_reset(&game, &board);
 
     struct chess_move move;
     while (parse_move(&move))
     {
-        board_complete_move(&board, &move);
-        board_apply_move(&board, &move);
+        if (trusted)
+        {
+            report_move_error(board_complete_move_trusted(&board, &move), &move);
+            board_apply_move_trusted(&board, &move);
+        }
+        else
+        {
+            report_move_error(board_complete_move(&board, &move), &move);
+            report_move_error(board_apply_move(&board, &move), &move);
+        }
+        if (!history_push(&game, &board, &move))
+        {
+            panicf("out of memory\n");
+        }
+    }
+    if (trusted) // the trusted calls leave the attack maps behind
+    {
+        board_update_attacks(&board);
     }
 
-    board_summarize(&board);
-    return 0;
+    int exit_code = 0;
+    if (mate_moves > 0) // puzzle mode: is there a forced mate, and how does it go
+    {
+        exit_code = solve_mate(&board, mate_moves, table_mb, print_stats);
+    }
+    else
+    {
+        struct search_context context;
+        if (!search_context_init(&context, (size_t)table_mb) || !search_context_set_threads(&context, threads))
+        {
+            panicf("out of memory\n");
+        }
+        context.tablebase = tablebase;
+        search_context_set_weights(&context, weights);
+        context.cache = cache;
+        context.pruning = *pruning;
+        context.multi_pv = multi_pv;
+        context.game = &game;
+
+        struct chess_summary summary;
+        unsigned long long start = search_now_ns();
+        enum chess_error error = board_analyze(&board, &context, depth, &summary);
+        char san[CHESS_MAX_LINES][10];
+        struct report_record record = {.game = 1, .summary = &summary, .san = san, .analysis_ns = search_now_ns() - start};
+        if (format != REPORT_TEXT)
+        {
+            report_format_san(&board, &summary, san);
+        }
+        report_write(report, &record);
+        report_finish(report);
+        if (error)
+        {
+            panicf("move completion error: %s\n", chess_error_string(error));
+        }
+
+        if (print_stats)
+        {
+            const struct search_stats *stats = &context.stats;
+            double cutoff_rate = stats->beta_cutoffs ? 100.0 * stats->first_move_cutoffs / stats->beta_cutoffs : 0.0;
+            fprintf(stderr, "nodes %llu qnodes %llu tt hits %llu cutoffs %llu first move cutoffs %.1f%%\n", stats->nodes, stats->qnodes, stats->tt_hits, stats->beta_cutoffs, cutoff_rate);
+            fprintf(stderr, "null move cutoffs %llu late move reductions %llu researched %llu futility pruned %llu\n", stats->null_move_cutoffs, stats->late_move_reductions, stats->late_move_researches, stats->futility_prunes);
+            fprintf(stderr, "pawn cache hits %llu misses %llu\n", stats->pawn_hits, stats->pawn_misses);
+        }
+
+        print_cache_stats(cache, print_stats);
+        search_context_free(&context);
+    }
+
+    history_free(&game);
+    return exit_code;
+}
+
+int main(int argc, char **argv)
+{
+    int depth = SEARCH_DEFAULT_DEPTH;
+    int multi_pv = 1;
+    bool depth_given = false; // the bench has its own default
+    int table_mb = SEARCH_DEFAULT_TABLE_MB;
+    bool print_stats = false;
+    bool uci_mode = false;
+    bool batch_mode = false;
+    int pipeline_workers = 0;
+    int threads = 1;
+    bool bench_mode = false;
+    int bench_eval_positions = -1; // not asked for
+    struct search_pruning pruning = {true, true, true};
+    int mate_moves = 0;
+    enum report_format format = REPORT_TEXT;
+    bool timing = false;
+    const char *cache_path = NULL;
+    int cache_mb = 0;
+    bool trusted = false;
+    int arena_kb = ARENA_DEFAULT_GAME_KB;
+    struct eval_weights loaded_weights;
+    const struct eval_weights *weights = NULL; // the compiled-in ones unless --weights
+    struct tablebase tablebase;
+    tablebase_init(&tablebase);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+        {
+            depth = atoi(argv[++i]);
+            depth_given = true;
+        }
+        else if (strcmp(argv[i], "--multipv") == 0 && i + 1 < argc) // the best N moves with their scores, not just one
+        {
+            multi_pv = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc)
+        {
+            table_mb = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            print_stats = true;
+        }
+        else if (strcmp(argv[i], "--uci") == 0)
+        {
+            uci_mode = true;
+        }
+        else if (strcmp(argv[i], "--batch") == 0)
+        {
+            batch_mode = true;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bench") == 0)
+        {
+            bench_mode = true;
+        }
+        else if (strcmp(argv[i], "--bench-eval") == 0 && i + 1 < argc) // 0 for the default count
+        {
+            bench_eval_positions = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--no-null-move") == 0)
+        {
+            pruning.null_move = false;
+        }
+        else if (strcmp(argv[i], "--no-lmr") == 0)
+        {
+            pruning.late_move_reductions = false;
+        }
+        else if (strcmp(argv[i], "--no-futility") == 0)
+        {
+            pruning.futility = false;
+        }
+        else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc)
+        {
+            pipeline_workers = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc && report_parse_format(argv[i + 1], &format))
+        {
+            i++;
+        }
+        else if (strcmp(argv[i], "--timing") == 0)
+        {
+            timing = true;
+        }
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) // results kept on disk across runs
+        {
+            cache_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cache-mb") == 0 && i + 1 < argc)
+        {
+            cache_mb = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--trusted") == 0) // games from an archive that was validated before, replayed without the checks
+        {
+            trusted = true;
+        }
+        else if (strcmp(argv[i], "--arena-kb") == 0 && i + 1 < argc) // memory cap for one game's buffers in --batch and --pipeline
+        {
+            arena_kb = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--mate") == 0 && i + 1 < argc)
+        {
+            mate_moves = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--weights") == 0 && i + 1 < argc) // evaluation weights from chess-tune instead of the compiled-in ones
+        {
+            i++;
+            eval_default_weights(&loaded_weights);
+            enum chess_error error = eval_load_weights(argv[i], &loaded_weights);
+            if (error)
+            {
+                panicf("%s: %s\n", argv[i], chess_error_string(error));
+            }
+            weights = &loaded_weights;
+        }
+        else if (strcmp(argv[i], "--tablebase") == 0 && i + 1 < argc) // one table file each time, see chess-tbgen
+        {
+            i++;
+            enum chess_error error = tablebase_load(&tablebase, argv[i]);
+            if (error)
+            {
+                panicf("%s: %s\n", argv[i], chess_error_string(error));
+            }
+        }
+        else
+        {
+            panicf("usage: %s [--depth N] [--multipv N] [--hash MB] [--threads N] [--stats] [--bench] [--bench-eval N] [--no-null-move] [--no-lmr] [--no-futility] [--uci] [--batch] [--pipeline N] [--format text|jsonl|csv] [--timing] [--cache FILE] [--cache-mb MB] [--trusted] [--arena-kb KB] [--mate N] [--weights FILE] [--tablebase FILE]...\n", argv[0]);
+        }
+    }
+
+    if (table_mb < 1)
+    {
+        table_mb = 1;
+    }
+    if (multi_pv < 1)
+    {
+        multi_pv = 1;
+    }
+    if (multi_pv > CHESS_MAX_LINES)
+    {
+        multi_pv = CHESS_MAX_LINES;
+    }
+    // every mode falls through to the cleanup at the end, so the tables and cache are freed whichever ran
+    struct cache cache = {0};
+    int exit_code;
+    if (bench_eval_positions >= 0) // batch evaluation speed, and a check that every kernel agrees
+    {
+        exit_code = bench_eval_main(bench_eval_positions, weights);
+    }
+    else if (bench_mode) // fixed positions, for comparing search changes and the pruning switches
+    {
+        exit_code = bench_main(depth_given ? depth : BENCH_DEFAULT_DEPTH, table_mb, threads, &pruning, weights);
+    }
+    else if (uci_mode) // long running engine process, the game comes from UCI commands instead
+    {
+        exit_code = uci_main(table_mb, threads, &pruning, tablebase.count ? &tablebase : NULL, weights);
+    }
+    else
+    {
+        // a repeated position is answered from the cache instead of searched again. --cache-mb alone
+        // keeps it in memory for this run, --cache FILE (new files get --cache-mb, default 64) keeps it
+        struct cache *results = NULL;
+        if (cache_path != NULL)
+        {
+            enum chess_error error = cache_open(&cache, cache_path, (size_t)(cache_mb > 0 ? cache_mb : CACHE_DEFAULT_MB));
+            if (error)
+            {
+                panicf("%s: %s\n", cache_path, chess_error_string(error));
+            }
+            results = &cache;
+        }
+        else if (cache_mb > 0)
+        {
+            if (!cache_init(&cache, (size_t)cache_mb))
+            {
+                panicf("out of memory\n");
+            }
+            results = &cache;
+        }
+
+        // the mate puzzle prints plain text and writes no records, so it shouldn't get a CSV header
+        struct report_writer report;
+        if (!report_init(&report, stdout, mate_moves > 0 ? REPORT_TEXT : format, timing, multi_pv > 1))
+        {
+            panicf("out of memory\n");
+        }
+        if (pipeline_workers > 0) // batch input streamed through reader, parser, N analyser and writer threads
+        {
+            exit_code = pipeline_main(stdin, &report, pipeline_workers, depth, multi_pv, trusted, table_mb, arena_kb, &pruning, tablebase.count ? &tablebase : NULL, weights, results, print_stats);
+        }
+        else if (batch_mode) // many games separated by blank lines, shared openings are only played through once
+        {
+            exit_code = batch_main(stdin, &report, depth, multi_pv, trusted, table_mb, arena_kb, threads, &pruning, tablebase.count ? &tablebase : NULL, weights, results, print_stats);
+        }
+        else // one game, the default
+        {
+            exit_code = game_main(&report, format, trusted, mate_moves, depth, multi_pv, table_mb, threads, &pruning, tablebase.count ? &tablebase : NULL, weights, results, print_stats);
+        }
+        report_finish(&report); // a second call is harmless, game_main finishes it before it can panic
+        if (pipeline_workers > 0 || batch_mode) // game_main prints its own, next to the search stats
+        {
+            print_cache_stats(results, print_stats);
+        }
+    }
+
+    cache_free(&cache);
+    tablebase_free(&tablebase);
+    return exit_code;
 }
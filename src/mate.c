@@ -0,0 +1,236 @@
+#include "mate.h"
+#include "rules.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool mate_context_init(struct mate_context *context, size_t table_mb)
+{
+    size_t wanted = table_mb * 1024 * 1024 / sizeof(struct mate_entry);
+    size_t entries = 1;
+    while (entries * 2 <= wanted)
+    {
+        entries *= 2;
+    }
+
+    memset(context, 0, sizeof(*context));
+    context->table = calloc(entries, sizeof(struct mate_entry));
+    context->frames = malloc((2 * MATE_MAX_MOVES + 1) * sizeof(struct search_frame));
+    if (context->table == NULL || context->frames == NULL)
+    {
+        mate_context_free(context);
+        return false;
+    }
+    context->table_size = entries;
+    return true;
+}
+
+void mate_context_free(struct mate_context *context)
+{
+    free(context->table);
+    free(context->frames);
+    context->table = NULL;
+    context->frames = NULL;
+    context->table_size = 0;
+}
+
+// takes the highest scored move left and swaps it into place, like search_pick_move
+static void mate_pick_move(struct chess_move *moves, int *scores, int count, int index)
+{
+    int best = index;
+    for (int i = index + 1; i < count; i++)
+    {
+        if (scores[i] > scores[best])
+        {
+            best = i;
+        }
+    }
+    if (best != index)
+    {
+        struct chess_move move = moves[index];
+        moves[index] = moves[best];
+        moves[best] = move;
+        int score = scores[index];
+        scores[index] = scores[best];
+        scores[best] = score;
+    }
+}
+
+static bool mate_attack(struct mate_context *context, const struct chess_board *board, int moves_left, int ply, struct chess_move *mating_move);
+
+// the defender is in check from the attacker's last move; can it survive with the attacker
+// only allowed moves_left more moves? returns true if every reply still gets mated
+static bool mate_defend(struct mate_context *context, const struct chess_board *board, int moves_left, int ply)
+{
+    context->stats.nodes++;
+
+    struct search_frame *frame = &context->frames[ply];
+    int move_count = rules_generate_legal_moves(board, frame->moves);
+    if (move_count == 0)
+    {
+        return board_in_check(board); // mated (always in check here, the attacker only plays checks)
+    }
+    if (moves_left <= 0)
+    {
+        return false;
+    }
+
+    // captures and king moves are the likeliest refutations, so try them first
+    for (int i = 0; i < move_count; i++)
+    {
+        frame->scores[i] = frame->moves[i].is_capture ? 2 : (frame->moves[i].piece_type == PIECE_KING) ? 1 : 0;
+    }
+
+    for (int i = 0; i < move_count; i++)
+    {
+        mate_pick_move(frame->moves, frame->scores, move_count, i);
+        frame->child = *board;
+        board_apply_move(&frame->child, &frame->moves[i]);
+        if (!mate_attack(context, &frame->child, moves_left, ply + 1, NULL))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// can the player to move force mate in moves_left moves or fewer, checking on every move?
+static bool mate_attack(struct mate_context *context, const struct chess_board *board, int moves_left, int ply, struct chess_move *mating_move)
+{
+    context->stats.nodes++;
+    if (moves_left <= 0)
+    {
+        return false;
+    }
+
+    struct mate_entry *entry = &context->table[board->hash & (context->table_size - 1)];
+    if (entry->key == board->hash && entry->depth >= moves_left)
+    {
+        context->stats.table_hits++;
+        return false;
+    }
+
+    struct search_frame *frame = &context->frames[ply];
+    struct chess_move *moves = frame->moves;
+    int move_count = rules_generate_legal_moves(board, moves);
+
+    // keep only the checks, and try first the ones that leave the defender the fewest replies.
+    // the next ply's move list isn't in use yet, so it holds the replies while counting
+    struct chess_move *replies = context->frames[ply + 1].moves;
+    int check_count = 0;
+    for (int i = 0; i < move_count; i++)
+    {
+        frame->child = *board;
+        board_apply_move(&frame->child, &moves[i]);
+        if (!board_in_check(&frame->child))
+        {
+            continue;
+        }
+
+        int reply_count = rules_generate_legal_moves(&frame->child, replies);
+        if (reply_count == 0) // mate on the spot
+        {
+            if (mating_move != NULL)
+            {
+                *mating_move = moves[i];
+            }
+            return true;
+        }
+        moves[check_count] = moves[i];
+        frame->scores[check_count] = -reply_count;
+        check_count++;
+    }
+
+    for (int i = 0; i < check_count && moves_left > 1; i++)
+    {
+        mate_pick_move(moves, frame->scores, check_count, i);
+        context->stats.checks++;
+
+        frame->child = *board;
+        board_apply_move(&frame->child, &moves[i]);
+        if (mate_defend(context, &frame->child, moves_left - 1, ply + 1))
+        {
+            if (mating_move != NULL)
+            {
+                *mating_move = moves[i];
+            }
+            return true;
+        }
+    }
+
+    // proving a position can't be mated is the expensive part, so remember it
+    if (entry->key != board->hash || entry->depth < moves_left)
+    {
+        entry->key = board->hash;
+        entry->depth = (int8_t)moves_left;
+    }
+    return false;
+}
+
+// the fewest moves (up to moves_left) the attacker needs to mate from board, 0 if it can't
+static int mate_distance(struct mate_context *context, const struct chess_board *board, int moves_left, struct chess_move *mating_move)
+{
+    for (int moves = 1; moves <= moves_left; moves++)
+    {
+        if (mate_attack(context, board, moves, 0, mating_move))
+        {
+            return moves;
+        }
+    }
+    return 0;
+}
+
+bool mate_search(struct mate_context *context, const struct chess_board *board, int moves, struct chess_move *line, int *length)
+{
+    memset(&context->stats, 0, sizeof(context->stats));
+    *length = 0;
+    if (moves > MATE_MAX_MOVES)
+    {
+        moves = MATE_MAX_MOVES;
+    }
+
+    struct chess_move mating_move;
+    int distance = mate_distance(context, board, moves, &mating_move);
+    if (distance == 0)
+    {
+        return false;
+    }
+
+    // walk the line: the attacker's quickest mate, the defender's slowest loss
+    struct chess_board position = *board;
+    struct chess_move replies[RULES_MAX_MOVES];
+    while (true)
+    {
+        line[(*length)++] = mating_move;
+        board_apply_move(&position, &mating_move);
+
+        int reply_count = rules_generate_legal_moves(&position, replies);
+        if (reply_count == 0)
+        {
+            break;
+        }
+
+        int longest = 0;
+        struct chess_move longest_reply = replies[0];
+        struct chess_move longest_answer = replies[0];
+        for (int i = 0; i < reply_count; i++)
+        {
+            struct chess_board after = position;
+            board_apply_move(&after, &replies[i]);
+            struct chess_move answer;
+            int reply_distance = mate_distance(context, &after, distance - 1, &answer);
+            if (reply_distance > longest)
+            {
+                longest = reply_distance;
+                longest_reply = replies[i];
+                longest_answer = answer;
+            }
+        }
+
+        line[(*length)++] = longest_reply;
+        board_apply_move(&position, &longest_reply);
+        mating_move = longest_answer;
+        distance = longest;
+    }
+
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef APSC143__MATE_H
+#define APSC143__MATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "board.h"
+#include "search.h"
+
+// longest mate mate_search will look for, in moves of the attacking side
+#define MATE_MAX_MOVES 16
+
+// one remembered failure: the attacker to move here has no mate in depth moves or fewer
+struct mate_entry
+{
+    uint64_t key;
+    int8_t depth;
+};
+
+struct mate_stats
+{
+    unsigned long long nodes;  // positions visited
+    unsigned long long checks; // checking moves the attacker tried
+    unsigned long long table_hits;
+};
+
+// Scratch space for a mate search, reusable across searches like a search_context.
+struct mate_context
+{
+    struct mate_entry *table;
+    size_t table_size; // power of two
+    struct search_frame *frames; // 2 * MATE_MAX_MOVES + 1 of them, indexed by ply
+    struct mate_stats stats;
+};
+
+bool mate_context_init(struct mate_context *context, size_t table_mb);
+void mate_context_free(struct mate_context *context);
+
+// Looks for a forced mate in at most moves moves for the player to move. This
+// is an AND/OR search rather than a general one: the attacker only ever tries
+// moves that give check, the defender tries every legal reply, and there's no
+// evaluation at all, so it stays cheap at depths where a full search wouldn't.
+// Shorter mates are tried first. On success the mating line (attacker's moves
+// and the defender's longest resistance, ending in mate) goes into line, which
+// needs 2 * MATE_MAX_MOVES entries, and its length into *length. Returns false
+// if there is no such mate.
+bool mate_search(struct mate_context *context, const struct chess_board *board, int moves, struct chess_move *line, int *length);
+
+#endif
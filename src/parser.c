@@ -1,14 +1,20 @@
 #include "parser.h"
-#include "panic.h"
+#include "rules.h"
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 
 bool parse_move(struct chess_move *move)
 {
-    char current_char; // current character being read from input
+    return parse_move_from(stdin, move);
+}
+
+bool parse_move_from(FILE *input, struct chess_move *move)
+{
+    int current_char; // current character being read from input (int so EOF can't be confused with a real character)
     do
     {
-        current_char = getc(stdin); // read the next character from stdin
+        current_char = getc(input); // read the next character from the input
         if (current_char == EOF) // check if we hit a end of file
         {
             return false; // lets just return false to prevent infinite loops
@@ -20,30 +26,51 @@ bool parse_move(struct chess_move *move)
         return false; // return false
     }
 
-    char input_buffer[32]; // define an input buffer to hold the entire move string
-    int input_length = 0; // we need to keep track of the length of the input
+    char line[32]; // holds the rest of the move string
+    int line_length = 0;
 
-    input_buffer[input_length++] = current_char; // store the character in the input buffer and increment the length
+    line[line_length++] = (char)current_char;
 
     // read the rest of the input line
     while (true) //changed from while (1) because we can use stdbool.h
     {
-        current_char = getc(stdin); // read the next character from stdin
+        current_char = getc(input); // read the next character from the input
         if (current_char == EOF || current_char == '\n' || current_char == '\r') // if we hit end of file or a new line or a carriage return
         {
             break;
         }
-        if (current_char == ' ') // we need to ignore spaces
+        if (line_length < (int)(sizeof(line) - 1)) // check to see if our buffer is full
+        {
+            line[line_length++] = (char)current_char;
+        }
+    }
+
+    line[line_length] = '\0';
+    return parse_move_text(line, move);
+}
+
+bool parse_move_text(const char *text, struct chess_move *move)
+{
+    char input_buffer[32]; // define an input buffer to hold the entire move string
+    int input_length = 0; // we need to keep track of the length of the input
+
+    for (int j = 0; text[j] != '\0'; j++)
+    {
+        if (text[j] == ' ') // we need to ignore spaces
         {
             continue;
         }
         if (input_length < (int)(sizeof(input_buffer) - 1)) // check to see if our input buffer is full
         {
-            input_buffer[input_length++] = current_char; // store the character in the input buffer and increment the length
+            input_buffer[input_length++] = text[j]; // store the character in the input buffer and increment the length
         }
     }
 
     input_buffer[input_length] = '\0'; // IMPORTANT******** we need to null terminate the string
+    if (input_length == 0)
+    {
+        return false;
+    }
 
     // we declare the move struct values here because we don't want to have garbage values
     move->is_castle = false;
@@ -240,3 +267,141 @@ bool parse_move(struct chess_move *move)
 
     return true;
 }
+
+
+void format_move_coordinate(const struct chess_move *move, char *text)
+{
+    static const char promotion_letters[] = "pnbrqk";
+    int length = 0;
+
+    text[length++] = (char)('a' + move->from_col);
+    text[length++] = (char)('1' + (8 - move->from_row - 1));
+    text[length++] = (char)('a' + move->to_col);
+    text[length++] = (char)('1' + (8 - move->to_row - 1));
+    if (move->is_promotion)
+    {
+        text[length++] = promotion_letters[move->promo_piece];
+    }
+    text[length] = '\0';
+}
+
+void format_move_san(const struct chess_board *board, const struct chess_move *move, char *text)
+{
+    static const char piece_letters[] = "PNBRQK";
+    int length = 0;
+
+    if (move->is_castle)
+    {
+        strcpy(text, move->castle_kingside ? "O-O" : "O-O-O");
+        length = (int)strlen(text);
+    }
+    else
+    {
+        if (move->piece_type != PIECE_PAWN)
+        {
+            text[length++] = piece_letters[move->piece_type];
+
+            // does another piece of the same kind go to the same square? then say which one moved
+            struct chess_move moves[RULES_MAX_MOVES];
+            int move_count = rules_generate_legal_moves(board, moves);
+            bool ambiguous = false, same_file = false, same_rank = false;
+            for (int i = 0; i < move_count; i++)
+            {
+                const struct chess_move *other = &moves[i];
+                if (other->piece_type != move->piece_type || other->to_row != move->to_row || other->to_col != move->to_col || (other->from_row == move->from_row && other->from_col == move->from_col))
+                {
+                    continue;
+                }
+                ambiguous = true;
+                same_file |= (other->from_col == move->from_col);
+                same_rank |= (other->from_row == move->from_row);
+            }
+            if (ambiguous && (!same_file || same_rank))
+            {
+                text[length++] = (char)('a' + move->from_col);
+            }
+            if (ambiguous && same_file)
+            {
+                text[length++] = (char)('1' + (8 - move->from_row - 1));
+            }
+        }
+        else if (move->is_capture) // pawn captures are named by the file they come from
+        {
+            text[length++] = (char)('a' + move->from_col);
+        }
+
+        if (move->is_capture)
+        {
+            text[length++] = 'x';
+        }
+        text[length++] = (char)('a' + move->to_col);
+        text[length++] = (char)('1' + (8 - move->to_row - 1));
+        if (move->is_promotion)
+        {
+            text[length++] = '=';
+            text[length++] = piece_letters[move->promo_piece];
+        }
+    }
+
+    struct chess_board after = *board;
+    board_apply_move(&after, move);
+    if (board_in_check(&after))
+    {
+        text[length++] = board_in_checkmate(&after) ? '#' : '+';
+    }
+    text[length] = '\0';
+}
+
+bool parse_move_coordinate(const struct chess_board *board, const char *text, struct chess_move *move)
+{
+    if (text[0] < 'a' || text[0] > 'h' || text[1] < '1' || text[1] > '8' || text[2] < 'a' || text[2] > 'h' || text[3] < '1' || text[3] > '8')
+    {
+        return false;
+    }
+
+    int from_col = text[0] - 'a';
+    int from_row = 8 - (text[1] - '0');
+    int to_col = text[2] - 'a';
+    int to_row = 8 - (text[3] - '0');
+
+    enum chess_piece promotion = PIECE_QUEEN;
+    bool has_promotion = true;
+    switch (text[4])
+    {
+    case 'q':
+        promotion = PIECE_QUEEN;
+        break;
+    case 'r':
+        promotion = PIECE_ROOK;
+        break;
+    case 'b':
+        promotion = PIECE_BISHOP;
+        break;
+    case 'n':
+        promotion = PIECE_KNIGHT;
+        break;
+    default:
+        has_promotion = false;
+        break;
+    }
+
+    // coordinates alone don't say if it's a capture or castling, so find the legal move they describe
+    struct chess_move moves[RULES_MAX_MOVES];
+    int move_count = rules_generate_legal_moves(board, moves);
+    for (int i = 0; i < move_count; i++)
+    {
+        const struct chess_move *candidate = &moves[i];
+        if (candidate->from_row != from_row || candidate->from_col != from_col || candidate->to_row != to_row || candidate->to_col != to_col)
+        {
+            continue;
+        }
+        if (candidate->is_promotion && candidate->promo_piece != (has_promotion ? promotion : PIECE_QUEEN))
+        {
+            continue;
+        }
+        *move = *candidate;
+        return true;
+    }
+
+    return false;
+}
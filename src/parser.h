@@ -1,6 +1,7 @@
 #ifndef APSC143__PARSER_H
 #define APSC143__PARSER_H
 
+#include <stdio.h>
 #include <stdbool.h>
 #include "board.h"
 
@@ -10,4 +11,27 @@
 // unspecified.
 bool parse_move(struct chess_move *move);
 
+// Same as parse_move but reads the line from any stream.
+bool parse_move_from(FILE *input, struct chess_move *move);
+
+// Parses a single move in algebraic notation from a string (spaces are
+// ignored). Returns false on a syntax error. Keeps no state between calls, so
+// it is safe to use from several threads at once.
+bool parse_move_text(const char *text, struct chess_move *move);
+
+// Writes a move in coordinate notation ("e2e4", "e7e8q"), as used by UCI.
+// text needs room for 6 characters.
+void format_move_coordinate(const struct chess_move *move, char *text);
+
+// Writes a complete legal move in standard algebraic notation ("Nbd7",
+// "exd5", "e8=Q+", "O-O-O#"), as played in board: the source file or rank is
+// only given when another piece of the same type could reach the same square,
+// and a check or mate gets its suffix. text needs room for 10 characters.
+void format_move_san(const struct chess_board *board, const struct chess_move *move, char *text);
+
+// Parses a coordinate notation move and matches it against the legal moves in
+// board, so the result is complete. A missing promotion letter means queen.
+// Returns false if it is malformed or not legal.
+bool parse_move_coordinate(const struct chess_board *board, const char *text, struct chess_move *move);
+
 #endif
@@ -0,0 +1,147 @@
+#include "pawns.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PAWNS_FILE_A 0x0101010101010101ull
+
+// bonus for a passed pawn by how far it has come, 0 for its own first rank to 7 for the last
+static const int passed_mg[BOARD_SIZE] = {0, 2, 5, 10, 20, 35, 60, 0};
+static const int passed_eg[BOARD_SIZE] = {0, 5, 10, 20, 35, 60, 90, 0};
+// each pawn on a file past the first, and each pawn with no friendly pawn on either file next to it
+#define PAWNS_DOUBLED_MG (-10)
+#define PAWNS_DOUBLED_EG (-20)
+#define PAWNS_ISOLATED_MG (-10)
+#define PAWNS_ISOLATED_EG (-15)
+// each pawn on the three files around a king on its home rank, one and two ranks in front of it.
+// the middlegame only: in the endgame the king should come out anyway
+#define PAWNS_SHIELD_NEAR 10
+#define PAWNS_SHIELD_FAR 5
+
+bool pawns_cache_init(struct pawns_cache *cache, size_t entries)
+{
+    size_t size = 1;
+    while (size * 2 <= entries) // round down to a power of two so indexing is a mask
+    {
+        size *= 2;
+    }
+    // zeroed entries have key 0, which is also the hash of no pawns at all, whose terms are all 0
+    cache->entries = calloc(size, sizeof(struct pawns_entry));
+    cache->size = cache->entries != NULL ? size : 0;
+    return cache->entries != NULL;
+}
+
+void pawns_cache_free(struct pawns_cache *cache)
+{
+    free(cache->entries);
+    cache->entries = NULL;
+    cache->size = 0;
+}
+
+void pawns_cache_clear(struct pawns_cache *cache)
+{
+    memset(cache->entries, 0, cache->size * sizeof(struct pawns_entry));
+}
+
+// the file col and the ones either side of it
+static uint64_t pawns_adjacent_files(int col)
+{
+    uint64_t files = PAWNS_FILE_A << col;
+    if (col > 0)
+    {
+        files |= PAWNS_FILE_A << (col - 1);
+    }
+    if (col < BOARD_SIZE - 1)
+    {
+        files |= PAWNS_FILE_A << (col + 1);
+    }
+    return files;
+}
+
+// every square on the rows ahead of row from player's point of view (white moves towards row 0)
+static uint64_t pawns_rows_ahead(enum chess_player player, int row)
+{
+    if (player == PLAYER_WHITE)
+    {
+        return ((uint64_t)1 << (row * BOARD_SIZE)) - 1;
+    }
+    return row >= BOARD_SIZE - 1 ? 0 : ~(((uint64_t)1 << ((row + 1) * BOARD_SIZE)) - 1);
+}
+
+void pawns_evaluate(const struct chess_board *board, struct pawns_entry *entry)
+{
+    int mg = 0, eg = 0;
+    memset(entry, 0, sizeof(*entry));
+    entry->key = board->pawn_hash;
+
+    for (int player = PLAYER_WHITE; player <= PLAYER_BLACK; player++)
+    {
+        uint64_t own = board->pieces[player][PIECE_PAWN];
+        uint64_t enemy = board->pieces[1 - player][PIECE_PAWN];
+        int side = player == PLAYER_WHITE ? 1 : -1;
+
+        for (int col = 0; col < BOARD_SIZE; col++)
+        {
+            int on_file = board_count_squares(own & (PAWNS_FILE_A << col));
+            if (on_file > 1)
+            {
+                mg += side * (on_file - 1) * PAWNS_DOUBLED_MG;
+                eg += side * (on_file - 1) * PAWNS_DOUBLED_EG;
+            }
+            if (on_file > 0 && (own & pawns_adjacent_files(col) & ~(PAWNS_FILE_A << col)) == 0)
+            {
+                mg += side * on_file * PAWNS_ISOLATED_MG;
+                eg += side * on_file * PAWNS_ISOLATED_EG;
+            }
+        }
+
+        for (uint64_t remaining = own; remaining; remaining &= remaining - 1)
+        {
+            int square_index = board_lowest_square(remaining);
+            int row = square_index / BOARD_SIZE, col = square_index % BOARD_SIZE;
+            // nothing of the other side's that can block or take it on the way
+            if ((enemy & pawns_adjacent_files(col) & pawns_rows_ahead((enum chess_player)player, row)) == 0)
+            {
+                int advanced = player == PLAYER_WHITE ? BOARD_SIZE - 1 - row : row;
+                mg += side * passed_mg[advanced];
+                eg += side * passed_eg[advanced];
+            }
+        }
+
+        // the shield for a king on each square of the home rank, picked out in pawns_probe
+        int home_row = player == PLAYER_WHITE ? BOARD_SIZE - 1 : 0;
+        int forward = player == PLAYER_WHITE ? -1 : 1;
+        for (int col = 0; col < BOARD_SIZE; col++)
+        {
+            uint64_t files = pawns_adjacent_files(col);
+            uint64_t near_row = (uint64_t)0xFF << ((home_row + forward) * BOARD_SIZE);
+            uint64_t far_row = (uint64_t)0xFF << ((home_row + 2 * forward) * BOARD_SIZE);
+            int shield = PAWNS_SHIELD_NEAR * board_count_squares(own & files & near_row) + PAWNS_SHIELD_FAR * board_count_squares(own & files & far_row);
+            entry->shield[player][col] = (int8_t)(side * shield);
+        }
+    }
+
+    entry->mg = (int16_t)mg;
+    entry->eg = (int16_t)eg;
+}
+
+bool pawns_probe(struct pawns_cache *cache, const struct chess_board *board, int *mg, int *eg)
+{
+    struct pawns_entry *entry = &cache->entries[board->pawn_hash & (cache->size - 1)];
+    bool hit = entry->key == board->pawn_hash;
+    if (!hit)
+    {
+        pawns_evaluate(board, entry);
+    }
+
+    *mg += entry->mg;
+    *eg += entry->eg;
+    for (int player = PLAYER_WHITE; player <= PLAYER_BLACK; player++)
+    {
+        int home_row = player == PLAYER_WHITE ? BOARD_SIZE - 1 : 0;
+        if (board->king_row[player] == home_row)
+        {
+            *mg += entry->shield[player][board->king_col[player]];
+        }
+    }
+    return hit;
+}
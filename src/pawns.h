@@ -0,0 +1,47 @@
+#ifndef APSC143__PAWNS_H
+#define APSC143__PAWNS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "board.h"
+
+// entries in each search context's pawn cache, 32 bytes each
+#define PAWNS_CACHE_ENTRIES 8192
+
+// What the pawns alone are worth, white minus black: passed, doubled and
+// isolated pawns, plus how well the pawns in front of each king's home rank
+// shield it. key is the board's pawn_hash.
+struct pawns_entry
+{
+    uint64_t key;
+    int16_t mg, eg;
+    // [player][col]: the shield bonus for that player's king on its home rank on col
+    int8_t shield[2][BOARD_SIZE];
+};
+
+// Pawn structure terms keyed by board->pawn_hash. The pawns change on only a
+// few moves of a search tree, so nearly every evaluation finds its skeleton
+// here and the terms are worked out once per skeleton instead of once per
+// node. One per search context (so per thread), which keeps it free of locks;
+// an entry is just overwritten by the next skeleton that wants its slot.
+struct pawns_cache
+{
+    struct pawns_entry *entries;
+    size_t size; // number of entries, always a power of two
+};
+
+// Room for entries entries (rounded down to a power of two). Returns false if
+// the memory isn't available.
+bool pawns_cache_init(struct pawns_cache *cache, size_t entries);
+void pawns_cache_free(struct pawns_cache *cache);
+void pawns_cache_clear(struct pawns_cache *cache);
+
+// Works out board's pawn structure terms from scratch.
+void pawns_evaluate(const struct chess_board *board, struct pawns_entry *entry);
+// Adds board's pawn structure terms, with the king shields for where the
+// kings actually are, to *mg and *eg (white minus black, like the board's
+// totals), from the cache if they're there. Returns whether they were.
+bool pawns_probe(struct pawns_cache *cache, const struct chess_board *board, int *mg, int *eg);
+
+#endif
@@ -0,0 +1,553 @@
+#include "pipeline.h"
+#include "board.h"
+#include "parser.h"
+#include "search.h"
+#include "panic.h"
+#include "ring.h"
+#include "report.h"
+#include "history.h"
+#include "arena.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PIPELINE_BLOCK_SIZE (1 << 20)  // bytes per read from the input
+#define PIPELINE_RING_SIZE 256         // games each ring holds
+#define PIPELINE_LINE_MAX 256          // same limit as the batch reader, longer lines are cut here
+#define PIPELINE_MOVE_TEXT 32          // parse_move_text never looks past 31 characters
+#define PIPELINE_WINDOW 1024           // most games the reader may get ahead of the writer
+
+// one game on its way through. each stage fills in its part and passes the pointer on. there are
+// PIPELINE_WINDOW of these, game n goes in slot n % PIPELINE_WINDOW once game n - PIPELINE_WINDOW
+// is written, so they're made once and used over and over
+struct pipeline_game
+{
+    size_t index; // position in the input, the writer puts them back in this order
+
+    // the text and the moves. only the stage holding the game touches it, and it's reset when the
+    // slot takes its next game, so after the first few games nothing here calls malloc
+    struct arena arena;
+
+    // from the reader: the game's lines, each ending in '\n', blank lines already gone
+    char *text;
+    size_t length, capacity;
+
+    // from a parser: the moves, not yet completed
+    struct chess_move *moves;
+    int move_count;
+
+    // from an analyser (or the reader or a parser, if the game didn't fit in its arena)
+    enum chess_error error; // completing or applying a move failed, there is no summary
+    struct chess_move failed_move;
+    enum chess_error analysis_error;
+    struct chess_summary summary;
+    char san[CHESS_MAX_LINES][10]; // the suggestion and the lines, for the structured formats
+    unsigned long long analysis_ns;
+};
+
+// what one stage got through, over all of its threads
+struct pipeline_stage
+{
+    const char *name;
+    atomic_ullong items;
+    atomic_ullong busy_ns; // time spent working rather than waiting on a ring
+};
+
+struct pipeline
+{
+    FILE *input;
+    struct report_writer *report;
+    int depth;
+    int multi_pv;
+    bool trusted; // replay with the trusted board calls, the archive is known to be clean
+    size_t table_mb;
+    struct search_pruning pruning;
+    const struct tablebase *tablebase;
+    const struct eval_weights *weights;
+    struct cache *cache; // shared by every analyser
+    struct pipeline_game *slots; // PIPELINE_WINDOW of them
+
+    struct ring read_ring;    // reader -> parsers
+    struct ring parse_ring;   // parsers -> analysers
+    struct ring analyse_ring; // analysers -> writer
+
+    struct pipeline_stage reader, parser, analyser, writer;
+    atomic_ullong bytes, moves;
+
+    // games written so far. the reader never starts a game PIPELINE_WINDOW or more past this, which
+    // bounds how far out of order the writer can receive them however slow one game is to analyse
+    atomic_size_t written;
+    atomic_ullong window_waits;
+};
+
+static void pipeline_stage_add(struct pipeline_stage *stage, unsigned long long items, unsigned long long busy_ns)
+{
+    atomic_fetch_add(&stage->items, items);
+    atomic_fetch_add(&stage->busy_ns, busy_ns);
+}
+
+static struct pipeline_game *pipeline_new_game(struct pipeline *pipeline, size_t index)
+{
+    while (index - atomic_load(&pipeline->written) >= PIPELINE_WINDOW)
+    {
+        atomic_fetch_add_explicit(&pipeline->window_waits, 1, memory_order_relaxed);
+        sched_yield();
+    }
+
+    // the writer is done with the slot's last game, everything but the arena starts over
+    struct pipeline_game *game = &pipeline->slots[index % PIPELINE_WINDOW];
+    struct arena arena = game->arena;
+    memset(game, 0, sizeof(*game));
+    game->arena = arena;
+    arena_reset(&game->arena);
+    game->index = index;
+    return game;
+}
+
+// a game too long for its arena is dropped here and reported as out of memory
+static void pipeline_append(struct pipeline_game *game, const char *text, size_t length)
+{
+    if (game->error)
+    {
+        return;
+    }
+    if (game->length + length > game->capacity)
+    {
+        size_t capacity = game->capacity ? game->capacity : 256;
+        while (capacity < game->length + length)
+        {
+            capacity *= 2;
+        }
+        char *grown = game->text == NULL ? arena_alloc(&game->arena, capacity) : arena_grow(&game->arena, game->text, game->capacity, capacity);
+        if (grown == NULL)
+        {
+            game->error = CHESS_ERROR_OUT_OF_MEMORY;
+            return;
+        }
+        game->text = grown;
+        game->capacity = capacity;
+    }
+    memcpy(game->text + game->length, text, length);
+    game->length += length;
+}
+
+// cuts the input into games. only the line boundaries are looked at here, the moves are left to the parsers
+static void *pipeline_reader(void *argument)
+{
+    struct pipeline *pipeline = argument;
+    char *block = malloc(PIPELINE_BLOCK_SIZE);
+    if (block == NULL)
+    {
+        panicf("out of memory\n");
+    }
+
+    char line[PIPELINE_LINE_MAX];
+    int line_length = 0;
+    bool line_blank = true;   // nothing but spaces so far (anything after a '\r' doesn't count)
+    bool line_ended = false;  // saw the '\r', the rest of the line is ignored
+    size_t game_count = 0;
+    struct pipeline_game *game = NULL;
+    unsigned long long busy_ns = 0;
+    unsigned long long bytes = 0;
+
+    while (true)
+    {
+        unsigned long long start = search_now_ns();
+        size_t size = fread(block, 1, PIPELINE_BLOCK_SIZE, pipeline->input);
+        bool at_end = size < PIPELINE_BLOCK_SIZE;
+        bytes += size;
+
+        for (size_t i = 0; i <= size; i++)
+        {
+            // the end of the input finishes the last line as if it had a newline
+            bool end_of_line = i == size ? at_end && line_length > 0 : block[i] == '\n';
+            if (i == size && !end_of_line)
+            {
+                break;
+            }
+            if (!end_of_line)
+            {
+                char current_char = block[i];
+                if (line_length < PIPELINE_LINE_MAX - 1)
+                {
+                    line[line_length++] = current_char;
+                    if (current_char == '\r')
+                    {
+                        line_ended = true;
+                    }
+                    else if (!line_ended && current_char != ' ' && current_char != '\t')
+                    {
+                        line_blank = false;
+                    }
+                }
+                continue;
+            }
+
+            if (!line_blank)
+            {
+                if (game == NULL)
+                {
+                    busy_ns += search_now_ns() - start;
+                    game = pipeline_new_game(pipeline, game_count++);
+                    start = search_now_ns();
+                }
+                pipeline_append(game, line, (size_t)line_length);
+                pipeline_append(game, "\n", 1);
+            }
+            else if (game != NULL) // blank line, the game is over
+            {
+                busy_ns += search_now_ns() - start;
+                ring_push(&pipeline->read_ring, game);
+                start = search_now_ns();
+                game = NULL;
+            }
+            line_length = 0;
+            line_blank = true;
+            line_ended = false;
+        }
+        busy_ns += search_now_ns() - start;
+
+        if (at_end)
+        {
+            break;
+        }
+    }
+
+    if (game != NULL)
+    {
+        ring_push(&pipeline->read_ring, game);
+    }
+    ring_close(&pipeline->read_ring);
+
+    free(block);
+    atomic_fetch_add(&pipeline->bytes, bytes);
+    pipeline_stage_add(&pipeline->reader, game_count, busy_ns);
+    return NULL;
+}
+
+// parses one game's lines. like the other readers, a move that doesn't parse ends the game there
+static void pipeline_parse_game(struct pipeline_game *game)
+{
+    if (game->error)
+    {
+        return;
+    }
+    int line_count = 0;
+    for (size_t i = 0; i < game->length; i++)
+    {
+        line_count += game->text[i] == '\n';
+    }
+    game->moves = arena_alloc(&game->arena, (size_t)line_count * sizeof(struct chess_move));
+    if (game->moves == NULL)
+    {
+        game->error = CHESS_ERROR_OUT_OF_MEMORY;
+        return;
+    }
+
+    const char *cursor = game->text;
+    const char *end = game->text + game->length;
+    while (cursor < end)
+    {
+        char text[PIPELINE_MOVE_TEXT];
+        int length = 0;
+        const char *line_end = memchr(cursor, '\n', (size_t)(end - cursor));
+        for (const char *c = cursor; c < line_end && *c != '\r'; c++)
+        {
+            if (*c != ' ' && *c != '\t' && length < PIPELINE_MOVE_TEXT - 1)
+            {
+                text[length++] = *c;
+            }
+        }
+        text[length] = '\0';
+        cursor = line_end + 1;
+
+        if (!parse_move_text(text, &game->moves[game->move_count]))
+        {
+            break;
+        }
+        game->move_count++;
+    }
+}
+
+static void *pipeline_parser(void *argument)
+{
+    struct pipeline *pipeline = argument;
+    unsigned long long games = 0, moves = 0, busy_ns = 0;
+
+    void *item;
+    while (ring_pop(&pipeline->read_ring, &item))
+    {
+        unsigned long long start = search_now_ns();
+        struct pipeline_game *game = item;
+        pipeline_parse_game(game);
+        games++;
+        moves += (unsigned long long)game->move_count;
+        busy_ns += search_now_ns() - start;
+        ring_push(&pipeline->parse_ring, game);
+    }
+    ring_close(&pipeline->parse_ring);
+
+    atomic_fetch_add(&pipeline->moves, moves);
+    pipeline_stage_add(&pipeline->parser, games, busy_ns);
+    return NULL;
+}
+
+static void *pipeline_analyser(void *argument)
+{
+    struct pipeline *pipeline = argument;
+    unsigned long long games = 0, busy_ns = 0;
+
+    // each analyser keeps its own table warm from one game to the next
+    struct search_context context;
+    struct history history; // the game being replayed, reset for each one
+    if (!search_context_init(&context, pipeline->table_mb) || !history_init(&history, HISTORY_GAME_PLIES))
+    {
+        panicf("out of memory\n");
+    }
+    context.tablebase = pipeline->tablebase;
+    search_context_set_weights(&context, pipeline->weights);
+    context.cache = pipeline->cache;
+    context.multi_pv = pipeline->multi_pv;
+    context.pruning = pipeline->pruning;
+    context.game = &history;
+
+    void *item;
+    while (ring_pop(&pipeline->parse_ring, &item))
+    {
+        unsigned long long start = search_now_ns();
+        struct pipeline_game *game = item;
+
+        struct chess_board board;
+        board_initialize(&board);
+        history_reset(&history, &board);
+        for (int i = 0; i < game->move_count && !game->error; i++)
+        {
+            struct chess_move *move = &game->moves[i];
+            if (pipeline->trusted)
+            {
+                game->error = board_complete_move_trusted(&board, move);
+                if (!game->error)
+                {
+                    board_apply_move_trusted(&board, move);
+                }
+            }
+            else
+            {
+                game->error = board_complete_move(&board, move);
+                if (!game->error)
+                {
+                    game->error = board_apply_move(&board, move);
+                }
+            }
+            if (!game->error && !history_push(&history, &board, move))
+            {
+                game->error = CHESS_ERROR_OUT_OF_MEMORY;
+            }
+            if (game->error)
+            {
+                game->failed_move = *move;
+            }
+        }
+        if (!game->error)
+        {
+            if (pipeline->trusted)
+            {
+                board_update_attacks(&board);
+            }
+            game->analysis_error = board_analyze(&board, &context, pipeline->depth, &game->summary);
+            if (pipeline->report->format != REPORT_TEXT)
+            {
+                report_format_san(&board, &game->summary, game->san);
+            }
+        }
+
+        games++;
+        game->analysis_ns = search_now_ns() - start;
+        busy_ns += game->analysis_ns;
+        ring_push(&pipeline->analyse_ring, game);
+    }
+    ring_close(&pipeline->analyse_ring);
+
+    search_context_free(&context);
+    history_free(&history);
+    pipeline_stage_add(&pipeline->analyser, games, busy_ns);
+    return NULL;
+}
+
+static void pipeline_print_stage(const struct pipeline_stage *stage, int threads, double seconds)
+{
+    unsigned long long items = atomic_load(&stage->items);
+    double busy = (double)atomic_load(&stage->busy_ns) / 1e9;
+    fprintf(stderr, "%-8s threads %d games %llu busy %.3fs (%.0f%% of %d) %.0f games/s\n", stage->name, threads, items, busy,
+            seconds > 0 ? 100.0 * busy / (seconds * threads) : 0.0, threads, seconds > 0 ? (double)items / seconds : 0.0);
+}
+
+static void pipeline_print_ring(const char *name, struct ring *ring)
+{
+    unsigned long long pushes = atomic_load(&ring->pushes);
+    double mean = pushes ? (double)atomic_load(&ring->depth_total) / (double)pushes : 0.0;
+    fprintf(stderr, "%-16s capacity %zu depth max %zu mean %.1f full waits %llu empty waits %llu\n", name, ring_capacity(ring),
+            atomic_load(&ring->depth_max), mean, atomic_load(&ring->full_waits), atomic_load(&ring->empty_waits));
+}
+
+// takes the analysed games off the last ring and prints them in input order.
+// the reader stays within PIPELINE_WINDOW games of us, so that many slots hold every early arrival
+static int pipeline_write(struct pipeline *pipeline)
+{
+    struct pipeline_game **pending = calloc(PIPELINE_WINDOW, sizeof(*pending));
+    if (pending == NULL)
+    {
+        panicf("out of memory\n");
+    }
+
+    size_t next = 0;
+    unsigned long long busy_ns = 0;
+    enum chess_error analysis_error = CHESS_OK;
+    int exit_code = 0;
+
+    void *item;
+    while (ring_pop(&pipeline->analyse_ring, &item))
+    {
+        unsigned long long start = search_now_ns();
+        struct pipeline_game *game = item;
+        pending[game->index % PIPELINE_WINDOW] = game;
+
+        while ((game = pending[next % PIPELINE_WINDOW]) != NULL && game->index == next)
+        {
+            struct report_record record = {next + 1, game->error, game->failed_move, &game->summary, game->san, game->analysis_ns};
+            report_write(pipeline->report, &record);
+            if (game->error)
+            {
+                exit_code = 1;
+            }
+            if (game->analysis_error && !analysis_error)
+            {
+                analysis_error = game->analysis_error;
+            }
+            pending[next % PIPELINE_WINDOW] = NULL;
+            next++;
+        }
+        atomic_store(&pipeline->written, next);
+        busy_ns += search_now_ns() - start;
+    }
+    pipeline_stage_add(&pipeline->writer, next, busy_ns);
+
+    if (analysis_error)
+    {
+        fprintf(stderr, "move completion error: %s\n", chess_error_string(analysis_error));
+        exit_code = 1;
+    }
+    free(pending);
+    return exit_code;
+}
+
+// what the game slots' arenas came to
+static void pipeline_print_arenas(const struct pipeline *pipeline)
+{
+    size_t reserved = 0, high_water = 0;
+    unsigned long long failures = 0;
+    for (int i = 0; i < PIPELINE_WINDOW; i++)
+    {
+        const struct arena *arena = &pipeline->slots[i].arena;
+        reserved += arena->reserved;
+        high_water = arena->high_water > high_water ? arena->high_water : high_water;
+        failures += arena->failures;
+    }
+    fprintf(stderr, "game arenas %d reserved %zu KB, most one game used %zu bytes of %zu KB, too long %llu\n", PIPELINE_WINDOW, reserved / 1024, high_water,
+            pipeline->slots[0].arena.cap / 1024, failures);
+}
+
+int pipeline_main(FILE *input, struct report_writer *report, int workers, int depth, int multi_pv, bool trusted, int table_mb, int arena_kb, const struct search_pruning *pruning, const struct tablebase *tablebase, const struct eval_weights *weights, struct cache *cache, bool print_stats)
+{
+    if (workers < 1)
+    {
+        workers = 1;
+    }
+    int parsers = workers / 2 > 0 ? workers / 2 : 1; // parsing is far cheaper than searching
+
+    struct pipeline pipeline = {0};
+    pipeline.input = input;
+    pipeline.report = report;
+    pipeline.depth = depth;
+    pipeline.multi_pv = multi_pv;
+    pipeline.pruning = *pruning;
+    pipeline.trusted = trusted;
+    pipeline.table_mb = (size_t)(table_mb / workers > 0 ? table_mb / workers : 1);
+    pipeline.tablebase = tablebase;
+    pipeline.weights = weights;
+    pipeline.cache = cache;
+    pipeline.reader.name = "read";
+    pipeline.parser.name = "parse";
+    pipeline.analyser.name = "analyse";
+    pipeline.writer.name = "write";
+
+    if (!ring_init(&pipeline.read_ring, PIPELINE_RING_SIZE, 1) || !ring_init(&pipeline.parse_ring, PIPELINE_RING_SIZE, parsers) ||
+        !ring_init(&pipeline.analyse_ring, PIPELINE_RING_SIZE, workers))
+    {
+        panicf("out of memory\n");
+    }
+    pipeline.slots = calloc(PIPELINE_WINDOW, sizeof(struct pipeline_game));
+    if (pipeline.slots == NULL)
+    {
+        panicf("out of memory\n");
+    }
+    for (int i = 0; i < PIPELINE_WINDOW; i++)
+    {
+        arena_init(&pipeline.slots[i].arena, (size_t)(arena_kb > 0 ? arena_kb : 1) * 1024);
+    }
+
+    unsigned long long start = search_now_ns();
+    pthread_t *threads = malloc((size_t)(1 + parsers + workers) * sizeof(pthread_t));
+    if (threads == NULL)
+    {
+        panicf("out of memory\n");
+    }
+    int thread_count = 0;
+    bool started = pthread_create(&threads[thread_count++], NULL, pipeline_reader, &pipeline) == 0;
+    for (int i = 0; i < parsers && started; i++)
+    {
+        started = pthread_create(&threads[thread_count++], NULL, pipeline_parser, &pipeline) == 0;
+    }
+    for (int i = 0; i < workers && started; i++)
+    {
+        started = pthread_create(&threads[thread_count++], NULL, pipeline_analyser, &pipeline) == 0;
+    }
+    if (!started)
+    {
+        panicf("couldn't start the pipeline threads\n");
+    }
+
+    int exit_code = pipeline_write(&pipeline);
+    for (int i = 0; i < thread_count; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    double seconds = (double)(search_now_ns() - start) / 1e9;
+
+    if (print_stats)
+    {
+        fprintf(stderr, "games %llu moves %llu bytes %llu in %.3fs\n", atomic_load(&pipeline.writer.items), atomic_load(&pipeline.moves),
+                atomic_load(&pipeline.bytes), seconds);
+        pipeline_print_stage(&pipeline.reader, 1, seconds);
+        pipeline_print_stage(&pipeline.parser, parsers, seconds);
+        pipeline_print_stage(&pipeline.analyser, workers, seconds);
+        pipeline_print_stage(&pipeline.writer, 1, seconds);
+        pipeline_print_ring("read -> parse", &pipeline.read_ring);
+        pipeline_print_ring("parse -> analyse", &pipeline.parse_ring);
+        pipeline_print_ring("analyse -> write", &pipeline.analyse_ring);
+        fprintf(stderr, "reader waits for the writer %llu\n", atomic_load(&pipeline.window_waits));
+        pipeline_print_arenas(&pipeline);
+    }
+
+    for (int i = 0; i < PIPELINE_WINDOW; i++)
+    {
+        arena_free(&pipeline.slots[i].arena);
+    }
+    free(pipeline.slots);
+    free(threads);
+    ring_free(&pipeline.read_ring);
+    ring_free(&pipeline.parse_ring);
+    ring_free(&pipeline.analyse_ring);
+    return exit_code;
+}
@@ -0,0 +1,28 @@
+#ifndef APSC143__PIPELINE_H
+#define APSC143__PIPELINE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "search.h"
+#include "tablebase.h"
+#include "report.h"
+#include "cache.h"
+
+// Analyzes many games like batch_main (same input, same output, same order),
+// but streams them through a pipeline instead of reading everything first:
+// a reader thread pulls the input in large blocks and cuts it into games,
+// parser threads turn each game into a batch of moves, workers analysis
+// threads replay and analyze them, and this thread writes the results back in
+// input order through report. The stages are joined by bounded lock-free
+// rings, so reading, parsing and searching all overlap and memory stays
+// bounded however long the archive is. The hash budget is split between the
+// analysis threads, cache (may be NULL) is shared by all of them. multi_pv and
+// pruning are search_context.multi_pv and pruning, and weights (NULL for the
+// compiled-in ones) the evaluation weights, for every analysis. trusted
+// replays the games with the trusted board calls (see board_apply_move_trusted). Each game in flight
+// keeps its text and moves in an arena of at most arena_kb kilobytes that is
+// reused for a later game, so the stages don't allocate per game; a game that
+// doesn't fit fails as out of memory. Returns the process exit code.
+int pipeline_main(FILE *input, struct report_writer *report, int workers, int depth, int multi_pv, bool trusted, int table_mb, int arena_kb, const struct search_pruning *pruning, const struct tablebase *tablebase, const struct eval_weights *weights, struct cache *cache, bool print_stats);
+
+#endif
@@ -0,0 +1,530 @@
+#include "posdb.h"
+#include "parser.h"
+#include "eval.h"
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// file layout: this magic, 4 bytes of padding, then as little endian uint64s the record count, the
+// game count, the size of the names section and the file count, zeros up to POSDB_HEADER_SIZE. then
+// the names (padded to a multiple of 8 bytes), the records and the two indexes
+#define POSDB_MAGIC "CPD1"
+#define POSDB_HEADER_SIZE 64
+
+#define POSDB_MOVE_TEXT 32 // parse_move_text never looks past 31 characters either
+
+void posdb_builder_init(struct posdb_builder *builder)
+{
+    memset(builder, 0, sizeof(*builder));
+}
+
+void posdb_builder_free(struct posdb_builder *builder)
+{
+    free(builder->records);
+    free(builder->names);
+    memset(builder, 0, sizeof(*builder));
+}
+
+// the next line of input with its spaces taken out, at most size - 1 characters of it. offset
+// counts every byte read. returns the length, -1 at the end of the input
+static int posdb_read_line(FILE *input, char *text, int size, uint64_t *offset)
+{
+    int length = 0;
+    int current_char = getc(input);
+    if (current_char == EOF)
+    {
+        return -1;
+    }
+    for (; current_char != EOF; current_char = getc(input))
+    {
+        (*offset)++;
+        if (current_char == '\n')
+        {
+            break;
+        }
+        if (current_char != ' ' && current_char != '\t' && current_char != '\r' && length < size - 1)
+        {
+            text[length++] = (char)current_char;
+        }
+    }
+    text[length] = '\0';
+    return length;
+}
+
+static bool posdb_add_record(struct posdb_builder *builder, const struct chess_board *board, uint64_t game_offset, int ply, int file)
+{
+    if (builder->record_count == builder->record_capacity)
+    {
+        size_t capacity = builder->record_capacity ? builder->record_capacity * 2 : 65536;
+        struct posdb_record *records = realloc(builder->records, capacity * sizeof(*records));
+        if (records == NULL)
+        {
+            return false;
+        }
+        builder->records = records;
+        builder->record_capacity = capacity;
+    }
+
+    struct posdb_record *record = &builder->records[builder->record_count++];
+    memset(record, 0, sizeof(*record));
+    for (int row = 0; row < BOARD_SIZE; row++)
+    {
+        for (int col = 0; col < BOARD_SIZE; col++)
+        {
+            const struct square *square = &board->squares[row][col];
+            if (square->has_piece)
+            {
+                int index = row * BOARD_SIZE + col;
+                record->squares[index / 2] |= (uint8_t)((1 + square->piece + 8 * square->owner) << (4 * (index & 1)));
+            }
+        }
+    }
+    record->hash = board->hash;
+    record->game_offset = game_offset;
+    record->game = (uint32_t)builder->game_count;
+    record->ply = (uint16_t)ply;
+    record->file = (uint8_t)file;
+    record->flags = (board->next_move_player == PLAYER_BLACK ? POSDB_BLACK_TO_MOVE : 0) | (board->rights.white_kingside ? POSDB_WHITE_KINGSIDE : 0) |
+                    (board->rights.white_queenside ? POSDB_WHITE_QUEENSIDE : 0) | (board->rights.black_kingside ? POSDB_BLACK_KINGSIDE : 0) |
+                    (board->rights.black_queenside ? POSDB_BLACK_QUEENSIDE : 0);
+    return true;
+}
+
+enum chess_error posdb_builder_add(struct posdb_builder *builder, FILE *input, const char *name)
+{
+    if (builder->file_count == POSDB_MAX_FILES)
+    {
+        return CHESS_ERROR_BAD_DATABASE;
+    }
+    size_t name_length = strlen(name) + 1;
+    char *names = realloc(builder->names, builder->names_size + name_length);
+    if (names == NULL)
+    {
+        return CHESS_ERROR_OUT_OF_MEMORY;
+    }
+    memcpy(names + builder->names_size, name, name_length);
+    builder->names = names;
+    builder->names_size += name_length;
+    int file = builder->file_count++;
+
+    struct chess_board board;
+    char text[POSDB_MOVE_TEXT];
+    uint64_t offset = 0, game_offset = 0;
+    bool in_game = false;
+    bool stopped = false; // a move failed, the rest of the game is skipped
+    int ply = 0;
+
+    for (;;)
+    {
+        uint64_t line_offset = offset;
+        int length = posdb_read_line(input, text, sizeof(text), &offset);
+        if (length < 0)
+        {
+            break;
+        }
+        if (length == 0) // blank line, the game is over
+        {
+            if (in_game)
+            {
+                builder->game_count++;
+            }
+            in_game = false;
+            continue;
+        }
+
+        if (!in_game)
+        {
+            in_game = true;
+            stopped = false;
+            game_offset = line_offset;
+            board_initialize(&board);
+            ply = 0;
+        }
+        if (stopped)
+        {
+            continue;
+        }
+
+        struct chess_move move;
+        if (!parse_move_text(text, &move) || board_complete_move(&board, &move) || board_apply_move(&board, &move))
+        {
+            stopped = true;
+            builder->skipped_games++;
+            continue;
+        }
+        ply++;
+        if (!posdb_add_record(builder, &board, game_offset, ply, file))
+        {
+            return CHESS_ERROR_OUT_OF_MEMORY;
+        }
+    }
+    if (in_game)
+    {
+        builder->game_count++;
+    }
+    return CHESS_OK;
+}
+
+// splitmix64 finaliser, so pawn sets that differ by one square land far apart
+static uint64_t posdb_mix(uint64_t value)
+{
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+static uint64_t posdb_material_of(const uint64_t pieces[2][6])
+{
+    // four bits per count is plenty: even with every pawn promoted there are at most ten of a piece
+    uint64_t key = 0;
+    for (int player = PLAYER_WHITE; player <= PLAYER_BLACK; player++)
+    {
+        for (int piece = PIECE_PAWN; piece < PIECE_KING; piece++)
+        {
+            key |= (uint64_t)board_count_squares(pieces[player][piece]) << (4 * (player * 5 + piece));
+        }
+    }
+    return key;
+}
+
+static uint64_t posdb_pawns_of(const uint64_t pieces[2][6])
+{
+    return posdb_mix(pieces[PLAYER_WHITE][PIECE_PAWN] ^ posdb_mix(pieces[PLAYER_BLACK][PIECE_PAWN]));
+}
+
+void posdb_record_pieces(const struct posdb_record *record, uint64_t pieces[2][6])
+{
+    memset(pieces, 0, 2 * 6 * sizeof(uint64_t));
+    for (int index = 0; index < 64; index++)
+    {
+        int code = record->squares[index / 2] >> (4 * (index & 1)) & 0xF;
+        if (code != 0 && ((code - 1) & 7) <= PIECE_KING) // the file isn't trusted to hold only real pieces
+        {
+            pieces[(code - 1) >> 3][(code - 1) & 7] |= (uint64_t)1 << index;
+        }
+    }
+}
+
+static int posdb_compare_entries(const void *a, const void *b)
+{
+    const struct posdb_index_entry *x = a;
+    const struct posdb_index_entry *y = b;
+    if (x->key != y->key)
+    {
+        return x->key < y->key ? -1 : 1;
+    }
+    return x->record < y->record ? -1 : x->record > y->record;
+}
+
+// names_size rounded up so the records after it stay aligned
+static size_t posdb_padded(size_t size)
+{
+    return (size + 7) & ~(size_t)7;
+}
+
+static void posdb_write_header(uint8_t *header, const uint64_t fields[4])
+{
+    memset(header, 0, POSDB_HEADER_SIZE);
+    memcpy(header, POSDB_MAGIC, 4);
+    for (int field = 0; field < 4; field++)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            header[8 + 8 * field + i] = (uint8_t)(fields[field] >> (8 * i));
+        }
+    }
+}
+
+enum chess_error posdb_write(const struct posdb_builder *builder, const char *path)
+{
+    size_t count = builder->record_count;
+    struct posdb_index_entry *indexes[2];
+    indexes[POSDB_BY_MATERIAL] = malloc((count ? count : 1) * sizeof(struct posdb_index_entry));
+    indexes[POSDB_BY_PAWNS] = malloc((count ? count : 1) * sizeof(struct posdb_index_entry));
+    if (indexes[POSDB_BY_MATERIAL] == NULL || indexes[POSDB_BY_PAWNS] == NULL)
+    {
+        free(indexes[POSDB_BY_MATERIAL]);
+        free(indexes[POSDB_BY_PAWNS]);
+        return CHESS_ERROR_OUT_OF_MEMORY;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t pieces[2][6];
+        posdb_record_pieces(&builder->records[i], pieces);
+        indexes[POSDB_BY_MATERIAL][i] = (struct posdb_index_entry){posdb_material_of(pieces), i};
+        indexes[POSDB_BY_PAWNS][i] = (struct posdb_index_entry){posdb_pawns_of(pieces), i};
+    }
+    qsort(indexes[POSDB_BY_MATERIAL], count, sizeof(struct posdb_index_entry), posdb_compare_entries);
+    qsort(indexes[POSDB_BY_PAWNS], count, sizeof(struct posdb_index_entry), posdb_compare_entries);
+
+    enum chess_error error = CHESS_ERROR_BAD_DATABASE;
+    FILE *file = fopen(path, "wb");
+    if (file != NULL)
+    {
+        uint8_t header[POSDB_HEADER_SIZE];
+        uint64_t fields[4] = {count, builder->game_count, posdb_padded(builder->names_size), (uint64_t)builder->file_count};
+        posdb_write_header(header, fields);
+        static const uint8_t padding[8] = {0};
+        bool written = fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+                       fwrite(builder->names, 1, builder->names_size, file) == builder->names_size &&
+                       fwrite(padding, 1, posdb_padded(builder->names_size) - builder->names_size, file) == posdb_padded(builder->names_size) - builder->names_size &&
+                       fwrite(builder->records, sizeof(struct posdb_record), count, file) == count &&
+                       fwrite(indexes[POSDB_BY_MATERIAL], sizeof(struct posdb_index_entry), count, file) == count &&
+                       fwrite(indexes[POSDB_BY_PAWNS], sizeof(struct posdb_index_entry), count, file) == count;
+        if (fclose(file) == 0 && written)
+        {
+            error = CHESS_OK;
+        }
+    }
+    free(indexes[POSDB_BY_MATERIAL]);
+    free(indexes[POSDB_BY_PAWNS]);
+    return error;
+}
+
+// checks the header against the file size and points db's sections into the file
+static bool posdb_read_header(struct posdb *db, const uint8_t *mapping, size_t file_size)
+{
+    if (file_size < POSDB_HEADER_SIZE || memcmp(mapping, POSDB_MAGIC, 4) != 0)
+    {
+        return false;
+    }
+    uint64_t fields[4] = {0};
+    for (int field = 0; field < 4; field++)
+    {
+        for (int i = 7; i >= 0; i--)
+        {
+            fields[field] = fields[field] << 8 | mapping[8 + 8 * field + i];
+        }
+    }
+    uint64_t count = fields[0], names_size = fields[2], file_count = fields[3];
+    if (names_size % 8 != 0 || file_count > POSDB_MAX_FILES || count > file_size ||
+        file_size != POSDB_HEADER_SIZE + names_size + count * (sizeof(struct posdb_record) + 2 * sizeof(struct posdb_index_entry)))
+    {
+        return false;
+    }
+
+    // the names have to be all there, or posdb_file_name could run off the end
+    const char *names = (const char *)mapping + POSDB_HEADER_SIZE;
+    uint64_t terminators = 0;
+    for (uint64_t i = 0; i < names_size; i++)
+    {
+        terminators += names[i] == '\0';
+    }
+    if (terminators < file_count)
+    {
+        return false;
+    }
+
+    db->names = names;
+    db->file_count = (int)file_count;
+    db->record_count = (size_t)count;
+    db->game_count = (size_t)fields[1];
+    db->records = (const struct posdb_record *)(mapping + POSDB_HEADER_SIZE + names_size);
+    db->indexes[POSDB_BY_MATERIAL] = (const struct posdb_index_entry *)(db->records + count);
+    db->indexes[POSDB_BY_PAWNS] = db->indexes[POSDB_BY_MATERIAL] + count;
+    return true;
+}
+
+enum chess_error posdb_open(struct posdb *db, const char *path)
+{
+    memset(db, 0, sizeof(*db));
+
+#ifndef _WIN32
+    int descriptor = open(path, O_RDONLY);
+    if (descriptor < 0)
+    {
+        return CHESS_ERROR_BAD_DATABASE;
+    }
+    struct stat info;
+    if (fstat(descriptor, &info) != 0 || info.st_size < POSDB_HEADER_SIZE)
+    {
+        close(descriptor);
+        return CHESS_ERROR_BAD_DATABASE;
+    }
+    size_t file_size = (size_t)info.st_size;
+    void *mapping = mmap(NULL, file_size, PROT_READ, MAP_SHARED, descriptor, 0);
+    close(descriptor); // the mapping keeps the file alive
+    if (mapping == MAP_FAILED)
+    {
+        return CHESS_ERROR_BAD_DATABASE;
+    }
+    if (!posdb_read_header(db, mapping, file_size))
+    {
+        munmap(mapping, file_size);
+        memset(db, 0, sizeof(*db));
+        return CHESS_ERROR_BAD_DATABASE;
+    }
+#else
+    // no mmap here, read the whole file instead
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return CHESS_ERROR_BAD_DATABASE;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    size_t file_size = length > 0 ? (size_t)length : 0;
+    void *mapping = malloc(file_size ? file_size : 1);
+    bool read = mapping != NULL && fread(mapping, 1, file_size, file) == file_size;
+    fclose(file);
+    if (!read || !posdb_read_header(db, mapping, file_size))
+    {
+        free(mapping);
+        memset(db, 0, sizeof(*db));
+        return mapping == NULL ? CHESS_ERROR_OUT_OF_MEMORY : CHESS_ERROR_BAD_DATABASE;
+    }
+#endif
+
+    db->mapping = mapping;
+    db->mapping_size = file_size;
+    return CHESS_OK;
+}
+
+void posdb_close(struct posdb *db)
+{
+    if (db->mapping != NULL)
+    {
+#ifndef _WIN32
+        munmap(db->mapping, db->mapping_size);
+#else
+        free(db->mapping);
+#endif
+    }
+    memset(db, 0, sizeof(*db));
+}
+
+uint64_t posdb_material_key(const struct chess_board *board)
+{
+    return posdb_material_of(board->pieces);
+}
+
+bool posdb_parse_material(const char *name, uint64_t *key)
+{
+    static const char piece_letters[] = "PNBRQK";
+    int counts[2][6] = {{0}};
+    int player = PLAYER_WHITE;
+
+    for (const char *cursor = name; *cursor != '\0'; cursor++)
+    {
+        if (*cursor == 'v' && player == PLAYER_WHITE)
+        {
+            player = PLAYER_BLACK;
+            continue;
+        }
+        const char *found = memchr(piece_letters, *cursor, sizeof(piece_letters) - 1);
+        if (found == NULL || ++counts[player][found - piece_letters] > 10)
+        {
+            return false;
+        }
+    }
+    if (player != PLAYER_BLACK || counts[PLAYER_WHITE][PIECE_KING] > 1 || counts[PLAYER_BLACK][PIECE_KING] > 1)
+    {
+        return false;
+    }
+
+    *key = 0;
+    for (player = PLAYER_WHITE; player <= PLAYER_BLACK; player++)
+    {
+        for (int piece = PIECE_PAWN; piece < PIECE_KING; piece++)
+        {
+            *key |= (uint64_t)counts[player][piece] << (4 * (player * 5 + piece));
+        }
+    }
+    return true;
+}
+
+uint64_t posdb_pawn_key(const struct chess_board *board)
+{
+    return posdb_pawns_of(board->pieces);
+}
+
+size_t posdb_find(const struct posdb *db, enum posdb_index index, uint64_t key, size_t *first)
+{
+    const struct posdb_index_entry *entries = db->indexes[index];
+
+    // lower bound, then upper bound from there
+    size_t low = 0, high = db->record_count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (entries[middle].key < key)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    *first = low;
+
+    high = db->record_count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (entries[middle].key <= key)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low - *first;
+}
+
+void posdb_record_board(const struct posdb_record *record, struct chess_board *board)
+{
+    memset(board, 0, sizeof(*board));
+    for (int row = 0; row < BOARD_SIZE; row++)
+    {
+        for (int col = 0; col < BOARD_SIZE; col++)
+        {
+            int index = row * BOARD_SIZE + col;
+            int code = record->squares[index / 2] >> (4 * (index & 1)) & 0xF;
+            if (code != 0 && ((code - 1) & 7) <= PIECE_KING)
+            {
+                board->squares[row][col] = (struct square){true, (enum chess_piece)((code - 1) & 7), (enum chess_player)((code - 1) >> 3), col, row};
+            }
+        }
+    }
+    board->next_move_player = (record->flags & POSDB_BLACK_TO_MOVE) ? PLAYER_BLACK : PLAYER_WHITE;
+    board->rights.white_kingside = (record->flags & POSDB_WHITE_KINGSIDE) != 0;
+    board->rights.white_queenside = (record->flags & POSDB_WHITE_QUEENSIDE) != 0;
+    board->rights.black_kingside = (record->flags & POSDB_BLACK_KINGSIDE) != 0;
+    board->rights.black_queenside = (record->flags & POSDB_BLACK_QUEENSIDE) != 0;
+
+    board_reset_pieces(board);
+    eval_reset(board, NULL);
+    board_update_attacks(board);
+    board->hash = board_compute_hash(board);
+    board->pawn_hash = board_compute_pawn_hash(board);
+}
+
+const struct posdb_record *posdb_index_record(const struct posdb *db, enum posdb_index index, size_t position)
+{
+    uint64_t record = db->indexes[index][position].record;
+    return record < db->record_count ? &db->records[record] : NULL;
+}
+
+const char *posdb_file_name(const struct posdb *db, int file)
+{
+    if (file < 0 || file >= db->file_count)
+    {
+        return NULL;
+    }
+    const char *name = db->names;
+    for (int i = 0; i < file; i++)
+    {
+        name += strlen(name) + 1;
+    }
+    return name;
+}
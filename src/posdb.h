@@ -0,0 +1,121 @@
+#ifndef APSC143__POSDB_H
+#define APSC143__POSDB_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "board.h"
+
+// One position of a game in the store. The board is packed two squares to a
+// byte (low nibble first, squares in bit index order), each nibble 0 for an
+// empty square or 1 + piece + 8 * owner; flags hold the side to move and the
+// castling rights. The game is found again through its corpus file and the
+// byte offset of its first line there.
+struct posdb_record
+{
+    uint8_t squares[32];
+    uint64_t hash;        // the board's zobrist hash
+    uint64_t game_offset; // where the game starts in its corpus file
+    uint32_t game;        // which game of the whole corpus, counting from 0
+    uint16_t ply;         // moves played to get here, 1 for the position after the first
+    uint8_t flags;        // POSDB_BLACK_TO_MOVE and the POSDB_*_CASTLE bits
+    uint8_t file;         // which corpus file, see posdb_file_name
+};
+
+#define POSDB_BLACK_TO_MOVE 0x01
+#define POSDB_WHITE_KINGSIDE 0x02
+#define POSDB_WHITE_QUEENSIDE 0x04
+#define POSDB_BLACK_KINGSIDE 0x08
+#define POSDB_BLACK_QUEENSIDE 0x10
+
+// most corpus files one store covers
+#define POSDB_MAX_FILES 255
+
+// a secondary index: every record's key, sorted by key and then record, so
+// the matches for one key are a single run in corpus order
+struct posdb_index_entry
+{
+    uint64_t key;
+    uint64_t record;
+};
+
+enum posdb_index
+{
+    POSDB_BY_MATERIAL, // posdb_material_key
+    POSDB_BY_PAWNS,    // posdb_pawn_key
+};
+
+// Every position of a game corpus, replayed once and written to a file that
+// later runs memory-map, with an index on material and one on pawn structure
+// so a query is a binary search instead of a replay of the whole archive. The
+// corpus files are in the batch input format: one move per line, games
+// separated by blank lines. A game stops at the first move that doesn't parse
+// or isn't legal, keeping the positions before it. The starting position, the
+// same in every game, isn't stored. The sections are in this machine's byte
+// order, like the result cache.
+struct posdb
+{
+    const struct posdb_record *records;
+    size_t record_count;
+    size_t game_count;
+    const struct posdb_index_entry *indexes[2]; // by enum posdb_index, record_count entries each
+    const char *names;                          // the corpus file names, one after another with their NULs
+    int file_count;
+
+    // where it all came from, so posdb_close knows how to give it back
+    void *mapping;
+    size_t mapping_size;
+};
+
+// Collects positions for posdb_write.
+struct posdb_builder
+{
+    struct posdb_record *records;
+    size_t record_count, record_capacity;
+    size_t game_count;
+    size_t skipped_games; // stopped early by a move that didn't parse or wasn't legal
+    char *names;
+    size_t names_size;
+    int file_count;
+};
+
+void posdb_builder_init(struct posdb_builder *builder);
+void posdb_builder_free(struct posdb_builder *builder);
+// Replays every game in input and adds its positions, name is what the store
+// calls the file. Returns CHESS_ERROR_OUT_OF_MEMORY if the positions don't
+// fit, or CHESS_ERROR_BAD_DATABASE after POSDB_MAX_FILES files.
+enum chess_error posdb_builder_add(struct posdb_builder *builder, FILE *input, const char *name);
+// Sorts the indexes and writes the store to path.
+enum chess_error posdb_write(const struct posdb_builder *builder, const char *path);
+
+// Maps a store written by posdb_write. Returns CHESS_ERROR_BAD_DATABASE if the
+// file can't be used. Only the header and the sizes are checked, so opening
+// costs the same however big the store is; what the records and index entries
+// point at is checked as they're read (posdb_index_record, posdb_file_name).
+enum chess_error posdb_open(struct posdb *db, const char *path);
+void posdb_close(struct posdb *db);
+
+// How many of each piece each side has, kings left out, as one number.
+uint64_t posdb_material_key(const struct chess_board *board);
+// The material key for a name like "KRvKRP" (white's pieces, then black's;
+// the kings may be left out). Returns false if it isn't one.
+bool posdb_parse_material(const char *name, uint64_t *key);
+// A hash of where both sides' pawns are, nothing else.
+uint64_t posdb_pawn_key(const struct chess_board *board);
+
+// The records whose key in index is key: *first is the position of the first
+// one in db->indexes[index], the return value how many there are.
+size_t posdb_find(const struct posdb *db, enum posdb_index index, uint64_t key, size_t *first);
+// Just the piece sets of a record, like chess_board.pieces.
+void posdb_record_pieces(const struct posdb_record *record, uint64_t pieces[2][6]);
+// Unpacks a record into a full board.
+void posdb_record_board(const struct posdb_record *record, struct chess_board *board);
+// The record entry position of db->indexes[index] points at, NULL if it
+// points past the end (a damaged store).
+const struct posdb_record *posdb_index_record(const struct posdb *db, enum posdb_index index, size_t position);
+// The name of corpus file number file (a record's file field), NULL if the
+// store has no such file (a damaged store).
+const char *posdb_file_name(const struct posdb *db, int file);
+
+#endif
@@ -0,0 +1,225 @@
+#include "posdb.h"
+#include "search.h"
+#include "panic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// chess-posdb build [-o FILE] CORPUS...
+//   replays every game of the corpus files (batch input: one move per line, blank line between
+//   games) once and writes their positions with a material and a pawn structure index to FILE
+//   (default positions.cpd)
+// chess-posdb query FILE [--material KRvKRP] [--pawns FEN] [--limit N]
+//   prints every stored position with that material and/or exactly that pawn structure (the rest
+//   of the FEN is ignored, though it still has to be a legal position), in corpus order: "file:offset game G ply P FEN", offset being where
+//   the game starts in its corpus file. the count and the time taken go to stderr
+
+#define POSDB_DEFAULT_PATH "positions.cpd"
+
+static int posdb_tool_build(int argc, char **argv)
+{
+    const char *output = POSDB_DEFAULT_PATH;
+    struct posdb_builder builder;
+    posdb_builder_init(&builder);
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+            continue;
+        }
+        FILE *input = fopen(argv[i], "r");
+        if (input == NULL)
+        {
+            panicf("%s: can't open\n", argv[i]);
+        }
+        enum chess_error error = posdb_builder_add(&builder, input, argv[i]);
+        fclose(input);
+        if (error)
+        {
+            panicf("%s: %s\n", argv[i], chess_error_string(error));
+        }
+    }
+    if (builder.file_count == 0)
+    {
+        panicf("usage: %s build [-o FILE] CORPUS...\n", argv[0]);
+    }
+
+    enum chess_error error = posdb_write(&builder, output);
+    if (error)
+    {
+        panicf("%s: %s\n", output, chess_error_string(error));
+    }
+    fprintf(stderr, "%s: %zu positions from %zu games (%zu stopped at a bad move)\n", output, builder.record_count, builder.game_count, builder.skipped_games);
+    posdb_builder_free(&builder);
+    return 0;
+}
+
+// the board part of a FEN, side to move and castling rights (the library only reads FENs)
+static void posdb_tool_fen(const struct chess_board *board, char *text)
+{
+    static const char piece_letters[] = "PNBRQK";
+    int length = 0;
+    for (int row = 0; row < BOARD_SIZE; row++)
+    {
+        int empty = 0;
+        for (int col = 0; col < BOARD_SIZE; col++)
+        {
+            const struct square *square = &board->squares[row][col];
+            if (!square->has_piece)
+            {
+                empty++;
+                continue;
+            }
+            if (empty > 0)
+            {
+                text[length++] = (char)('0' + empty);
+                empty = 0;
+            }
+            char letter = piece_letters[square->piece];
+            text[length++] = square->owner == PLAYER_WHITE ? letter : (char)(letter - 'A' + 'a');
+        }
+        if (empty > 0)
+        {
+            text[length++] = (char)('0' + empty);
+        }
+        text[length++] = row < BOARD_SIZE - 1 ? '/' : ' ';
+    }
+    text[length++] = board->next_move_player == PLAYER_WHITE ? 'w' : 'b';
+    text[length++] = ' ';
+    int rights_start = length;
+    if (board->rights.white_kingside)
+    {
+        text[length++] = 'K';
+    }
+    if (board->rights.white_queenside)
+    {
+        text[length++] = 'Q';
+    }
+    if (board->rights.black_kingside)
+    {
+        text[length++] = 'k';
+    }
+    if (board->rights.black_queenside)
+    {
+        text[length++] = 'q';
+    }
+    if (length == rights_start)
+    {
+        text[length++] = '-';
+    }
+    text[length] = '\0';
+}
+
+static int posdb_tool_query(int argc, char **argv)
+{
+    const char *path = NULL;
+    const char *material = NULL;
+    const char *pawns_fen = NULL;
+    long long limit = -1;
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--material") == 0 && i + 1 < argc)
+        {
+            material = argv[++i];
+        }
+        else if (strcmp(argv[i], "--pawns") == 0 && i + 1 < argc)
+        {
+            pawns_fen = argv[++i];
+        }
+        else if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc)
+        {
+            limit = atoll(argv[++i]);
+        }
+        else if (path == NULL && argv[i][0] != '-')
+        {
+            path = argv[i];
+        }
+        else
+        {
+            path = NULL;
+            break;
+        }
+    }
+    if (path == NULL || (material == NULL && pawns_fen == NULL))
+    {
+        panicf("usage: %s query FILE [--material KRvKRP] [--pawns FEN] [--limit N]\n", argv[0]);
+    }
+
+    uint64_t material_key = 0;
+    if (material != NULL && !posdb_parse_material(material, &material_key))
+    {
+        panicf("%s: not a material set like KRvKRP\n", material);
+    }
+    struct chess_board pawns_board;
+    if (pawns_fen != NULL)
+    {
+        enum chess_error error = board_set_fen(&pawns_board, pawns_fen);
+        if (error)
+        {
+            panicf("%s: %s\n", pawns_fen, chess_error_string(error));
+        }
+    }
+
+    unsigned long long start = search_now_ns();
+    struct posdb db;
+    enum chess_error error = posdb_open(&db, path);
+    if (error)
+    {
+        panicf("%s: %s\n", path, chess_error_string(error));
+    }
+
+    // walk whichever index was asked for, the pawn one when both were since it's the narrower
+    enum posdb_index index = pawns_fen != NULL ? POSDB_BY_PAWNS : POSDB_BY_MATERIAL;
+    uint64_t key = pawns_fen != NULL ? posdb_pawn_key(&pawns_board) : material_key;
+    size_t first;
+    size_t candidates = posdb_find(&db, index, key, &first);
+
+    long long matches = 0;
+    for (size_t i = first; i < first + candidates && matches != limit; i++)
+    {
+        const struct posdb_record *record = posdb_index_record(&db, index, i);
+        const char *file_name = record != NULL ? posdb_file_name(&db, record->file) : NULL;
+        if (file_name == NULL)
+        {
+            panicf("%s: %s\n", path, chess_error_string(CHESS_ERROR_BAD_DATABASE));
+        }
+        struct chess_board board;
+        posdb_record_board(record, &board);
+
+        // the hash only narrows it down, the pawns have to be the very same
+        if (pawns_fen != NULL && (board.pieces[PLAYER_WHITE][PIECE_PAWN] != pawns_board.pieces[PLAYER_WHITE][PIECE_PAWN] ||
+                                  board.pieces[PLAYER_BLACK][PIECE_PAWN] != pawns_board.pieces[PLAYER_BLACK][PIECE_PAWN]))
+        {
+            continue;
+        }
+        if (material != NULL && posdb_material_key(&board) != material_key)
+        {
+            continue;
+        }
+
+        char fen[96];
+        posdb_tool_fen(&board, fen);
+        printf("%s:%llu game %lu ply %u %s\n", file_name, (unsigned long long)record->game_offset, (unsigned long)record->game, (unsigned)record->ply, fen);
+        matches++;
+    }
+
+    fprintf(stderr, "%lld matches among %zu positions of %zu games in %.1f ms\n", matches, db.record_count, db.game_count, (double)(search_now_ns() - start) / 1e6);
+    posdb_close(&db);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "build") == 0)
+    {
+        return posdb_tool_build(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "query") == 0)
+    {
+        return posdb_tool_query(argc, argv);
+    }
+    panicf("usage: %s build [-o FILE] CORPUS... | query FILE [--material KRvKRP] [--pawns FEN] [--limit N]\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,351 @@
+#include "report.h"
+#include "parser.h"
+#include "search.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define REPORT_BUFFER_SIZE (1 << 20)
+#define REPORT_RECORD_MAX 1024 // more than any one record needs, flush before there's less room than this
+
+bool report_parse_format(const char *text, enum report_format *format)
+{
+    if (strcmp(text, "text") == 0)
+    {
+        *format = REPORT_TEXT;
+    }
+    else if (strcmp(text, "jsonl") == 0)
+    {
+        *format = REPORT_JSONL;
+    }
+    else if (strcmp(text, "csv") == 0)
+    {
+        *format = REPORT_CSV;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+static void report_flush(struct report_writer *report)
+{
+    fwrite(report->buffer, 1, report->length, report->out);
+    report->length = 0;
+}
+
+static void report_append(struct report_writer *report, const char *text)
+{
+    size_t length = strlen(text);
+    memcpy(report->buffer + report->length, text, length);
+    report->length += length;
+}
+
+static void report_append_char(struct report_writer *report, char current_char)
+{
+    report->buffer[report->length++] = current_char;
+}
+
+static void report_append_number(struct report_writer *report, unsigned long long value)
+{
+    char digits[20];
+    int count = 0;
+    do
+    {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (count > 0)
+    {
+        report_append_char(report, digits[--count]);
+    }
+}
+
+// milliseconds with three decimals, e.g. 12.345
+static void report_append_ms(struct report_writer *report, unsigned long long ns)
+{
+    unsigned long long us = ns / 1000;
+    report_append_number(report, us / 1000);
+    report_append_char(report, '.');
+    report_append_char(report, (char)('0' + us / 100 % 10));
+    report_append_char(report, (char)('0' + us / 10 % 10));
+    report_append_char(report, (char)('0' + us % 10));
+}
+
+// a quoted JSON string, or null if text is NULL or empty
+static void report_append_json_string(struct report_writer *report, const char *text)
+{
+    if (text == NULL || text[0] == '\0')
+    {
+        report_append(report, "null");
+        return;
+    }
+    report_append_char(report, '"');
+    for (; *text != '\0'; text++)
+    {
+        if (*text == '"' || *text == '\\')
+        {
+            report_append_char(report, '\\');
+        }
+        report_append_char(report, *text);
+    }
+    report_append_char(report, '"');
+}
+
+// a CSV field, quoted only if it has to be
+static void report_append_csv_field(struct report_writer *report, const char *text)
+{
+    if (text == NULL)
+    {
+        return;
+    }
+    if (strpbrk(text, ",\"") == NULL)
+    {
+        report_append(report, text);
+        return;
+    }
+    report_append_char(report, '"');
+    for (; *text != '\0'; text++)
+    {
+        if (*text == '"')
+        {
+            report_append_char(report, '"');
+        }
+        report_append_char(report, *text);
+    }
+    report_append_char(report, '"');
+}
+
+// a line's score: centipawns for the player to move, or a mate as #N (#-N when being mated)
+static void report_append_score(struct report_writer *report, int score, bool json)
+{
+    int mate = search_mate_moves(score);
+    if (mate != 0)
+    {
+        report_append(report, json ? "\"mate\":" : "#");
+        score = mate;
+    }
+    else if (json)
+    {
+        report_append(report, "\"score\":");
+    }
+    if (score < 0)
+    {
+        report_append_char(report, '-');
+    }
+    report_append_number(report, (unsigned long long)get_absolute_value(score));
+}
+
+// JSONL: an array of {"san","move","score" or "mate"} objects. CSV: one field of "san move score" separated by semicolons
+static void report_append_lines(struct report_writer *report, const struct report_record *record)
+{
+    const struct chess_summary *summary = record->error ? NULL : record->summary;
+    int count = (summary != NULL && summary->line_count > 1) ? summary->line_count : 0;
+    bool json = report->format == REPORT_JSONL;
+    if (json)
+    {
+        report_append_char(report, '[');
+    }
+    for (int i = 0; i < count; i++)
+    {
+        char move[6];
+        format_move_coordinate(&summary->lines[i], move);
+        if (json)
+        {
+            report_append(report, i > 0 ? ",{\"san\":" : "{\"san\":");
+            report_append_json_string(report, record->san[i]);
+            report_append(report, ",\"move\":");
+            report_append_json_string(report, move);
+            report_append_char(report, ',');
+            report_append_score(report, summary->line_scores[i], true);
+            report_append_char(report, '}');
+        }
+        else
+        {
+            if (i > 0)
+            {
+                report_append_char(report, ';');
+            }
+            report_append(report, record->san[i]);
+            report_append_char(report, ' ');
+            report_append(report, move);
+            report_append_char(report, ' ');
+            report_append_score(report, summary->line_scores[i], false);
+        }
+    }
+    if (json)
+    {
+        report_append_char(report, ']');
+    }
+}
+
+bool report_init(struct report_writer *report, FILE *out, enum report_format format, bool timing, bool lines)
+{
+    report->out = out;
+    report->format = format;
+    report->timing = timing;
+    report->lines = lines;
+    report->length = 0;
+    report->buffer = NULL;
+    if (format == REPORT_TEXT) // board_print_summary writes to the FILE, so give that the big buffer instead
+    {
+        setvbuf(out, NULL, _IOFBF, REPORT_BUFFER_SIZE);
+        return true;
+    }
+
+    report->buffer = malloc(REPORT_BUFFER_SIZE);
+    if (report->buffer == NULL)
+    {
+        return false;
+    }
+
+    if (format == REPORT_CSV)
+    {
+        report_append(report, "game,status,winner,san,move,error");
+        report_append(report, timing ? ",ms" : "");
+        report_append(report, lines ? ",lines\n" : "\n");
+    }
+    return true;
+}
+
+void report_format_san(const struct chess_board *board, const struct chess_summary *summary, char san[][10])
+{
+    if (summary->has_suggestion)
+    {
+        format_move_san(board, &summary->suggestion, san[0]);
+    }
+    for (int i = 1; i < summary->line_count; i++) // lines[0] is the suggestion
+    {
+        format_move_san(board, &summary->lines[i], san[i]);
+    }
+}
+
+static void report_write_text(struct report_writer *report, const struct report_record *record)
+{
+    if (record->error)
+    {
+        char message[128];
+        chess_describe_move_error(message, sizeof(message), record->error, &record->failed_move);
+        fprintf(report->out, "%s\n", message);
+    }
+    else
+    {
+        board_print_summary(report->out, record->summary);
+    }
+}
+
+void report_write(struct report_writer *report, const struct report_record *record)
+{
+    if (report->format == REPORT_TEXT)
+    {
+        report_write_text(report, record);
+        return;
+    }
+
+    // work out the fields once, both formats write the same ones
+    const char *status = "error";
+    const char *winner = NULL;
+    const char *san = NULL;
+    char move[6] = "";
+    char message[128] = "";
+    if (record->error)
+    {
+        chess_describe_move_error(message, sizeof(message), record->error, &record->failed_move);
+    }
+    else
+    {
+        const struct chess_summary *summary = record->summary;
+        switch (summary->status)
+        {
+        case STATUS_CHECKMATE:
+            status = "checkmate";
+            winner = player_string(summary->winner);
+            break;
+        case STATUS_STALEMATE:
+            status = "stalemate";
+            break;
+        case STATUS_REPETITION:
+            status = "repetition";
+            break;
+        case STATUS_FIFTY_MOVES:
+            status = "fifty-move";
+            break;
+        case STATUS_INCOMPLETE:
+            status = "incomplete";
+            break;
+        }
+        if (summary->has_suggestion)
+        {
+            san = record->san[0];
+            format_move_coordinate(&summary->suggestion, move);
+        }
+    }
+
+    if (report->length > REPORT_BUFFER_SIZE - REPORT_RECORD_MAX)
+    {
+        report_flush(report);
+    }
+
+    if (report->format == REPORT_JSONL)
+    {
+        report_append(report, "{\"game\":");
+        report_append_number(report, record->game);
+        report_append(report, ",\"status\":");
+        report_append_json_string(report, status);
+        report_append(report, ",\"winner\":");
+        report_append_json_string(report, winner);
+        report_append(report, ",\"san\":");
+        report_append_json_string(report, san);
+        report_append(report, ",\"move\":");
+        report_append_json_string(report, move);
+        report_append(report, ",\"error\":");
+        report_append_json_string(report, message);
+        if (report->timing)
+        {
+            report_append(report, ",\"ms\":");
+            report_append_ms(report, record->analysis_ns);
+        }
+        if (report->lines)
+        {
+            report_append(report, ",\"lines\":");
+            report_append_lines(report, record);
+        }
+        report_append(report, "}\n");
+    }
+    else
+    {
+        report_append_number(report, record->game);
+        report_append_char(report, ',');
+        report_append_csv_field(report, status);
+        report_append_char(report, ',');
+        report_append_csv_field(report, winner);
+        report_append_char(report, ',');
+        report_append_csv_field(report, san);
+        report_append_char(report, ',');
+        report_append_csv_field(report, move);
+        report_append_char(report, ',');
+        report_append_csv_field(report, message);
+        if (report->timing)
+        {
+            report_append_char(report, ',');
+            report_append_ms(report, record->analysis_ns);
+        }
+        if (report->lines)
+        {
+            report_append_char(report, ',');
+            report_append_lines(report, record);
+        }
+        report_append_char(report, '\n');
+    }
+}
+
+void report_finish(struct report_writer *report)
+{
+    if (report->buffer != NULL)
+    {
+        report_flush(report);
+    }
+    fflush(report->out);
+    free(report->buffer);
+    report->buffer = NULL;
+}
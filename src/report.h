@@ -0,0 +1,55 @@
+#ifndef APSC143__REPORT_H
+#define APSC143__REPORT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "board.h"
+
+enum report_format
+{
+    REPORT_TEXT,  // the usual human readable summaries
+    REPORT_JSONL, // one JSON object per game
+    REPORT_CSV,   // a header row, then one row per game
+};
+
+// everything written about one game
+struct report_record
+{
+    size_t game; // 1 based, in input order
+    enum chess_error error; // completing or applying failed_move went wrong, there's no summary
+    struct chess_move failed_move;
+    const struct chess_summary *summary;
+    const char (*san)[10]; // san[0] the suggestion and san[i] lines[i] in SAN, only needed for the structured formats
+    unsigned long long analysis_ns; // only written with timing on
+};
+
+// Writes game results in one of the formats above. The structured formats are
+// put together by hand in one large buffer that is reused for the whole run
+// and only handed to the FILE when nearly full, so formatting stays cheap at
+// millions of games; text goes through board_print_summary as it always has.
+struct report_writer
+{
+    FILE *out;
+    enum report_format format;
+    bool timing; // add each game's analysis time in milliseconds (structured formats only)
+    bool lines;  // add the ranked moves of a multi-PV search (structured formats only, text always has them)
+    char *buffer;
+    size_t length;
+};
+
+// Parses "text", "jsonl" or "csv". Returns false for anything else.
+bool report_parse_format(const char *text, enum report_format *format);
+
+// Sets up the buffering for out, so call it before anything else is written
+// there. Writes the CSV header straight away. Returns false if the buffer
+// can't be allocated.
+bool report_init(struct report_writer *report, FILE *out, enum report_format format, bool timing, bool lines);
+// Fills in san for report_record.san from the position summary was made for.
+// Nothing to do for the text format, which doesn't use it.
+void report_format_san(const struct chess_board *board, const struct chess_summary *summary, char san[][10]);
+void report_write(struct report_writer *report, const struct report_record *record);
+// Flushes whatever is buffered and frees the buffer.
+void report_finish(struct report_writer *report);
+
+#endif
@@ -0,0 +1,152 @@
+#include "ring.h"
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+bool ring_init(struct ring *ring, size_t capacity, int producers)
+{
+    size_t size = 2;
+    while (size < capacity)
+    {
+        size *= 2;
+    }
+
+    ring->cells = malloc(size * sizeof(struct ring_cell));
+    if (ring->cells == NULL)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < size; i++)
+    {
+        atomic_init(&ring->cells[i].sequence, i);
+        ring->cells[i].item = NULL;
+    }
+    ring->mask = size - 1;
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->pushes, 0);
+    atomic_init(&ring->depth_total, 0);
+    atomic_init(&ring->depth_max, 0);
+    atomic_init(&ring->full_waits, 0);
+    atomic_init(&ring->empty_waits, 0);
+    atomic_init(&ring->producers, producers);
+    return true;
+}
+
+void ring_free(struct ring *ring)
+{
+    free(ring->cells);
+    ring->cells = NULL;
+}
+
+size_t ring_capacity(const struct ring *ring)
+{
+    return ring->mask + 1;
+}
+
+bool ring_try_push(struct ring *ring, void *item)
+{
+    size_t position = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    struct ring_cell *cell;
+
+    while (true)
+    {
+        cell = &ring->cells[position & ring->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+        if (difference == 0) // our turn for this slot, claim it
+        {
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0) // a whole lap behind: the consumer hasn't emptied it yet, so we're full
+        {
+            return false;
+        }
+        else // another producer got here first
+        {
+            position = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+
+    cell->item = item;
+    atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+
+    // statistics only, relaxed is plenty. consumers may already have moved past us, so clamp the depth
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t depth = tail <= position + 1 ? position + 1 - tail : 0;
+    atomic_fetch_add_explicit(&ring->pushes, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&ring->depth_total, depth, memory_order_relaxed);
+    size_t depth_max = atomic_load_explicit(&ring->depth_max, memory_order_relaxed);
+    while (depth > depth_max && !atomic_compare_exchange_weak_explicit(&ring->depth_max, &depth_max, depth, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+    return true;
+}
+
+bool ring_try_pop(struct ring *ring, void **item)
+{
+    size_t position = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    struct ring_cell *cell;
+
+    while (true)
+    {
+        cell = &ring->cells[position & ring->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+
+        if (difference == 0) // filled and waiting for us
+        {
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0) // not filled yet, we're empty
+        {
+            return false;
+        }
+        else // another consumer got here first
+        {
+            position = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+
+    *item = cell->item;
+    // hand the slot back to producers for the next lap
+    atomic_store_explicit(&cell->sequence, position + ring->mask + 1, memory_order_release);
+    return true;
+}
+
+void ring_push(struct ring *ring, void *item)
+{
+    while (!ring_try_push(ring, item))
+    {
+        atomic_fetch_add_explicit(&ring->full_waits, 1, memory_order_relaxed);
+        sched_yield();
+    }
+}
+
+bool ring_pop(struct ring *ring, void **item)
+{
+    while (!ring_try_pop(ring, item))
+    {
+        if (atomic_load_explicit(&ring->producers, memory_order_acquire) == 0)
+        {
+            // everything pushed before the last close is visible now, one more look settles it
+            return ring_try_pop(ring, item);
+        }
+        atomic_fetch_add_explicit(&ring->empty_waits, 1, memory_order_relaxed);
+        sched_yield();
+    }
+    return true;
+}
+
+void ring_close(struct ring *ring)
+{
+    atomic_fetch_sub_explicit(&ring->producers, 1, memory_order_release);
+}
@@ -0,0 +1,59 @@
+#ifndef APSC143__RING_H
+#define APSC143__RING_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// one slot of the ring. sequence says whose turn the slot is: a producer may fill it when it equals
+// the enqueue position, a consumer may empty it when it equals the position + 1
+struct ring_cell
+{
+    atomic_size_t sequence;
+    void *item;
+};
+
+// Bounded lock-free queue of pointers for any number of producers and
+// consumers (Vyukov's MPMC design: one compare-and-swap per push or pop, no
+// locks, and producers and consumers only meet on the slot they hand over).
+// Single producer / single consumer use is just the special case.
+struct ring
+{
+    struct ring_cell *cells;
+    size_t mask; // capacity - 1, the capacity is a power of two
+
+    // the two ends live on their own cache lines so producers and consumers don't fight over one
+    alignas(64) atomic_size_t head; // next position to push to
+    alignas(64) atomic_size_t tail; // next position to pop from
+
+    // how busy the queue was, for the pipeline statistics
+    alignas(64) atomic_ullong pushes;
+    atomic_ullong depth_total; // queue depth seen by each push, summed
+    atomic_size_t depth_max;
+    atomic_ullong full_waits;  // times a producer found it full and had to wait
+    atomic_ullong empty_waits; // times a consumer found it empty and had to wait
+
+    // producers that haven't called ring_close yet. consumers stop once this is 0 and the queue is empty
+    atomic_int producers;
+};
+
+// capacity is rounded up to a power of two. Returns false if the memory isn't available.
+bool ring_init(struct ring *ring, size_t capacity, int producers);
+void ring_free(struct ring *ring);
+
+// Non-blocking versions, false if the ring is full / empty.
+bool ring_try_push(struct ring *ring, void *item);
+bool ring_try_pop(struct ring *ring, void **item);
+
+// Push, yielding the processor while the ring is full.
+void ring_push(struct ring *ring, void *item);
+// Pop, yielding while the ring is empty. Returns false once every producer has
+// closed the ring and nothing is left in it.
+bool ring_pop(struct ring *ring, void **item);
+// One producer is done.
+void ring_close(struct ring *ring);
+
+size_t ring_capacity(const struct ring *ring);
+
+#endif
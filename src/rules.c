@@ -0,0 +1,318 @@
+#include "rules.h"
+
+// the 8 directions out from a square, diagonal ones are the ones where both steps are non zero
+static const int direction_rows[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+static const int direction_cols[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+
+static const int knight_offsets[8][2] = {{-2, -1}, {-2, 1}, {-1, -2}, {-1, 2}, {1, -2}, {1, 2}, {2, -1}, {2, 1}};
+
+// everything we need to know up front to throw away illegal moves without playing them
+struct legality
+{
+    int checkers;         // how many enemy pieces are giving check
+    uint64_t check_mask;  // squares a non king move must land on: the checker or a square between it and the king
+    uint64_t king_danger; // squares the king can't step to, including squares behind it on a checking line
+    uint64_t pinned;      // our pieces that are pinned against the king
+    int pin_count;
+    int pin_square[8];    // square index of each pinned piece
+    uint64_t pin_ray[8];  // squares that pinned piece may still move to (towards the king or onto the pinner)
+};
+
+static bool rules_in_bounds(int row, int col)
+{
+    return row >= 0 && row < BOARD_SIZE && col >= 0 && col < BOARD_SIZE;
+}
+
+// can this piece slide along the given direction?
+static bool rules_slides_along(enum chess_piece piece, int row_step, int col_step)
+{
+    bool diagonal = (row_step != 0 && col_step != 0);
+    if (piece == PIECE_QUEEN)
+    {
+        return true;
+    }
+    return diagonal ? (piece == PIECE_BISHOP) : (piece == PIECE_ROOK);
+}
+
+BOARD_SPECIALISE void rules_compute_legality(const struct chess_board *board, struct legality *legality, const enum chess_player player)
+{
+    const enum chess_player opponent = BOARD_OPPONENT(player);
+
+    legality->checkers = 0;
+    legality->check_mask = ~(uint64_t)0;
+    legality->king_danger = board->attacks[opponent];
+    legality->pinned = 0;
+    legality->pin_count = 0;
+
+    int king_row = board->king_row[player];
+    int king_col = board->king_col[player];
+    if (king_row < 0) // no king means no checks and no pins
+    {
+        return;
+    }
+
+    uint64_t block_mask = 0; // squares that resolve the check(s)
+
+    // walk out from the king in every direction looking for sliding checkers and pins
+    for (int direction = 0; direction < 8; direction++)
+    {
+        int row_step = direction_rows[direction];
+        int col_step = direction_cols[direction];
+        int row = king_row + row_step;
+        int col = king_col + col_step;
+        int own_square = -1; // the first of our own pieces on this line, if any
+        uint64_t ray = 0;
+
+        while (rules_in_bounds(row, col))
+        {
+            ray |= BOARD_SQUARE_BIT(row, col);
+            const struct square *square = &board->squares[row][col];
+
+            if (square->has_piece)
+            {
+                if (square->owner == player)
+                {
+                    if (own_square >= 0) // two of our pieces shield the king, nothing to see here
+                    {
+                        break;
+                    }
+                    own_square = row * BOARD_SIZE + col;
+                }
+                else
+                {
+                    if (rules_slides_along(square->piece, row_step, col_step))
+                    {
+                        if (own_square < 0) // nothing in between, it's a check
+                        {
+                            legality->checkers++;
+                            block_mask |= ray;
+
+                            // the king blocks its own line of fire today, but stepping back along it is still check
+                            if (rules_in_bounds(king_row - row_step, king_col - col_step))
+                            {
+                                legality->king_danger |= BOARD_SQUARE_BIT(king_row - row_step, king_col - col_step);
+                            }
+                        }
+                        else // exactly one of our pieces in the way, it's pinned to this ray
+                        {
+                            legality->pinned |= (uint64_t)1 << own_square;
+                            legality->pin_square[legality->pin_count] = own_square;
+                            legality->pin_ray[legality->pin_count] = ray;
+                            legality->pin_count++;
+                        }
+                    }
+                    break;
+                }
+            }
+
+            row += row_step;
+            col += col_step;
+        }
+    }
+
+    // knights giving check
+    for (int i = 0; i < 8; i++)
+    {
+        int row = king_row + knight_offsets[i][0];
+        int col = king_col + knight_offsets[i][1];
+        if (!rules_in_bounds(row, col))
+        {
+            continue;
+        }
+        const struct square *square = &board->squares[row][col];
+        if (square->has_piece && square->owner == opponent && square->piece == PIECE_KNIGHT)
+        {
+            legality->checkers++;
+            block_mask |= BOARD_SQUARE_BIT(row, col);
+        }
+    }
+
+    // pawns giving check sit where one of our pawns on the king's square would capture
+    uint64_t pawn_checkers = board_pawn_attacks(BOARD_SQUARE_BIT(king_row, king_col), player) & board->pieces[opponent][PIECE_PAWN];
+    legality->checkers += board_count_squares(pawn_checkers);
+    block_mask |= pawn_checkers;
+
+    if (legality->checkers == 1)
+    {
+        legality->check_mask = block_mask;
+    }
+    else if (legality->checkers > 1) // double check, only the king can move
+    {
+        legality->check_mask = 0;
+    }
+}
+
+// squares a pawn can push to (captures come from its attack set)
+BOARD_SPECIALISE uint64_t rules_pawn_pushes(const struct chess_board *board, int row, int col, const enum chess_player player)
+{
+    const int forward_direction = BOARD_FORWARD(player);
+    const int start_row_index = BOARD_PAWN_START_ROW(player);
+    uint64_t pushes = 0;
+
+    int one_row = row + forward_direction;
+    if (one_row < 0 || one_row >= BOARD_SIZE || board->squares[one_row][col].has_piece)
+    {
+        return 0;
+    }
+    pushes |= BOARD_SQUARE_BIT(one_row, col);
+
+    int two_row = one_row + forward_direction;
+    if (row == start_row_index && !board->squares[two_row][col].has_piece)
+    {
+        pushes |= BOARD_SQUARE_BIT(two_row, col);
+    }
+
+    return pushes;
+}
+
+// appends one move (or all four promotions of it) to the list and returns the new count
+BOARD_SPECIALISE int rules_add_move(const struct chess_board *board, struct chess_move *moves, int count, int from_row, int from_col, int to_row, int to_col, const enum chess_player player)
+{
+    static const enum chess_piece promotions[4] = {PIECE_QUEEN, PIECE_KNIGHT, PIECE_ROOK, PIECE_BISHOP};
+
+    const struct square *src = &board->squares[from_row][from_col];
+    const struct square *dst = &board->squares[to_row][to_col];
+
+    struct chess_move move = {0}; // anti garbage
+    move.player = player;
+    move.piece_type = src->piece;
+    move.from_row = from_row;
+    move.from_col = from_col;
+    move.to_row = to_row;
+    move.to_col = to_col;
+    move.is_capture = dst->has_piece && dst->owner != player;
+    move.is_castle = false;
+    move.is_promotion = false;
+    move.promo_piece = PIECE_QUEEN;
+
+    if (move.piece_type == PIECE_PAWN && to_row == BOARD_PROMOTION_ROW(player))
+    {
+        move.is_promotion = true;
+        for (int i = 0; i < 4; i++) // queen first so it wins ties when moves are scored
+        {
+            move.promo_piece = promotions[i];
+            moves[count++] = move;
+        }
+        return count;
+    }
+
+    moves[count++] = move;
+    return count;
+}
+
+// shared by the full and captures only generators, instantiated once per colour by rules_generate
+BOARD_SPECIALISE int rules_generate_as(const struct chess_board *board, struct chess_move *moves, bool captures_only, const enum chess_player player)
+{
+    const enum chess_player opponent = BOARD_OPPONENT(player);
+
+    struct legality legality;
+    rules_compute_legality(board, &legality, player);
+
+    int count = 0;
+
+    // castling first, board_can_castle already refuses when in check or passing through attacked squares
+    if (legality.checkers == 0 && !captures_only)
+    {
+        for (int side = 0; side < 2; side++)
+        {
+            bool kingside = (side == 0);
+            if (!board_can_castle(board, kingside))
+            {
+                continue;
+            }
+
+            const int row = BOARD_BACK_ROW(player);
+            struct chess_move move = {0};
+            move.player = player;
+            move.piece_type = PIECE_KING;
+            move.from_row = row;
+            move.from_col = 4;
+            move.to_row = row;
+            move.to_col = kingside ? 6 : 2;
+            move.is_castle = true;
+            move.castle_kingside = kingside;
+            moves[count++] = move;
+        }
+    }
+
+    uint64_t pieces = board->occupied[player];
+    while (pieces)
+    {
+        int from = board_lowest_square(pieces);
+        pieces &= pieces - 1;
+
+        int from_row = from / BOARD_SIZE;
+        int from_col = from % BOARD_SIZE;
+        const struct square *src = &board->squares[from_row][from_col];
+
+        uint64_t targets;
+        if (src->piece == PIECE_KING)
+        {
+            targets = board_piece_attacks(board, from_row, from_col) & ~board->occupied[player] & ~legality.king_danger;
+        }
+        else
+        {
+            if (legality.checkers > 1) // only the king can answer a double check
+            {
+                continue;
+            }
+
+            if (src->piece == PIECE_PAWN)
+            {
+                targets = (board_pawn_attacks((uint64_t)1 << from, player) & board->occupied[opponent]) | rules_pawn_pushes(board, from_row, from_col, player);
+            }
+            else
+            {
+                targets = board_piece_attacks(board, from_row, from_col) & ~board->occupied[player];
+            }
+
+            targets &= legality.check_mask;
+
+            if (legality.pinned & ((uint64_t)1 << from)) // a pinned piece can only slide along its pin
+            {
+                for (int i = 0; i < legality.pin_count; i++)
+                {
+                    if (legality.pin_square[i] == from)
+                    {
+                        targets &= legality.pin_ray[i];
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (captures_only) // keep captures, and pawn pushes that promote
+        {
+            const uint64_t promotion_rank = 0xFFull << (BOARD_PROMOTION_ROW(player) * BOARD_SIZE);
+            targets &= (src->piece == PIECE_PAWN) ? (board->occupied[opponent] | promotion_rank) : board->occupied[opponent];
+        }
+
+        while (targets)
+        {
+            int to = board_lowest_square(targets);
+            targets &= targets - 1;
+            count = rules_add_move(board, moves, count, from_row, from_col, to / BOARD_SIZE, to % BOARD_SIZE, player);
+        }
+    }
+
+    return count;
+}
+
+static int rules_generate(const struct chess_board *board, struct chess_move *moves, bool captures_only)
+{
+    if (board->next_move_player == PLAYER_WHITE)
+    {
+        return rules_generate_as(board, moves, captures_only, PLAYER_WHITE);
+    }
+    return rules_generate_as(board, moves, captures_only, PLAYER_BLACK);
+}
+
+int rules_generate_legal_moves(const struct chess_board *board, struct chess_move *moves)
+{
+    return rules_generate(board, moves, false);
+}
+
+int rules_generate_legal_captures(const struct chess_board *board, struct chess_move *moves)
+{
+    return rules_generate(board, moves, true);
+}
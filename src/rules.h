@@ -0,0 +1,22 @@
+#ifndef APSC143__RULES_H
+#define APSC143__RULES_H
+
+#include <stdbool.h>
+#include "board.h"
+
+// no chess position has more than 218 legal moves, so this is always enough room
+#define RULES_MAX_MOVES 256
+
+// Fills moves with every strictly legal move for board->next_move_player and
+// returns how many there are. Moves are complete (source, capture, promotion
+// and castling fields are all set) and can be passed straight to
+// board_apply_move. Legality is worked out up front from the pinned pieces and
+// the squares that block or capture a checking piece, so no move ever has to be
+// tried on a copy of the board. The moves array needs RULES_MAX_MOVES entries.
+int rules_generate_legal_moves(const struct chess_board *board, struct chess_move *moves);
+
+// Same as rules_generate_legal_moves but only emits captures and promotions,
+// the moves a quiescence search looks at.
+int rules_generate_legal_captures(const struct chess_board *board, struct chess_move *moves);
+
+#endif
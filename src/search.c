@@ -0,0 +1,1100 @@
+#include "search.h"
+#include "rules.h"
+#include "eval.h"
+#include "tablebase.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// move ordering bands, higher is tried first
+#define ORDER_HASH_MOVE 1000000000
+#define ORDER_CAPTURE 100000000
+#define ORDER_KILLER 90000000
+#define ORDER_HISTORY_MAX 80000000
+
+// null move and late move reduction only kick in with at least this much depth left to reduce
+#define NULL_MOVE_MIN_DEPTH 3
+#define LMR_MIN_DEPTH 3
+// the first moves, hash move and captures and killers included, are always searched at full depth
+#define LMR_FULL_DEPTH_MOVES 3
+// how far below alpha a frontier node's static evaluation has to be before its quiet moves are skipped
+#define FUTILITY_MARGIN 200
+
+// a transposition table entry unpacked, see search_tt_entry
+struct search_tt_data
+{
+    uint16_t move;
+    int16_t score;
+    int8_t depth;
+    uint8_t bound;
+};
+
+// piece values used when trading pieces off in search_see (pawn, knight, bishop, rook, queen, king)
+static const int see_value[6] = {100, 320, 330, 500, 900, 20000};
+
+static const int see_knight_offsets[8][2] = {{-2, -1}, {-2, 1}, {-1, -2}, {-1, 2}, {1, -2}, {1, 2}, {2, -1}, {2, 1}};
+static const int see_direction_rows[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+static const int see_direction_cols[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+
+static bool see_in_bounds(int row, int col)
+{
+    return row >= 0 && row < BOARD_SIZE && col >= 0 && col < BOARD_SIZE;
+}
+
+// is there a piece of this type and colour on (row, col) that hasn't been traded off yet?
+static bool see_piece_at(const struct chess_board *board, uint64_t occupied, int row, int col, enum chess_player player, enum chess_piece piece)
+{
+    if (!see_in_bounds(row, col) || !(occupied & BOARD_SQUARE_BIT(row, col)))
+    {
+        return false;
+    }
+    const struct square *square = &board->squares[row][col];
+    return square->owner == player && square->piece == piece;
+}
+
+// finds player's least valuable piece still in occupied that attacks (row, col). returns its square
+// index or -1, and stores the piece type in *piece. sliders are found by walking out from the target
+// through the pieces already traded off, so x-ray attackers line up behind the first one naturally
+static int see_least_valuable_attacker(const struct chess_board *board, uint64_t occupied, int row, int col, enum chess_player player, enum chess_piece *piece)
+{
+    // pawns attack diagonally forward, so our pawns sit one row behind the target
+    int pawn_row = row - ((player == PLAYER_WHITE) ? -1 : +1);
+    for (int col_step = -1; col_step <= 1; col_step += 2)
+    {
+        if (see_piece_at(board, occupied, pawn_row, col + col_step, player, PIECE_PAWN))
+        {
+            *piece = PIECE_PAWN;
+            return pawn_row * BOARD_SIZE + col + col_step;
+        }
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        int from_row = row + see_knight_offsets[i][0];
+        int from_col = col + see_knight_offsets[i][1];
+        if (see_piece_at(board, occupied, from_row, from_col, player, PIECE_KNIGHT))
+        {
+            *piece = PIECE_KNIGHT;
+            return from_row * BOARD_SIZE + from_col;
+        }
+    }
+
+    // first piece along each line, keep the cheapest slider that can use that line
+    int best_square = -1;
+    enum chess_piece best_piece = PIECE_KING;
+    for (int direction = 0; direction < 8; direction++)
+    {
+        int row_step = see_direction_rows[direction];
+        int col_step = see_direction_cols[direction];
+        bool diagonal = (row_step != 0 && col_step != 0);
+        int from_row = row + row_step;
+        int from_col = col + col_step;
+
+        while (see_in_bounds(from_row, from_col) && !(occupied & BOARD_SQUARE_BIT(from_row, from_col)))
+        {
+            from_row += row_step;
+            from_col += col_step;
+        }
+        if (!see_in_bounds(from_row, from_col))
+        {
+            continue;
+        }
+
+        const struct square *square = &board->squares[from_row][from_col];
+        if (square->owner != player)
+        {
+            continue;
+        }
+
+        bool can_slide = square->piece == PIECE_QUEEN || (diagonal ? square->piece == PIECE_BISHOP : square->piece == PIECE_ROOK);
+        if (can_slide && (best_square < 0 || see_value[square->piece] < see_value[best_piece]))
+        {
+            best_square = from_row * BOARD_SIZE + from_col;
+            best_piece = square->piece;
+        }
+    }
+    if (best_square >= 0)
+    {
+        *piece = best_piece;
+        return best_square;
+    }
+
+    int king_row = board->king_row[player];
+    int king_col = board->king_col[player];
+    if (king_row >= 0 && (occupied & BOARD_SQUARE_BIT(king_row, king_col)) && get_absolute_value(king_row - row) <= 1 && get_absolute_value(king_col - col) <= 1)
+    {
+        *piece = PIECE_KING;
+        return king_row * BOARD_SIZE + king_col;
+    }
+
+    return -1;
+}
+
+int search_see(const struct chess_board *board, const struct chess_move *move)
+{
+    const struct square *victim = &board->squares[move->to_row][move->to_col];
+    int gain[40];
+    int depth = 0;
+
+    uint64_t occupied = board->occupied[PLAYER_WHITE] | board->occupied[PLAYER_BLACK];
+    occupied &= ~BOARD_SQUARE_BIT(move->from_row, move->from_col);
+
+    gain[0] = move->is_capture ? see_value[victim->piece] : 0;
+    enum chess_piece on_square = move->piece_type; // the piece that would be captured next
+    enum chess_player side = move->player;
+
+    while (depth < 38)
+    {
+        depth++;
+        side = (side == PLAYER_WHITE) ? PLAYER_BLACK : PLAYER_WHITE;
+        gain[depth] = see_value[on_square] - gain[depth - 1]; // what side gains by taking back
+
+        // neither continuing nor stopping can change the outcome any more
+        if ((-gain[depth - 1] > gain[depth] ? -gain[depth - 1] : gain[depth]) < 0)
+        {
+            break;
+        }
+
+        enum chess_piece attacker;
+        int attacker_square = see_least_valuable_attacker(board, occupied, move->to_row, move->to_col, side, &attacker);
+        if (attacker_square < 0)
+        {
+            break;
+        }
+
+        occupied &= ~((uint64_t)1 << attacker_square);
+        on_square = attacker;
+    }
+
+    // work back up: each side only recaptures if it's worth it
+    while (--depth)
+    {
+        int stop = -gain[depth - 1];
+        gain[depth - 1] = -(stop > gain[depth] ? stop : gain[depth]);
+    }
+
+    return gain[0];
+}
+
+bool search_context_init(struct search_context *context, size_t table_mb)
+{
+    size_t wanted = table_mb * 1024 * 1024 / sizeof(struct search_tt_entry);
+    size_t entries = 1;
+    while (entries * 2 <= wanted) // round down to a power of two so indexing is a mask
+    {
+        entries *= 2;
+    }
+
+    memset(context, 0, sizeof(*context));
+    atomic_init(&context->stop, false);
+    context->pruning.null_move = true;
+    context->pruning.late_move_reductions = true;
+    context->pruning.futility = true;
+    context->multi_pv = 1;
+    context->table = calloc(entries, sizeof(struct search_tt_entry));
+    context->frames = malloc((SEARCH_MAX_PLY + 1) * sizeof(struct search_frame));
+    if (context->table == NULL || context->frames == NULL || !history_init(&context->path, SEARCH_GAME_PLIES + SEARCH_MAX_PLY + 1) ||
+        !pawns_cache_init(&context->pawns, PAWNS_CACHE_ENTRIES))
+    {
+        search_context_free(context);
+        return false;
+    }
+    context->table_size = entries;
+    return true;
+}
+
+static void search_free_helpers(struct search_context *context)
+{
+    for (int i = 0; i < context->helper_count; i++)
+    {
+        search_context_free(&context->helpers[i]);
+    }
+    free(context->helpers);
+    context->helpers = NULL;
+    context->helper_count = 0;
+}
+
+void search_context_free(struct search_context *context)
+{
+    search_free_helpers(context);
+    if (!context->shared_table)
+    {
+        free(context->table);
+    }
+    free(context->frames);
+    history_free(&context->path);
+    pawns_cache_free(&context->pawns);
+    context->table = NULL;
+    context->frames = NULL;
+    context->table_size = 0;
+}
+
+void search_context_clear(struct search_context *context)
+{
+    if (!context->shared_table)
+    {
+        memset(context->table, 0, context->table_size * sizeof(struct search_tt_entry));
+    }
+    memset(context->killers, 0, sizeof(context->killers));
+    memset(context->history, 0, sizeof(context->history));
+    memset(&context->stats, 0, sizeof(context->stats));
+    pawns_cache_clear(&context->pawns);
+    for (int i = 0; i < context->helper_count; i++)
+    {
+        search_context_clear(&context->helpers[i]);
+    }
+}
+
+void search_context_set_weights(struct search_context *context, const struct eval_weights *weights)
+{
+    uint64_t key = eval_weights_key(weights);
+    if (key != context->weights_key)
+    {
+        search_context_clear(context); // the table's scores were worked out with the old ones
+    }
+    context->weights = weights;
+    context->weights_key = key;
+}
+
+bool search_context_set_threads(struct search_context *context, int threads)
+{
+    search_free_helpers(context);
+    if (threads > SEARCH_MAX_THREADS)
+    {
+        threads = SEARCH_MAX_THREADS;
+    }
+    if (threads <= 1)
+    {
+        return true;
+    }
+
+    context->helpers = calloc((size_t)(threads - 1), sizeof(struct search_context));
+    if (context->helpers == NULL)
+    {
+        return false;
+    }
+    for (int i = 0; i < threads - 1; i++)
+    {
+        // everything of its own except the table
+        struct search_context *helper = &context->helpers[i];
+        atomic_init(&helper->stop, false);
+        helper->table = context->table;
+        helper->table_size = context->table_size;
+        helper->shared_table = true;
+        helper->frames = malloc((SEARCH_MAX_PLY + 1) * sizeof(struct search_frame));
+        context->helper_count++;
+        if (helper->frames == NULL || !history_init(&helper->path, SEARCH_GAME_PLIES + SEARCH_MAX_PLY + 1) ||
+            !pawns_cache_init(&helper->pawns, PAWNS_CACHE_ENTRIES))
+        {
+            search_free_helpers(context);
+            return false;
+        }
+    }
+    return true;
+}
+
+uint16_t search_pack_move(const struct chess_move *move)
+{
+    int from = move->from_row * BOARD_SIZE + move->from_col;
+    int to = move->to_row * BOARD_SIZE + move->to_col;
+    uint16_t packed = (uint16_t)(from | to << 6);
+    if (move->is_promotion)
+    {
+        packed |= (uint16_t)(0x8000 | move->promo_piece << 12);
+    }
+    return packed; // from != to, so a real move is never 0
+}
+
+static bool search_tt_probe(const struct search_context *context, uint64_t key, struct search_tt_data *found)
+{
+    struct search_tt_entry *entry = &context->table[key & (context->table_size - 1)];
+    uint64_t data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+    uint64_t check = atomic_load_explicit(&entry->check, memory_order_relaxed);
+    if ((check ^ data) != key)
+    {
+        return false;
+    }
+    found->move = (uint16_t)data;
+    found->score = (int16_t)(uint16_t)(data >> 16);
+    found->depth = (int8_t)(uint8_t)(data >> 32);
+    found->bound = (uint8_t)(data >> 40);
+    return found->bound != SEARCH_BOUND_NONE;
+}
+
+static void search_tt_store(struct search_context *context, uint64_t key, const struct search_tt_data *stored)
+{
+    struct search_tt_entry *entry = &context->table[key & (context->table_size - 1)];
+    uint64_t data = (uint64_t)stored->move | (uint64_t)(uint16_t)stored->score << 16 | (uint64_t)(uint8_t)stored->depth << 32 | (uint64_t)stored->bound << 40;
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+    atomic_store_explicit(&entry->check, data ^ key, memory_order_relaxed);
+}
+
+// mate scores are stored relative to the node so they stay right when reached by a different path
+static int search_score_to_table(int score, int ply)
+{
+    if (score >= SEARCH_MATE - SEARCH_MAX_PLY)
+    {
+        return score + ply;
+    }
+    if (score <= -SEARCH_MATE + SEARCH_MAX_PLY)
+    {
+        return score - ply;
+    }
+    return score;
+}
+
+static int search_score_from_table(int score, int ply)
+{
+    if (score >= SEARCH_MATE - SEARCH_MAX_PLY)
+    {
+        return score - ply;
+    }
+    if (score <= -SEARCH_MATE + SEARCH_MAX_PLY)
+    {
+        return score + ply;
+    }
+    return score;
+}
+
+// a tablebase answer as a search score at this ply
+static int search_tablebase_score(enum tablebase_outcome outcome, int plies, int ply)
+{
+    switch (outcome)
+    {
+    case TABLEBASE_OUTCOME_WIN:
+        return SEARCH_MATE - (ply + plies);
+    case TABLEBASE_OUTCOME_LOSS:
+        return -SEARCH_MATE + (ply + plies);
+    default:
+        return 0;
+    }
+}
+
+// gives each move an ordering score: hash move, captures (most valuable victim, least valuable
+// attacker), killers, then quiet moves by how often they caused cutoffs before
+static void search_score_moves(const struct search_context *context, const struct chess_board *board, const struct chess_move *moves, int count, uint16_t hash_move, int ply, int *scores)
+{
+    for (int i = 0; i < count; i++)
+    {
+        const struct chess_move *move = &moves[i];
+        uint16_t packed = search_pack_move(move);
+
+        if (packed == hash_move)
+        {
+            scores[i] = ORDER_HASH_MOVE;
+        }
+        else if (move->is_capture || move->is_promotion)
+        {
+            int victim = move->is_capture ? see_value[board->squares[move->to_row][move->to_col].piece] : 0;
+            int promotion = move->is_promotion ? see_value[move->promo_piece] : 0;
+            scores[i] = ORDER_CAPTURE + (victim + promotion) * 8 - see_value[move->piece_type] / 100;
+        }
+        else if (packed == context->killers[ply][0] || packed == context->killers[ply][1])
+        {
+            scores[i] = (packed == context->killers[ply][0]) ? ORDER_KILLER + 1 : ORDER_KILLER;
+        }
+        else
+        {
+            int from = move->from_row * BOARD_SIZE + move->from_col;
+            int to = move->to_row * BOARD_SIZE + move->to_col;
+            scores[i] = context->history[move->player][from][to];
+        }
+    }
+}
+
+// selection sort one step at a time: we usually cut off long before the list is sorted
+static void search_pick_move(struct chess_move *moves, int *scores, int count, int index)
+{
+    int best = index;
+    for (int i = index + 1; i < count; i++)
+    {
+        if (scores[i] > scores[best])
+        {
+            best = i;
+        }
+    }
+    if (best != index)
+    {
+        struct chess_move move = moves[index];
+        moves[index] = moves[best];
+        moves[best] = move;
+
+        int score = scores[index];
+        scores[index] = scores[best];
+        scores[best] = score;
+    }
+}
+
+// a quiet move refuted this node: remember it for sibling nodes at the same ply and give it history credit
+static void search_note_cutoff(struct search_context *context, const struct chess_move *move, int depth, int ply)
+{
+    uint16_t packed = search_pack_move(move);
+    if (context->killers[ply][0] != packed)
+    {
+        context->killers[ply][1] = context->killers[ply][0];
+        context->killers[ply][0] = packed;
+    }
+
+    int from = move->from_row * BOARD_SIZE + move->from_col;
+    int to = move->to_row * BOARD_SIZE + move->to_col;
+    int *history = &context->history[move->player][from][to];
+    *history += depth * depth;
+
+    if (*history > ORDER_HISTORY_MAX) // keep history below the killers, halve everything when it gets big
+    {
+        for (int player = 0; player < 2; player++)
+        {
+            for (int i = 0; i < 64; i++)
+            {
+                for (int j = 0; j < 64; j++)
+                {
+                    context->history[player][i][j] /= 2;
+                }
+            }
+        }
+    }
+}
+
+long long search_now_ms(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+unsigned long long search_now_ns(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (unsigned long long)now.tv_sec * 1000000000ull + (unsigned long long)now.tv_nsec;
+}
+
+// true once someone asked us to stop or the deadline passed. the clock is only read every few
+// thousand nodes, and once set the flag sticks so every level of the search unwinds quickly
+static bool search_should_stop(struct search_context *context)
+{
+    if (context->aborted)
+    {
+        return true;
+    }
+    if (((context->stats.nodes + context->stats.qnodes) & 2047) == 0)
+    {
+        if (atomic_load(&context->stop) || (context->deadline_ms != 0 && search_now_ms() >= context->deadline_ms))
+        {
+            context->aborted = true;
+        }
+    }
+    return context->aborted;
+}
+
+// the static evaluation at the leaves: eval_board's running totals plus the pawn structure terms,
+// which come from the pawn cache nearly every time
+static int search_evaluate(struct search_context *context, const struct chess_board *board)
+{
+    int mg = board->eval_mg, eg = board->eval_eg;
+    if (pawns_probe(&context->pawns, board, &mg, &eg))
+    {
+        context->stats.pawn_hits++;
+    }
+    else
+    {
+        context->stats.pawn_misses++;
+    }
+    return eval_blend(mg, eg, board->eval_phase, board->next_move_player);
+}
+
+int search_quiescence(struct search_context *context, const struct chess_board *board, int alpha, int beta, int ply)
+{
+    context->stats.qnodes++;
+
+    if (search_should_stop(context))
+    {
+        return 0;
+    }
+    if (ply >= SEARCH_MAX_PLY) // runaway check sequences, just call it here
+    {
+        return search_evaluate(context, board);
+    }
+
+    bool in_check = board_in_check(board);
+    struct search_frame *frame = &context->frames[ply];
+    struct chess_move *moves = frame->moves;
+    int *scores = frame->scores;
+    int move_count;
+
+    if (in_check) // no standing pat in check, every evasion has to be looked at
+    {
+        move_count = rules_generate_legal_moves(board, moves);
+        if (move_count == 0)
+        {
+            return -SEARCH_MATE + ply;
+        }
+    }
+    else
+    {
+        int stand_pat = search_evaluate(context, board);
+        if (stand_pat >= beta)
+        {
+            return stand_pat;
+        }
+        if (stand_pat > alpha)
+        {
+            alpha = stand_pat;
+        }
+        move_count = rules_generate_legal_captures(board, moves);
+    }
+
+    search_score_moves(context, board, moves, move_count, 0, ply, scores);
+
+    for (int i = 0; i < move_count; i++)
+    {
+        search_pick_move(moves, scores, move_count, i);
+
+        // a capture that loses material can't raise alpha above standing pat, don't bother
+        if (!in_check && moves[i].is_capture && search_see(board, &moves[i]) < 0)
+        {
+            continue;
+        }
+
+        struct chess_board *child = &frame->child;
+        *child = *board;
+        board_apply_move(child, &moves[i]);
+
+        int score = -search_quiescence(context, child, -beta, -alpha, ply + 1);
+        if (score >= beta)
+        {
+            return score;
+        }
+        if (score > alpha)
+        {
+            alpha = score;
+        }
+    }
+
+    return alpha;
+}
+
+// does player have anything besides pawns and the king? without, passing is often the best move
+// there is (zugzwang) and the null move would lie
+static bool search_has_pieces(const struct chess_board *board, enum chess_player player)
+{
+    const uint64_t *pieces = board->pieces[player];
+    return (pieces[PIECE_KNIGHT] | pieces[PIECE_BISHOP] | pieces[PIECE_ROOK] | pieces[PIECE_QUEEN]) != 0;
+}
+
+static bool search_is_mate_score(int score)
+{
+    return score >= SEARCH_MATE - SEARCH_MAX_PLY || score <= -SEARCH_MATE + SEARCH_MAX_PLY;
+}
+
+int search_mate_moves(int score)
+{
+    if (!search_is_mate_score(score))
+    {
+        return 0;
+    }
+    int plies = SEARCH_MATE - get_absolute_value(score);
+    return score > 0 ? (plies + 1) / 2 : -((plies + 1) / 2);
+}
+
+// allow_null is false right after a null move, two in a row would just hand the move back
+static int search_alpha_beta(struct search_context *context, const struct chess_board *board, int depth, int alpha, int beta, int ply, struct chess_move *best_move, bool allow_null)
+{
+    if (depth <= 0)
+    {
+        return search_quiescence(context, board, alpha, beta, ply);
+    }
+    if (ply >= SEARCH_MAX_PLY)
+    {
+        return search_evaluate(context, board);
+    }
+
+    context->stats.nodes++;
+
+    if (search_should_stop(context))
+    {
+        return 0;
+    }
+    // before the table, whose entry may come from the same position reached without the repetition
+    if (ply > 0 && (history_search_repetition(&context->path, context->path_root) || history_fifty_moves(&context->path)))
+    {
+        return 0;
+    }
+
+    enum tablebase_outcome outcome;
+    int plies;
+    if (ply > 0 && context->tablebase != NULL && tablebase_probe(context->tablebase, board, &outcome, &plies)) // perfect answer, nothing to search
+    {
+        return search_tablebase_score(outcome, plies, ply);
+    }
+
+    int original_alpha = alpha;
+    struct search_tt_data entry = {0}; // only read when found, but the compiler can't always tell
+    bool found = search_tt_probe(context, board->hash, &entry);
+    uint16_t hash_move = 0;
+
+    if (found)
+    {
+        context->stats.tt_hits++;
+        hash_move = entry.move;
+
+        if (ply > 0 && entry.depth >= depth) // the root always searches so it has a move to report
+        {
+            int score = search_score_from_table(entry.score, ply);
+            if (entry.bound == SEARCH_BOUND_EXACT || (entry.bound == SEARCH_BOUND_LOWER && score >= beta) || (entry.bound == SEARCH_BOUND_UPPER && score <= alpha))
+            {
+                return score;
+            }
+        }
+    }
+
+    struct search_frame *frame = &context->frames[ply];
+    const struct search_pruning *pruning = &context->pruning;
+    bool in_check = board_in_check(board);
+    int static_eval = (!in_check && (pruning->null_move || pruning->futility)) ? search_evaluate(context, board) : 0;
+
+    if (pruning->null_move && allow_null && ply > 0 && !in_check && depth >= NULL_MOVE_MIN_DEPTH && !search_is_mate_score(beta) && static_eval >= beta && search_has_pieces(board, board->next_move_player))
+    {
+        frame->child = *board;
+        board_apply_null_move(&frame->child);
+        int reduction = (depth >= 6) ? 3 : 2;
+        history_push_null(&context->path, &frame->child);
+        int score = -search_alpha_beta(context, &frame->child, depth - 1 - reduction, -beta, -beta + 1, ply + 1, NULL, false);
+        history_pop(&context->path);
+        if (context->aborted)
+        {
+            return 0;
+        }
+        if (score >= beta)
+        {
+            context->stats.null_move_cutoffs++;
+            return beta; // a mate found after passing isn't a real one
+        }
+    }
+
+    struct chess_move *moves = frame->moves;
+    int *scores = frame->scores;
+    int move_count = rules_generate_legal_moves(board, moves);
+
+    if (move_count == 0)
+    {
+        return in_check ? -SEARCH_MATE + ply : 0; // checkmate or stalemate
+    }
+
+    search_score_moves(context, board, moves, move_count, hash_move, ply, scores);
+
+    bool futile = pruning->futility && depth == 1 && ply > 0 && !in_check && !search_is_mate_score(alpha) && static_eval + FUTILITY_MARGIN <= alpha;
+
+    int best_score = -SEARCH_INFINITY;
+    uint16_t best_packed = 0;
+
+    for (int i = 0; i < move_count; i++)
+    {
+        search_pick_move(moves, scores, move_count, i);
+        const struct chess_move *move = &moves[i];
+
+        struct chess_board *child = &frame->child;
+        *child = *board;
+        board_apply_move(child, move);
+
+        bool quiet = !move->is_capture && !move->is_promotion;
+        bool reducible = pruning->late_move_reductions && depth >= LMR_MIN_DEPTH && i >= LMR_FULL_DEPTH_MOVES && scores[i] < ORDER_KILLER && !in_check;
+        bool gives_check = quiet && (futile || reducible) && board_in_check(child);
+
+        if (futile && quiet && !gives_check)
+        {
+            context->stats.futility_prunes++;
+            if (static_eval + FUTILITY_MARGIN > best_score) // what the move could be worth at most, still a fail low
+            {
+                best_score = static_eval + FUTILITY_MARGIN;
+            }
+            continue;
+        }
+
+        int score;
+        history_push(&context->path, child, move);
+        if (reducible && quiet && !gives_check)
+        {
+            context->stats.late_move_reductions++;
+            int reduction = (depth >= 5 && i >= 2 * LMR_FULL_DEPTH_MOVES) ? 2 : 1;
+            score = -search_alpha_beta(context, child, depth - 1 - reduction, -alpha - 1, -alpha, ply + 1, NULL, true);
+            if (score > alpha && !context->aborted)
+            {
+                context->stats.late_move_researches++;
+                score = -search_alpha_beta(context, child, depth - 1, -beta, -alpha, ply + 1, NULL, true);
+            }
+        }
+        else
+        {
+            score = -search_alpha_beta(context, child, depth - 1, -beta, -alpha, ply + 1, NULL, true);
+        }
+        history_pop(&context->path);
+        if (context->aborted) // the score is meaningless, and must not reach the table
+        {
+            return 0;
+        }
+
+        if (score > best_score)
+        {
+            best_score = score;
+            best_packed = search_pack_move(move);
+            if (best_move != NULL)
+            {
+                *best_move = *move;
+            }
+        }
+        if (score > alpha)
+        {
+            alpha = score;
+        }
+        if (alpha >= beta)
+        {
+            context->stats.beta_cutoffs++;
+            if (i == 0)
+            {
+                context->stats.first_move_cutoffs++;
+            }
+            if (!move->is_capture && !move->is_promotion)
+            {
+                search_note_cutoff(context, move, depth, ply);
+            }
+            break;
+        }
+    }
+
+    // keep the deeper result when two positions fight over the same slot
+    if (!found || depth >= entry.depth)
+    {
+        entry.move = best_packed;
+        entry.score = (int16_t)search_score_to_table(best_score, ply);
+        entry.depth = (int8_t)depth;
+        entry.bound = (best_score <= original_alpha) ? SEARCH_BOUND_UPPER : (best_score >= beta) ? SEARCH_BOUND_LOWER : SEARCH_BOUND_EXACT;
+        search_tt_store(context, board->hash, &entry);
+    }
+
+    return best_score;
+}
+
+// the multi-PV root. every move is searched, but against the worst line kept so far rather than
+// the best: a move that can't beat it only has to fail low, one that can gets its exact score.
+// returns how many lines are in lines, best first
+static int search_root_lines(struct search_context *context, const struct chess_board *board, int depth, struct search_line *lines, int wanted)
+{
+    context->stats.nodes++;
+
+    struct search_tt_data entry;
+    bool found = search_tt_probe(context, board->hash, &entry);
+    if (found)
+    {
+        context->stats.tt_hits++;
+    }
+
+    struct search_frame *frame = &context->frames[0];
+    struct chess_move *moves = frame->moves;
+    int *scores = frame->scores;
+    int move_count = rules_generate_legal_moves(board, moves);
+    search_score_moves(context, board, moves, move_count, found ? entry.move : 0, 0, scores);
+
+    int count = 0;
+    for (int i = 0; i < move_count; i++)
+    {
+        search_pick_move(moves, scores, move_count, i);
+        const struct chess_move *move = &moves[i];
+
+        struct chess_board *child = &frame->child;
+        *child = *board;
+        board_apply_move(child, move);
+
+        int alpha = (count == wanted) ? lines[count - 1].score : -SEARCH_INFINITY;
+        history_push(&context->path, child, move);
+        int score = -search_alpha_beta(context, child, depth - 1, -SEARCH_INFINITY, -alpha, 1, NULL, true);
+        history_pop(&context->path);
+        if (context->aborted)
+        {
+            return count;
+        }
+        if (score <= alpha)
+        {
+            continue;
+        }
+
+        // insert in order, pushing the worst line out once the list is full
+        int slot = (count < wanted) ? count++ : wanted - 1;
+        while (slot > 0 && lines[slot - 1].score < score)
+        {
+            lines[slot] = lines[slot - 1];
+            slot--;
+        }
+        lines[slot].move = *move;
+        lines[slot].score = score;
+    }
+
+    if (count > 0) // the best line orders the next iteration and gives search_principal_variation its start
+    {
+        entry.move = search_pack_move(&lines[0].move);
+        entry.score = (int16_t)search_score_to_table(lines[0].score, 0);
+        entry.depth = (int8_t)depth;
+        entry.bound = SEARCH_BOUND_EXACT;
+        search_tt_store(context, board->hash, &entry);
+    }
+    return count;
+}
+
+// one thread's share of a search: iterative deepening from first_depth to last_depth
+struct search_job
+{
+    struct search_context *context;
+    const struct chess_board *board;
+    struct chess_move first_move; // reported if not even the first iteration finishes
+    int first_depth, last_depth;
+    int wanted_lines; // 1 for a normal search, more for search_root_lines
+
+    struct search_line lines[SEARCH_MAX_LINES];
+    int line_count;
+    int completed_depth; // deepest iteration that finished, 0 for none
+    pthread_t thread;
+};
+
+static void search_prepare(struct search_context *context, const struct chess_board *board)
+{
+    // the path starts with the game's recent positions, which end at board. there is always room:
+    // the path was made big enough for SEARCH_GAME_PLIES of them and a full depth search
+    if (context->game == NULL || context->game->count == 0)
+    {
+        history_reset(&context->path, board);
+    }
+    else
+    {
+        history_copy_recent(&context->path, context->game, SEARCH_GAME_PLIES + 1);
+    }
+    context->path_root = context->path.count - 1;
+    memset(context->killers, 0, sizeof(context->killers)); // killers are about this position's tree only
+    context->aborted = false;
+    memset(&context->stats, 0, sizeof(context->stats)); // stats describe one search
+}
+
+static void search_iterate(struct search_job *job)
+{
+    struct search_context *context = job->context;
+    job->lines[0].move = job->first_move;
+    job->lines[0].score = 0;
+    job->line_count = 1;
+    job->completed_depth = 0;
+
+    // each iteration leaves its best line in the table, which orders the next (deeper) one
+    for (int current_depth = job->first_depth; current_depth <= job->last_depth; current_depth++)
+    {
+        struct search_line iteration_lines[SEARCH_MAX_LINES];
+        int iteration_count = 1;
+        if (job->wanted_lines > 1)
+        {
+            iteration_count = search_root_lines(context, job->board, current_depth, iteration_lines, job->wanted_lines);
+        }
+        else
+        {
+            iteration_lines[0].move = job->first_move;
+            iteration_lines[0].score = search_alpha_beta(context, job->board, current_depth, -SEARCH_INFINITY, SEARCH_INFINITY, 0, &iteration_lines[0].move, true);
+        }
+
+        if (context->aborted)
+        {
+            if (current_depth == job->first_depth && iteration_count > 0) // nothing finished, take what the first iteration had got to
+            {
+                memcpy(job->lines, iteration_lines, (size_t)iteration_count * sizeof(struct search_line));
+                job->line_count = iteration_count;
+            }
+            break;
+        }
+
+        memcpy(job->lines, iteration_lines, (size_t)iteration_count * sizeof(struct search_line));
+        job->line_count = iteration_count;
+        job->completed_depth = current_depth;
+
+        if (context->on_iteration != NULL)
+        {
+            context->on_iteration(context->on_iteration_data, current_depth, job->lines[0].score, &job->lines[0].move, &context->stats);
+        }
+
+        if (job->lines[job->line_count - 1].score >= SEARCH_MATE - SEARCH_MAX_PLY) // every line is a forced mate, looking deeper won't beat them
+        {
+            break;
+        }
+    }
+}
+
+static void *search_helper_thread(void *data)
+{
+    search_iterate(data);
+    return NULL;
+}
+
+bool search_best_move(struct search_context *context, const struct chess_board *board, int depth, struct chess_move *best_move, int *score)
+{
+    struct search_line line;
+    if (search_best_lines(context, board, depth, &line, 1) == 0)
+    {
+        return false;
+    }
+    *best_move = line.move;
+    *score = line.score;
+    return true;
+}
+
+int search_best_lines(struct search_context *context, const struct chess_board *board, int depth, struct search_line *lines, int count)
+{
+    struct chess_move moves[RULES_MAX_MOVES];
+    int move_count = rules_generate_legal_moves(board, moves);
+    if (move_count == 0)
+    {
+        return 0;
+    }
+    if (count > SEARCH_MAX_LINES)
+    {
+        count = SEARCH_MAX_LINES;
+    }
+    if (count > move_count)
+    {
+        count = move_count;
+    }
+    if (count < 1)
+    {
+        count = 1;
+    }
+
+    // a board kept with other weights than the context's gets its totals redone with the context's
+    struct chess_board rebased;
+    if (board->weights != context->weights)
+    {
+        rebased = *board;
+        eval_reset(&rebased, context->weights);
+        board = &rebased;
+    }
+
+    search_prepare(context, board);
+
+    enum tablebase_outcome outcome;
+    int plies;
+    if (count == 1 && context->tablebase != NULL && tablebase_best_move(context->tablebase, board, &lines[0].move, &outcome, &plies))
+    {
+        lines[0].score = search_tablebase_score(outcome, plies, 0);
+        if (context->on_iteration != NULL)
+        {
+            context->on_iteration(context->on_iteration_data, 1, lines[0].score, &lines[0].move, &context->stats);
+        }
+        return 1;
+    }
+
+    if (depth < 1)
+    {
+        depth = 1;
+    }
+    if (depth >= SEARCH_MAX_PLY)
+    {
+        depth = SEARCH_MAX_PLY - 1;
+    }
+
+    struct search_job jobs[SEARCH_MAX_THREADS];
+    int job_count = 1 + context->helper_count;
+    for (int i = 0; i < job_count; i++)
+    {
+        struct search_job *job = &jobs[i];
+        job->context = i == 0 ? context : &context->helpers[i - 1];
+        job->board = board;
+        job->first_move = moves[0];
+        job->first_depth = 1;
+        job->last_depth = depth;
+        job->wanted_lines = i == 0 ? count : 1;
+        if (i % 2 == 1 && depth + 1 < SEARCH_MAX_PLY) // odd helpers go one deeper, so the threads don't all finish the same iterations together
+        {
+            job->first_depth = 2;
+            job->last_depth = depth + 1;
+        }
+    }
+
+    int started = 1;
+    for (; started < job_count; started++)
+    {
+        struct search_context *helper = jobs[started].context;
+        helper->game = context->game;
+        search_prepare(helper, board);
+        atomic_store(&helper->stop, false);
+        helper->deadline_ms = context->deadline_ms;
+        helper->pruning = context->pruning;
+        helper->tablebase = context->tablebase;
+        helper->weights = context->weights;
+        helper->weights_key = context->weights_key;
+        if (pthread_create(&jobs[started].thread, NULL, search_helper_thread, &jobs[started]) != 0)
+        {
+            break; // search with the threads we got
+        }
+    }
+
+    search_iterate(&jobs[0]);
+
+    // the helpers are only here to fill the table, once we're done so are they. with several
+    // lines wanted only this thread has them, otherwise the deepest search wins
+    struct search_job *best = &jobs[0];
+    for (int i = 1; i < started; i++)
+    {
+        struct search_context *helper = jobs[i].context;
+        atomic_store(&helper->stop, true);
+        pthread_join(jobs[i].thread, NULL);
+
+        if (count == 1 && jobs[i].completed_depth > best->completed_depth)
+        {
+            best = &jobs[i];
+        }
+        context->stats.nodes += helper->stats.nodes;
+        context->stats.qnodes += helper->stats.qnodes;
+        context->stats.beta_cutoffs += helper->stats.beta_cutoffs;
+        context->stats.first_move_cutoffs += helper->stats.first_move_cutoffs;
+        context->stats.tt_hits += helper->stats.tt_hits;
+        context->stats.null_move_cutoffs += helper->stats.null_move_cutoffs;
+        context->stats.late_move_reductions += helper->stats.late_move_reductions;
+        context->stats.late_move_researches += helper->stats.late_move_researches;
+        context->stats.futility_prunes += helper->stats.futility_prunes;
+        context->stats.pawn_hits += helper->stats.pawn_hits;
+        context->stats.pawn_misses += helper->stats.pawn_misses;
+    }
+
+    memcpy(lines, best->lines, (size_t)best->line_count * sizeof(struct search_line));
+    return best->line_count;
+}
+
+int search_principal_variation(const struct search_context *context, const struct chess_board *board, struct chess_move *line, int max_length)
+{
+    struct chess_board position = *board;
+    struct chess_move moves[RULES_MAX_MOVES];
+    int length = 0;
+
+    while (length < max_length)
+    {
+        struct search_tt_data entry;
+        if (!search_tt_probe(context, position.hash, &entry) || entry.move == 0)
+        {
+            break;
+        }
+
+        // the table only has the packed move, find the full legal move it stands for
+        int move_count = rules_generate_legal_moves(&position, moves);
+        int found = -1;
+        for (int i = 0; i < move_count; i++)
+        {
+            if (search_pack_move(&moves[i]) == entry.move)
+            {
+                found = i;
+                break;
+            }
+        }
+        if (found < 0)
+        {
+            break;
+        }
+
+        line[length++] = moves[found];
+        board_apply_move(&position, &moves[found]);
+    }
+
+    return length;
+}
@@ -0,0 +1,237 @@
+#ifndef APSC143__SEARCH_H
+#define APSC143__SEARCH_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include "board.h"
+#include "rules.h"
+#include "history.h"
+#include "pawns.h"
+
+// scores are centipawns from the point of view of the player to move. a mate
+// is SEARCH_MATE minus the number of plies until it happens
+#define SEARCH_MATE 30000
+#define SEARCH_INFINITY 32000
+#define SEARCH_MAX_PLY 64
+
+// most earlier positions of the game a search checks its own path against for repetitions
+#define SEARCH_GAME_PLIES 128
+
+// how deep board_recommend_move looks, in plies, before the quiescence search takes over
+#define SEARCH_DEFAULT_DEPTH 4
+// transposition table size board_recommend_move uses when it isn't given a context
+#define SEARCH_DEFAULT_TABLE_MB 4
+
+enum search_bound
+{
+    SEARCH_BOUND_NONE = 0,
+    SEARCH_BOUND_EXACT = 1, // score is the true value
+    SEARCH_BOUND_LOWER = 2, // search failed high, true value is at least score
+    SEARCH_BOUND_UPPER = 3, // search failed low, true value is at most score
+};
+
+// most threads one search can use, the calling thread included
+#define SEARCH_MAX_THREADS 64
+// most moves one search_best_lines call ranks, as many as a chess_summary holds
+#define SEARCH_MAX_LINES CHESS_MAX_LINES
+
+// one remembered position in the transposition table. data packs the best
+// move found here (see search_pack_move, 0 if none), the score, the depth and
+// the bound; check is data XOR the position's hash. Threads sharing the table
+// read and write entries without locks, and a probe only believes an entry
+// whose two words XOR back to the hash it's looking for, so one torn by two
+// threads writing at once just looks like a miss
+struct search_tt_entry
+{
+    _Atomic uint64_t check;
+    _Atomic uint64_t data;
+};
+
+// counters for measuring how well the search prunes
+struct search_stats
+{
+    unsigned long long nodes;              // positions visited by the alpha-beta search
+    unsigned long long qnodes;             // positions visited by the quiescence search
+    unsigned long long beta_cutoffs;       // nodes that failed high
+    unsigned long long first_move_cutoffs; // ... on the first move tried, i.e. the ordering got it right
+    unsigned long long tt_hits;            // probes that found the position in the table
+
+    // what the pruning in search_pruning did
+    unsigned long long null_move_cutoffs;    // nodes cut off by passing the move
+    unsigned long long late_move_reductions; // moves searched shallower because they came late in the ordering
+    unsigned long long late_move_researches; // ... that then beat alpha and had to be searched again at full depth
+    unsigned long long futility_prunes;      // quiet moves skipped at frontier nodes that couldn't get back to alpha
+
+    unsigned long long pawn_hits;   // evaluations that found their pawn structure in the pawn cache
+    unsigned long long pawn_misses; // ... and ones that had to work it out
+};
+
+// Ways the alpha-beta search cuts down the tree, each of which can be turned
+// off (search_context_init turns them all on) to measure what it's worth.
+struct search_pruning
+{
+    // let the opponent move twice in a row with a reduced search; if we're still above beta
+    // the real moves surely are too. not in check, or with only pawns left (zugzwang)
+    bool null_move;
+    // search quiet moves late in the ordering a ply or two shallower, again at full depth only
+    // if they turn out to beat alpha
+    bool late_move_reductions;
+    // one ply from the leaves, skip quiet moves when even a margin over the static evaluation
+    // can't reach alpha
+    bool futility;
+};
+
+// scratch space for one ply of the search: the child position and the move
+// list. allocated once per context instead of on the system stack every node
+struct search_frame
+{
+    struct chess_board child;
+    struct chess_move moves[RULES_MAX_MOVES];
+    int scores[RULES_MAX_MOVES];
+};
+
+// endgame tables live in tablebase.h, the search only probes them
+struct tablebase;
+struct cache;
+
+// called after each completed iteration of search_best_move (e.g. to print UCI info lines)
+typedef void (*search_iteration_callback)(void *data, int depth, int score, const struct chess_move *best_move, const struct search_stats *stats);
+
+// Everything a search keeps between calls: the transposition table, the move
+// ordering tables and the per-ply frames. Reusing one context across searches
+// keeps them warm.
+struct search_context
+{
+    struct search_tt_entry *table;
+    size_t table_size; // number of entries, always a power of two
+    bool shared_table; // a helper's table belongs to the context it helps
+
+    // contexts for the extra threads of a parallel search, see search_context_set_threads
+    struct search_context *helpers;
+    int helper_count;
+
+    uint16_t killers[SEARCH_MAX_PLY][2]; // two quiet moves per ply that recently caused a cutoff
+    int history[2][64][64];              // [player][from][to] credit for quiet moves that caused cutoffs
+
+    struct search_frame *frames; // SEARCH_MAX_PLY + 1 of them, indexed by ply
+    // the recent positions of the game followed by the search's own path to the current node. a
+    // node that repeats one of them is a draw, whatever the rest of the tree says
+    struct history path;
+    int path_root; // where the root is in path, see history_search_repetition
+    // pawn structure terms for the evaluation at the leaves, one cache per thread
+    struct pawns_cache pawns;
+
+    // limits for the next search_best_move. stop may be set from another thread at any time;
+    // deadline_ms is an absolute search_now_ms() time, 0 for no time limit
+    atomic_bool stop;
+    long long deadline_ms;
+    bool aborted; // the last search ran out of time or was stopped
+
+    search_iteration_callback on_iteration;
+    void *on_iteration_data;
+
+    struct search_pruning pruning;
+    // how many ranked moves board_analyze asks for, 1 for just the suggestion
+    int multi_pv;
+
+    // the evaluation weights to search with, NULL for the compiled-in ones, and their
+    // eval_weights_key. set through search_context_set_weights. not owned
+    const struct eval_weights *weights;
+    uint64_t weights_key;
+    // endgame tables to answer from when few enough pieces are left, NULL for none. not owned
+    const struct tablebase *tablebase;
+    // results of earlier board_analyze calls to answer from and add to, NULL for none. not owned
+    struct cache *cache;
+    // the game that led to the position being searched, its last entry that position. NULL if
+    // there's no game to speak of; then nothing before the root counts for repetitions. not owned
+    const struct history *game;
+
+    struct search_stats stats;
+};
+
+// Allocates the transposition table (table_mb megabytes, rounded down to a
+// power of two entries), the search frames and the pawn cache, and turns on
+// all the pruning.
+// Returns false if the memory isn't available.
+bool search_context_init(struct search_context *context, size_t table_mb);
+void search_context_free(struct search_context *context);
+// Forgets everything learned so far, e.g. between unrelated games.
+void search_context_clear(struct search_context *context);
+// Makes search_best_move use threads threads (1 to SEARCH_MAX_THREADS) from
+// now on, all sharing this context's transposition table. Returns false if
+// the memory for the extra threads' frames isn't available, which leaves the
+// context searching on one thread.
+bool search_context_set_threads(struct search_context *context, int threads);
+// Makes the context search with weights (NULL for the compiled-in ones) from
+// now on, forgetting what it learned under other weights. They have to stay
+// alive and unchanged while the context uses them.
+void search_context_set_weights(struct search_context *context, const struct eval_weights *weights);
+
+// Iterative deepening alpha-beta search to depth plies, with quiescence at the
+// leaves, stopping early if context->stop is set or deadline_ms passes (the
+// last completed iteration's move is kept). Stores the best move for the player to move in *best_move and its
+// score in *score. Moves are tried hash move first, then captures by MVV-LVA,
+// then killer moves, then quiet moves by history. A position covered by
+// context->tablebase is answered from the tables without searching. A
+// position that repeats one earlier in the search, or one from context->game
+// that already came up twice, or that the fifty-move rule makes drawn, scores
+// as a draw. Returns
+// false (and leaves *best_move alone) if there is no legal move.
+//
+// With more than one thread this is a lazy SMP search: the helper threads run
+// the same iterative deepening on the same position, half of them one ply
+// deeper, and only share what they find through the transposition table. Each
+// fills in entries the others then cut off on, so together they reach the
+// depth sooner than one thread would. The calling thread stops the helpers
+// once its own last iteration is done and takes the deepest completed result;
+// the stats are summed over every thread.
+bool search_best_move(struct search_context *context, const struct chess_board *board, int depth, struct chess_move *best_move, int *score);
+
+// one root move of a multi-PV search and what it's worth to the player to move
+struct search_line
+{
+    struct chess_move move;
+    int score;
+};
+
+// search_best_move for the best count moves (at most SEARCH_MAX_LINES) instead
+// of only the best one, written to lines best first. It's still one search:
+// every iteration tries each root move once against the shared table, and any
+// move that could still make the list gets an exact score instead of just
+// being shown worse than the best, so the cost is well under count separate
+// searches. Extra threads only help fill the table. The root isn't answered
+// from the endgame tables when count is above 1 (the moves below it still
+// are). Returns how many lines were found: fewer than count if there aren't
+// that many legal moves, 0 if there are none.
+int search_best_lines(struct search_context *context, const struct chess_board *board, int depth, struct search_line *lines, int count);
+
+// Moves until mate for a mate score, positive if the player to move gives it
+// and negative if they get mated; 0 for any other score.
+int search_mate_moves(int score);
+
+// Follows the best moves stored in the transposition table from board and
+// writes up to max_length of them to line. Returns how many were found.
+int search_principal_variation(const struct search_context *context, const struct chess_board *board, struct chess_move *line, int max_length);
+
+// Milliseconds on a clock that only moves forward, for deadline_ms.
+long long search_now_ms(void);
+// The same clock in nanoseconds, for timing things shorter than a search.
+unsigned long long search_now_ns(void);
+
+// Packs a move into 16 bits (from, to and promotion piece) for the tables.
+uint16_t search_pack_move(const struct chess_move *move);
+
+// Static exchange evaluation: the material the player making move comes out
+// ahead (or behind, if negative) once both sides have traded off everything
+// that attacks the destination square, each always recapturing with their
+// least valuable piece. Cheap, no moves are actually played.
+int search_see(const struct chess_board *board, const struct chess_move *move);
+
+// Capture-only search from a leaf position. The side to move may "stand pat"
+// on the static evaluation instead of capturing, and captures that lose
+// material by search_see are skipped, so the cost stays bounded. When in check
+// every evasion is tried instead. ply is the distance from the root, used to
+// score mates.
+int search_quiescence(struct search_context *context, const struct chess_board *board, int alpha, int beta, int ply);
+
+#endif
@@ -0,0 +1,847 @@
+#include "tablebase.h"
+#include "rules.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// file layout: this magic, the piece count, one byte per piece (owner << 3 | piece), padding to
+// TABLEBASE_HEADER_SIZE, then the values
+#define TABLEBASE_MAGIC "CTB1"
+#define TABLEBASE_HEADER_SIZE 16
+
+// only used while generating: not decided yet
+#define TABLEBASE_UNKNOWN 0xFE
+// longest mate a byte can hold without running into TABLEBASE_UNKNOWN
+#define TABLEBASE_MAX_PLIES 125
+
+static const char piece_letters[6] = {'P', 'N', 'B', 'R', 'Q', 'K'};
+
+static size_t tablebase_positions(int piece_count)
+{
+    return (size_t)2 << (6 * piece_count); // side to move times 64 squares per piece
+}
+
+static int tablebase_total_pieces(const int counts[2][6])
+{
+    int total = 0;
+    for (int player = 0; player < 2; player++)
+    {
+        for (int piece = 0; piece < 6; piece++)
+        {
+            total += counts[player][piece];
+        }
+    }
+    return total;
+}
+
+void tablebase_init(struct tablebase *tablebase)
+{
+    tablebase->count = 0;
+}
+
+void tablebase_free(struct tablebase *tablebase)
+{
+    for (int i = 0; i < tablebase->count; i++)
+    {
+        struct tablebase_table *table = &tablebase->tables[i];
+        if (table->owned)
+        {
+            free(table->mapping);
+        }
+#ifndef _WIN32
+        else
+        {
+            munmap(table->mapping, table->mapping_size);
+        }
+#endif
+    }
+    tablebase->count = 0;
+}
+
+void tablebase_name(const struct tablebase_table *table, char *text)
+{
+    int length = 0;
+    for (int i = 0; i < table->piece_count; i++)
+    {
+        if (i > 0 && table->owners[i] != table->owners[i - 1])
+        {
+            text[length++] = 'v';
+        }
+        text[length++] = piece_letters[table->pieces[i]];
+    }
+    text[length] = '\0';
+}
+
+// fills in the piece order of a table from its material: each side's king first, then the
+// heavier pieces, white before black
+static void tablebase_set_material(struct tablebase_table *table, const int counts[2][6])
+{
+    static const enum chess_piece order[6] = {PIECE_KING, PIECE_QUEEN, PIECE_ROOK, PIECE_BISHOP, PIECE_KNIGHT, PIECE_PAWN};
+
+    memset(table, 0, sizeof(*table));
+    memcpy(table->counts, counts, sizeof(table->counts));
+    for (int player = 0; player < 2; player++)
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            for (int n = 0; n < counts[player][order[i]]; n++)
+            {
+                table->owners[table->piece_count] = (enum chess_player)player;
+                table->pieces[table->piece_count] = order[i];
+                table->piece_count++;
+            }
+        }
+    }
+}
+
+// "KQvKR" -> piece counts. one king a side, TABLEBASE_MAX_PIECES at most
+static bool tablebase_parse_name(const char *name, int counts[2][6])
+{
+    memset(counts, 0, 6 * 2 * sizeof(int));
+    int player = PLAYER_WHITE;
+
+    for (const char *cursor = name; *cursor != '\0'; cursor++)
+    {
+        if (*cursor == 'v' && player == PLAYER_WHITE)
+        {
+            player = PLAYER_BLACK;
+            continue;
+        }
+
+        const char *found = memchr(piece_letters, *cursor, sizeof(piece_letters));
+        if (found == NULL)
+        {
+            return false;
+        }
+        counts[player][found - piece_letters]++;
+    }
+
+    return player == PLAYER_BLACK && counts[PLAYER_WHITE][PIECE_KING] == 1 && counts[PLAYER_BLACK][PIECE_KING] == 1 && tablebase_total_pieces(counts) <= TABLEBASE_MAX_PIECES;
+}
+
+// the table holding this material either way round, *mirrored says which
+static const struct tablebase_table *tablebase_find(const struct tablebase *tablebase, const int counts[2][6], bool *mirrored)
+{
+    for (int i = 0; i < tablebase->count; i++)
+    {
+        const struct tablebase_table *table = &tablebase->tables[i];
+        if (memcmp(table->counts[PLAYER_WHITE], counts[PLAYER_WHITE], sizeof(table->counts[0])) == 0 && memcmp(table->counts[PLAYER_BLACK], counts[PLAYER_BLACK], sizeof(table->counts[0])) == 0)
+        {
+            *mirrored = false;
+            return table;
+        }
+        if (memcmp(table->counts[PLAYER_WHITE], counts[PLAYER_BLACK], sizeof(table->counts[0])) == 0 && memcmp(table->counts[PLAYER_BLACK], counts[PLAYER_WHITE], sizeof(table->counts[0])) == 0)
+        {
+            *mirrored = true;
+            return table;
+        }
+    }
+    return NULL;
+}
+
+// index of the position on board in table, with the colours swapped and the board flipped if mirrored
+static size_t tablebase_index(const struct tablebase_table *table, const struct chess_board *board, bool mirrored)
+{
+    int squares[TABLEBASE_MAX_PIECES];
+    bool used[TABLEBASE_MAX_PIECES] = {false};
+
+    uint64_t remaining = board->occupied[PLAYER_WHITE] | board->occupied[PLAYER_BLACK];
+    while (remaining)
+    {
+        int square_index = board_lowest_square(remaining);
+        remaining &= remaining - 1;
+
+        int row = square_index / BOARD_SIZE;
+        int col = square_index % BOARD_SIZE;
+        const struct square *square = &board->squares[row][col];
+        enum chess_player owner = mirrored ? (enum chess_player)(1 - square->owner) : square->owner;
+        int table_row = mirrored ? BOARD_SIZE - 1 - row : row;
+
+        // identical pieces can go in either slot, the table has both orders
+        for (int slot = 0; slot < table->piece_count; slot++)
+        {
+            if (!used[slot] && table->owners[slot] == owner && table->pieces[slot] == square->piece)
+            {
+                used[slot] = true;
+                squares[slot] = table_row * BOARD_SIZE + col;
+                break;
+            }
+        }
+    }
+
+    size_t index = mirrored ? (size_t)(1 - board->next_move_player) : (size_t)board->next_move_player;
+    for (int slot = 0; slot < table->piece_count; slot++)
+    {
+        index = index * 64 + (size_t)squares[slot];
+    }
+    return index;
+}
+
+static void tablebase_decode(uint8_t value, enum tablebase_outcome *outcome, int *plies)
+{
+    if (value == TABLEBASE_DRAW)
+    {
+        *outcome = TABLEBASE_OUTCOME_DRAW;
+        *plies = 0;
+    }
+    else if (value & TABLEBASE_LOSS)
+    {
+        *outcome = TABLEBASE_OUTCOME_LOSS;
+        *plies = value & ~TABLEBASE_LOSS;
+    }
+    else
+    {
+        *outcome = TABLEBASE_OUTCOME_WIN;
+        *plies = value;
+    }
+}
+
+bool tablebase_probe(const struct tablebase *tablebase, const struct chess_board *board, enum tablebase_outcome *outcome, int *plies)
+{
+    int total = board_count_squares(board->occupied[PLAYER_WHITE] | board->occupied[PLAYER_BLACK]);
+    if (total > TABLEBASE_MAX_PIECES)
+    {
+        return false;
+    }
+
+    const struct castling_rights *rights = &board->rights;
+    if (rights->white_kingside || rights->white_queenside || rights->black_kingside || rights->black_queenside)
+    {
+        return false;
+    }
+
+    int counts[2][6];
+    for (int player = PLAYER_WHITE; player <= PLAYER_BLACK; player++)
+    {
+        for (int piece = PIECE_PAWN; piece <= PIECE_KING; piece++)
+        {
+            counts[player][piece] = board_count_squares(board->pieces[player][piece]);
+        }
+    }
+    if (counts[PLAYER_WHITE][PIECE_KING] != 1 || counts[PLAYER_BLACK][PIECE_KING] != 1)
+    {
+        return false;
+    }
+    if (total == 2) // bare kings, no table needed
+    {
+        *outcome = TABLEBASE_OUTCOME_DRAW;
+        *plies = 0;
+        return true;
+    }
+
+    bool mirrored;
+    const struct tablebase_table *table = tablebase_find(tablebase, counts, &mirrored);
+    if (table == NULL)
+    {
+        return false;
+    }
+
+    uint8_t value = table->values[tablebase_index(table, board, mirrored)];
+    if (value == TABLEBASE_INVALID)
+    {
+        return false;
+    }
+    tablebase_decode(value, outcome, plies);
+    return true;
+}
+
+// how good an outcome is for the player it belongs to, bigger is better
+static int tablebase_rank(enum tablebase_outcome outcome, int plies)
+{
+    switch (outcome)
+    {
+    case TABLEBASE_OUTCOME_WIN:
+        return 1000 - plies; // sooner is better
+    case TABLEBASE_OUTCOME_LOSS:
+        return -1000 + plies; // later is better
+    default:
+        return 0;
+    }
+}
+
+bool tablebase_best_move(const struct tablebase *tablebase, const struct chess_board *board, struct chess_move *move, enum tablebase_outcome *outcome, int *plies)
+{
+    enum tablebase_outcome current;
+    int current_plies;
+    if (!tablebase_probe(tablebase, board, &current, &current_plies))
+    {
+        return false;
+    }
+
+    struct chess_move moves[RULES_MAX_MOVES];
+    int move_count = rules_generate_legal_moves(board, moves);
+    int best_rank = -10000;
+
+    for (int i = 0; i < move_count; i++)
+    {
+        struct chess_board child = *board;
+        board_apply_move(&child, &moves[i]);
+
+        enum tablebase_outcome child_outcome;
+        int child_plies;
+        if (!tablebase_probe(tablebase, &child, &child_outcome, &child_plies))
+        {
+            return false; // a capture into a table we don't have, let the search handle it
+        }
+
+        // the child is from the opponent's point of view
+        enum tablebase_outcome our_outcome = (child_outcome == TABLEBASE_OUTCOME_WIN) ? TABLEBASE_OUTCOME_LOSS : (child_outcome == TABLEBASE_OUTCOME_LOSS) ? TABLEBASE_OUTCOME_WIN : TABLEBASE_OUTCOME_DRAW;
+        int our_plies = (our_outcome == TABLEBASE_OUTCOME_DRAW) ? 0 : child_plies + 1;
+        int rank = tablebase_rank(our_outcome, our_plies);
+        if (rank > best_rank)
+        {
+            best_rank = rank;
+            *move = moves[i];
+            *outcome = our_outcome;
+            *plies = our_plies;
+        }
+    }
+
+    return move_count > 0;
+}
+
+// sets board up as position index of table. returns false if the index isn't a position at all
+// (two pieces on a square, a pawn on its first or last rank) or the player who just moved is in check
+static bool tablebase_setup(const struct tablebase_table *table, size_t index, struct chess_board *board)
+{
+    int squares[TABLEBASE_MAX_PIECES];
+    uint64_t taken = 0;
+
+    for (int slot = table->piece_count - 1; slot >= 0; slot--)
+    {
+        squares[slot] = (int)(index % 64);
+        index /= 64;
+
+        uint64_t bit = (uint64_t)1 << squares[slot];
+        int row = squares[slot] / BOARD_SIZE;
+        if ((taken & bit) || (table->pieces[slot] == PIECE_PAWN && (row == 0 || row == BOARD_SIZE - 1)))
+        {
+            return false;
+        }
+        taken |= bit;
+    }
+
+    for (int row = 0; row < BOARD_SIZE; row++)
+    {
+        for (int col = 0; col < BOARD_SIZE; col++)
+        {
+            board->squares[row][col].has_piece = false;
+            board->squares[row][col].owner = PLAYER_WHITE;
+        }
+    }
+    memset(board->pieces, 0, sizeof(board->pieces));
+    for (int slot = 0; slot < table->piece_count; slot++)
+    {
+        int row = squares[slot] / BOARD_SIZE;
+        int col = squares[slot] % BOARD_SIZE;
+        board->squares[row][col] = (struct square){true, table->pieces[slot], table->owners[slot], col, row};
+        board->pieces[table->owners[slot]][table->pieces[slot]] |= BOARD_SQUARE_BIT(row, col);
+    }
+
+    board->next_move_player = (enum chess_player)index;
+    board->rights = (struct castling_rights){false, false, false, false};
+    // the generator never evaluates or hashes these positions, so the attack maps are all it needs
+    board->eval_mg = board->eval_eg = board->eval_phase = 0;
+    board->weights = NULL;
+    board->hash = board->pawn_hash = 0;
+    board_update_attacks(board);
+
+    enum chess_player mover = (enum chess_player)(1 - board->next_move_player);
+    return !board_square_attacked(board, board->next_move_player, board->king_row[mover], board->king_col[mover]);
+}
+
+// a win or loss one ply further from mate, seen from the other side
+static uint8_t tablebase_parent_value(uint8_t child)
+{
+    if (child == TABLEBASE_DRAW)
+    {
+        return TABLEBASE_DRAW;
+    }
+    int plies = (child & ~TABLEBASE_LOSS) + 1;
+    if (plies > TABLEBASE_MAX_PLIES)
+    {
+        return TABLEBASE_DRAW; // too long to store, never happens with four pieces
+    }
+    return (child & TABLEBASE_LOSS) ? (uint8_t)plies : (uint8_t)(TABLEBASE_LOSS | plies);
+}
+
+// is value a better outcome than best for the same player (TABLEBASE_UNKNOWN is the worst)
+static bool tablebase_better(uint8_t value, uint8_t best)
+{
+    if (best == TABLEBASE_UNKNOWN)
+    {
+        return true;
+    }
+    enum tablebase_outcome outcome, best_outcome;
+    int plies, best_plies;
+    tablebase_decode(value, &outcome, &plies);
+    tablebase_decode(best, &best_outcome, &best_plies);
+    return tablebase_rank(outcome, plies) > tablebase_rank(best_outcome, best_plies);
+}
+
+// working state for one table while it is generated
+struct tablebase_generator
+{
+    const struct tablebase *tablebase; // the smaller tables captures and promotions lead to
+    struct tablebase_table *table;
+    uint8_t *values;
+    uint8_t *remaining;    // moves that stay in this table and haven't been shown to lose yet
+    uint8_t *exit_best;    // best value among moves that leave the table, TABLEBASE_UNKNOWN if none
+    size_t weights[TABLEBASE_MAX_PIECES]; // index step for each piece's square
+    int highest;           // deepest level anything has been scheduled for
+};
+
+// first pass: mates, stalemates, legality, and what the moves out of the table are worth
+static void tablebase_scan(struct tablebase_generator *generator)
+{
+    size_t size = generator->table->size;
+    struct chess_board board;
+    struct chess_move moves[RULES_MAX_MOVES];
+
+    for (size_t index = 0; index < size; index++)
+    {
+        generator->exit_best[index] = TABLEBASE_UNKNOWN;
+        generator->remaining[index] = 0;
+        if (!tablebase_setup(generator->table, index, &board))
+        {
+            generator->values[index] = TABLEBASE_INVALID;
+            continue;
+        }
+
+        int move_count = rules_generate_legal_moves(&board, moves);
+        if (move_count == 0)
+        {
+            generator->values[index] = board_in_check(&board) ? TABLEBASE_LOSS : TABLEBASE_DRAW;
+            continue;
+        }
+
+        int staying = 0;
+        uint8_t exit_best = TABLEBASE_UNKNOWN;
+        for (int i = 0; i < move_count; i++)
+        {
+            if (!moves[i].is_capture && !moves[i].is_promotion)
+            {
+                staying++;
+                continue;
+            }
+
+            struct chess_board child = board;
+            board_apply_move(&child, &moves[i]);
+            enum tablebase_outcome outcome;
+            int plies;
+            uint8_t value = TABLEBASE_DRAW;
+            if (tablebase_probe(generator->tablebase, &child, &outcome, &plies))
+            {
+                value = tablebase_parent_value(outcome == TABLEBASE_OUTCOME_DRAW ? TABLEBASE_DRAW : outcome == TABLEBASE_OUTCOME_WIN ? (uint8_t)plies : (uint8_t)(TABLEBASE_LOSS | plies));
+            }
+            if (tablebase_better(value, exit_best))
+            {
+                exit_best = value;
+            }
+        }
+
+        generator->remaining[index] = (uint8_t)staying;
+        if (staying == 0) // every move leaves the table, so they decide it
+        {
+            generator->values[index] = exit_best;
+            if (exit_best != TABLEBASE_DRAW && (exit_best & ~TABLEBASE_LOSS) > generator->highest)
+            {
+                generator->highest = exit_best & ~TABLEBASE_LOSS;
+            }
+            continue;
+        }
+
+        generator->values[index] = TABLEBASE_UNKNOWN;
+        generator->exit_best[index] = exit_best;
+        if (exit_best != TABLEBASE_UNKNOWN && !(exit_best & TABLEBASE_LOSS) && exit_best > generator->highest)
+        {
+            generator->highest = exit_best; // a win waiting to be scheduled at its own level
+        }
+    }
+}
+
+// position index has just been decided at level plies (value is its value); tell every position
+// that could have moved into it
+static void tablebase_propagate(struct tablebase_generator *generator, size_t index, uint8_t value, int plies)
+{
+    const struct tablebase_table *table = generator->table;
+    struct chess_board board;
+    tablebase_setup(table, index, &board);
+
+    enum chess_player mover = (enum chess_player)(1 - board.next_move_player);
+    uint64_t occupied = board.occupied[PLAYER_WHITE] | board.occupied[PLAYER_BLACK];
+    size_t side_weight = tablebase_positions(table->piece_count) / 2;
+    size_t base = index - (size_t)board.next_move_player * side_weight + (size_t)mover * side_weight;
+
+    for (int slot = 0; slot < table->piece_count; slot++)
+    {
+        if (table->owners[slot] != mover)
+        {
+            continue;
+        }
+
+        size_t weight = generator->weights[slot];
+        int square_index = (int)((index / weight) % 64);
+        int row = square_index / BOARD_SIZE;
+        int col = square_index % BOARD_SIZE;
+
+        // where the piece could have come from without capturing anything
+        uint64_t sources;
+        if (table->pieces[slot] == PIECE_PAWN)
+        {
+            int back = (mover == PLAYER_WHITE) ? 1 : -1;
+            int double_row = (mover == PLAYER_WHITE) ? 4 : 3; // the row a double step lands on
+            sources = 0;
+            if (row + back > 0 && row + back < BOARD_SIZE - 1 && !(occupied & BOARD_SQUARE_BIT(row + back, col)))
+            {
+                sources |= BOARD_SQUARE_BIT(row + back, col);
+                if (row == double_row && !(occupied & BOARD_SQUARE_BIT(row + 2 * back, col)))
+                {
+                    sources |= BOARD_SQUARE_BIT(row + 2 * back, col);
+                }
+            }
+        }
+        else
+        {
+            // everything else moves the same both ways, so the squares it attacks are the squares it came from
+            sources = board_piece_attacks(&board, row, col) & ~occupied;
+        }
+
+        while (sources)
+        {
+            int source = board_lowest_square(sources);
+            sources &= sources - 1;
+
+            size_t parent = base - (size_t)square_index * weight + (size_t)source * weight;
+            if (generator->values[parent] != TABLEBASE_UNKNOWN)
+            {
+                continue;
+            }
+
+            if (value & TABLEBASE_LOSS) // moving here beats the opponent
+            {
+                generator->values[parent] = (uint8_t)(plies + 1);
+                if (plies + 1 > generator->highest)
+                {
+                    generator->highest = plies + 1;
+                }
+            }
+            else if (--generator->remaining[parent] == 0) // the last move that stayed in the table loses too
+            {
+                uint8_t exit_best = generator->exit_best[parent];
+                if (exit_best == TABLEBASE_DRAW)
+                {
+                    generator->values[parent] = TABLEBASE_DRAW;
+                }
+                else if (exit_best == TABLEBASE_UNKNOWN || (exit_best & TABLEBASE_LOSS))
+                {
+                    int loss_plies = plies + 1;
+                    if (exit_best != TABLEBASE_UNKNOWN && (exit_best & ~TABLEBASE_LOSS) > loss_plies)
+                    {
+                        loss_plies = exit_best & ~TABLEBASE_LOSS;
+                    }
+                    if (loss_plies > TABLEBASE_MAX_PLIES)
+                    {
+                        continue;
+                    }
+                    generator->values[parent] = (uint8_t)(TABLEBASE_LOSS | loss_plies);
+                    if (loss_plies > generator->highest)
+                    {
+                        generator->highest = loss_plies;
+                    }
+                }
+                // a winning way out of the table gets scheduled at its own level
+            }
+        }
+    }
+}
+
+static enum chess_error tablebase_build(struct tablebase *tablebase, struct tablebase_table *table)
+{
+    struct tablebase_generator generator = {tablebase, table, NULL, NULL, NULL, {0}, 0};
+    size_t size = tablebase_positions(table->piece_count);
+
+    generator.values = malloc(size);
+    generator.remaining = malloc(size);
+    generator.exit_best = malloc(size);
+    if (generator.values == NULL || generator.remaining == NULL || generator.exit_best == NULL)
+    {
+        free(generator.values);
+        free(generator.remaining);
+        free(generator.exit_best);
+        return CHESS_ERROR_OUT_OF_MEMORY;
+    }
+    table->size = size;
+    for (int slot = table->piece_count - 1, weight = 1; slot >= 0; slot--, weight *= 64)
+    {
+        generator.weights[slot] = (size_t)weight;
+    }
+
+    tablebase_scan(&generator);
+
+    // level by level outwards from mate. a position decided at a level is always decided for good,
+    // wins can only be found at the first level something leads to them and losses wait for their last move
+    for (int plies = 0; plies <= generator.highest && plies <= TABLEBASE_MAX_PLIES; plies++)
+    {
+        uint8_t win = (uint8_t)plies;
+        uint8_t loss = (uint8_t)(TABLEBASE_LOSS | plies);
+        for (size_t index = 0; index < size; index++)
+        {
+            uint8_t value = generator.values[index];
+            if (value == TABLEBASE_UNKNOWN && generator.exit_best[index] == win && plies > 0)
+            {
+                value = generator.values[index] = win;
+            }
+            if ((value == win && plies > 0) || value == loss)
+            {
+                tablebase_propagate(&generator, index, value, plies);
+            }
+        }
+    }
+
+    for (size_t index = 0; index < size; index++)
+    {
+        if (generator.values[index] == TABLEBASE_UNKNOWN) // nobody can force anything
+        {
+            generator.values[index] = TABLEBASE_DRAW;
+        }
+    }
+
+    free(generator.remaining);
+    free(generator.exit_best);
+    table->values = generator.values;
+    table->mapping = generator.values;
+    table->mapping_size = size;
+    table->owned = true;
+    return CHESS_OK;
+}
+
+// rough material of one side, to decide which way round a table is stored
+static int tablebase_material(const int counts[6])
+{
+    static const int values[6] = {1, 3, 3, 5, 9, 0};
+    int total = 0;
+    for (int piece = 0; piece < 6; piece++)
+    {
+        total += counts[piece] * values[piece];
+    }
+    return total;
+}
+
+static enum chess_error tablebase_generate_counts(struct tablebase *tablebase, int counts[2][6])
+{
+    bool mirrored;
+    if (tablebase_total_pieces(counts) <= 2 || tablebase_find(tablebase, counts, &mirrored) != NULL)
+    {
+        return CHESS_OK;
+    }
+
+    // everything a capture or promotion can turn this material into has to exist first
+    for (int player = 0; player < 2; player++)
+    {
+        int opponent = 1 - player;
+        for (int piece = PIECE_PAWN; piece < PIECE_KING; piece++)
+        {
+            if (counts[player][piece] == 0)
+            {
+                continue;
+            }
+
+            counts[player][piece]--; // captured
+            enum chess_error error = tablebase_generate_counts(tablebase, counts);
+            counts[player][piece]++;
+            if (error)
+            {
+                return error;
+            }
+        }
+
+        if (counts[player][PIECE_PAWN] == 0)
+        {
+            continue;
+        }
+        counts[player][PIECE_PAWN]--;
+        for (int promotion = PIECE_KNIGHT; promotion <= PIECE_QUEEN; promotion++)
+        {
+            counts[player][promotion]++;
+            enum chess_error error = tablebase_generate_counts(tablebase, counts);
+            for (int victim = PIECE_PAWN; victim < PIECE_KING && !error; victim++) // promoting with a capture
+            {
+                if (counts[opponent][victim] > 0)
+                {
+                    counts[opponent][victim]--;
+                    error = tablebase_generate_counts(tablebase, counts);
+                    counts[opponent][victim]++;
+                }
+            }
+            counts[player][promotion]--;
+            if (error)
+            {
+                counts[player][PIECE_PAWN]++;
+                return error;
+            }
+        }
+        counts[player][PIECE_PAWN]++;
+    }
+
+    if (tablebase->count == TABLEBASE_MAX_TABLES)
+    {
+        return CHESS_ERROR_BAD_TABLEBASE;
+    }
+    struct tablebase_table *table = &tablebase->tables[tablebase->count];
+    if (tablebase_material(counts[PLAYER_BLACK]) > tablebase_material(counts[PLAYER_WHITE])) // stronger side as white, "KRvK" rather than "KvKR"
+    {
+        int swapped[2][6];
+        memcpy(swapped[PLAYER_WHITE], counts[PLAYER_BLACK], sizeof(swapped[0]));
+        memcpy(swapped[PLAYER_BLACK], counts[PLAYER_WHITE], sizeof(swapped[0]));
+        tablebase_set_material(table, swapped);
+    }
+    else
+    {
+        tablebase_set_material(table, counts);
+    }
+    enum chess_error error = tablebase_build(tablebase, table);
+    if (error)
+    {
+        return error;
+    }
+    tablebase->count++;
+    return CHESS_OK;
+}
+
+enum chess_error tablebase_generate(struct tablebase *tablebase, const char *name)
+{
+    int counts[2][6];
+    if (!tablebase_parse_name(name, counts))
+    {
+        return CHESS_ERROR_BAD_TABLEBASE;
+    }
+    return tablebase_generate_counts(tablebase, counts);
+}
+
+enum chess_error tablebase_save(const struct tablebase_table *table, const char *path)
+{
+    uint8_t header[TABLEBASE_HEADER_SIZE] = {0};
+    memcpy(header, TABLEBASE_MAGIC, 4);
+    header[4] = (uint8_t)table->piece_count;
+    for (int slot = 0; slot < table->piece_count; slot++)
+    {
+        header[5 + slot] = (uint8_t)(table->owners[slot] << 3 | table->pieces[slot]);
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return CHESS_ERROR_BAD_TABLEBASE;
+    }
+    bool written = fwrite(header, 1, sizeof(header), file) == sizeof(header) && fwrite(table->values, 1, table->size, file) == table->size;
+    if (fclose(file) != 0 || !written)
+    {
+        return CHESS_ERROR_BAD_TABLEBASE;
+    }
+    return CHESS_OK;
+}
+
+// checks the header against the file size and fills in the table's material from it
+static bool tablebase_read_header(const uint8_t *header, size_t file_size, struct tablebase_table *table)
+{
+    if (file_size < TABLEBASE_HEADER_SIZE || memcmp(header, TABLEBASE_MAGIC, 4) != 0)
+    {
+        return false;
+    }
+    int piece_count = header[4];
+    if (piece_count < 3 || piece_count > TABLEBASE_MAX_PIECES || file_size != TABLEBASE_HEADER_SIZE + tablebase_positions(piece_count))
+    {
+        return false;
+    }
+
+    int counts[2][6] = {{0}};
+    for (int slot = 0; slot < piece_count; slot++)
+    {
+        int owner = header[5 + slot] >> 3;
+        int piece = header[5 + slot] & 7;
+        if (owner > PLAYER_BLACK || piece > PIECE_KING)
+        {
+            return false;
+        }
+        counts[owner][piece]++;
+    }
+
+    tablebase_set_material(table, counts);
+    // the slot order in the file is what the values are indexed by, keep it even if we'd sort differently
+    for (int slot = 0; slot < piece_count; slot++)
+    {
+        table->owners[slot] = (enum chess_player)(header[5 + slot] >> 3);
+        table->pieces[slot] = (enum chess_piece)(header[5 + slot] & 7);
+    }
+    table->size = tablebase_positions(piece_count);
+    return true;
+}
+
+enum chess_error tablebase_load(struct tablebase *tablebase, const char *path)
+{
+    if (tablebase->count == TABLEBASE_MAX_TABLES)
+    {
+        return CHESS_ERROR_BAD_TABLEBASE;
+    }
+    struct tablebase_table *table = &tablebase->tables[tablebase->count];
+
+#ifndef _WIN32
+    int descriptor = open(path, O_RDONLY);
+    if (descriptor < 0)
+    {
+        return CHESS_ERROR_BAD_TABLEBASE;
+    }
+    struct stat info;
+    if (fstat(descriptor, &info) != 0 || info.st_size < TABLEBASE_HEADER_SIZE)
+    {
+        close(descriptor);
+        return CHESS_ERROR_BAD_TABLEBASE;
+    }
+    size_t file_size = (size_t)info.st_size;
+    void *mapping = mmap(NULL, file_size, PROT_READ, MAP_SHARED, descriptor, 0);
+    close(descriptor); // the mapping keeps the file alive
+    if (mapping == MAP_FAILED)
+    {
+        return CHESS_ERROR_BAD_TABLEBASE;
+    }
+    if (!tablebase_read_header(mapping, file_size, table))
+    {
+        munmap(mapping, file_size);
+        return CHESS_ERROR_BAD_TABLEBASE;
+    }
+    table->owned = false;
+#else
+    // no mmap here, read the whole file instead
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return CHESS_ERROR_BAD_TABLEBASE;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    size_t file_size = length > 0 ? (size_t)length : 0;
+    void *mapping = malloc(file_size ? file_size : 1);
+    bool read = mapping != NULL && fread(mapping, 1, file_size, file) == file_size;
+    fclose(file);
+    if (!read || !tablebase_read_header(mapping, file_size, table))
+    {
+        free(mapping);
+        return mapping == NULL ? CHESS_ERROR_OUT_OF_MEMORY : CHESS_ERROR_BAD_TABLEBASE;
+    }
+    table->owned = true;
+#endif
+
+    table->values = (const uint8_t *)mapping + TABLEBASE_HEADER_SIZE;
+    table->mapping = mapping;
+    table->mapping_size = file_size;
+    tablebase->count++;
+    return CHESS_OK;
+}
@@ -0,0 +1,89 @@
+#ifndef APSC143__TABLEBASE_H
+#define APSC143__TABLEBASE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "board.h"
+
+// endgame tables cover positions with this many pieces or fewer, kings included
+#define TABLEBASE_MAX_PIECES 4
+// how many material sets one struct tablebase can hold
+#define TABLEBASE_MAX_TABLES 64
+
+// One byte per position, from the point of view of the player to move:
+// TABLEBASE_DRAW, a win in 1..127 plies, TABLEBASE_LOSS | plies for a loss
+// (TABLEBASE_LOSS alone means checkmated), or TABLEBASE_INVALID for indexes
+// that aren't a legal position.
+#define TABLEBASE_DRAW 0x00
+#define TABLEBASE_LOSS 0x80
+#define TABLEBASE_INVALID 0xFF
+
+// Table for one material set, e.g. "KQvKR" (white's pieces, then black's).
+// Positions are indexed by side to move and the square of each piece in the
+// order of the name, so the table covers both sides to move and needs
+// 2 * 64^pieces bytes. A set is only stored one way round; positions with the
+// colours swapped are probed by mirroring the board.
+struct tablebase_table
+{
+    int piece_count;
+    enum chess_player owners[TABLEBASE_MAX_PIECES];
+    enum chess_piece pieces[TABLEBASE_MAX_PIECES];
+    int counts[2][6]; // [player][piece] how many of each, for matching boards to tables
+
+    const uint8_t *values;
+    size_t size;
+
+    // where values came from, so tablebase_free knows how to give it back
+    void *mapping;
+    size_t mapping_size;
+    bool owned; // malloc'd by the generator rather than mapped from a file
+};
+
+struct tablebase
+{
+    struct tablebase_table tables[TABLEBASE_MAX_TABLES];
+    int count;
+};
+
+enum tablebase_outcome
+{
+    TABLEBASE_OUTCOME_DRAW,
+    TABLEBASE_OUTCOME_WIN,  // for the player to move
+    TABLEBASE_OUTCOME_LOSS,
+};
+
+void tablebase_init(struct tablebase *tablebase);
+void tablebase_free(struct tablebase *tablebase);
+
+// Writes the name of a table ("KQvKR") into text, which needs room for
+// TABLEBASE_MAX_PIECES + 2 characters.
+void tablebase_name(const struct tablebase_table *table, char *text);
+
+// Builds the table for a material set by retrograde analysis and adds it to
+// tablebase, along with every smaller table it depends on (what captures and
+// promotions lead to) that isn't there already. Checkmates are found first,
+// then each pass walks moves backwards from the positions decided in the last
+// pass: a position one move before a loss is a win, and a position whose every
+// move leads to a win for the opponent is a loss. Whatever is never decided is
+// a draw. Returns CHESS_ERROR_BAD_TABLEBASE for a name it can't use (one king
+// each, at most TABLEBASE_MAX_PIECES pieces).
+enum chess_error tablebase_generate(struct tablebase *tablebase, const char *name);
+
+// Writes a table to a file that tablebase_load can map back in.
+enum chess_error tablebase_save(const struct tablebase_table *table, const char *path);
+
+// Memory-maps a table written by tablebase_save and adds it to tablebase.
+enum chess_error tablebase_load(struct tablebase *tablebase, const char *path);
+
+// Looks the position up. Returns false if no loaded table covers it (wrong
+// material or castling rights still around), otherwise stores the outcome for
+// the player to move and the number of plies until mate (0 for a draw).
+bool tablebase_probe(const struct tablebase *tablebase, const struct chess_board *board, enum tablebase_outcome *outcome, int *plies);
+
+// Picks the move the tables say is best: the quickest win, otherwise a draw,
+// otherwise the slowest loss. Returns false if the position isn't covered or
+// there are no legal moves.
+bool tablebase_best_move(const struct tablebase *tablebase, const struct chess_board *board, struct chess_move *move, enum tablebase_outcome *outcome, int *plies);
+
+#endif
@@ -0,0 +1,85 @@
+#include "tablebase.h"
+#include "panic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// chess-tbgen [-o DIRECTORY] MATERIAL...
+// builds the endgame tables for each material set (e.g. KQvK KRvK KQvKR) and every smaller set they
+// need, and writes each one to DIRECTORY/NAME.ctb for chess-analysis --tablebase
+int main(int argc, char **argv)
+{
+    const char *directory = ".";
+    struct tablebase tablebase;
+    tablebase_init(&tablebase);
+
+    int generated = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            directory = argv[++i];
+            continue;
+        }
+
+        enum chess_error error = tablebase_generate(&tablebase, argv[i]);
+        if (error)
+        {
+            panicf("%s: %s\n", argv[i], chess_error_string(error));
+        }
+        generated++;
+    }
+    if (generated == 0)
+    {
+        panicf("usage: %s [-o DIRECTORY] MATERIAL... (e.g. KQvK KRvK KQvKR)\n", argv[0]);
+    }
+
+    for (int i = 0; i < tablebase.count; i++)
+    {
+        const struct tablebase_table *table = &tablebase.tables[i];
+        char name[TABLEBASE_MAX_PIECES + 2];
+        tablebase_name(table, name);
+
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s.ctb", directory, name);
+        enum chess_error error = tablebase_save(table, path);
+        if (error)
+        {
+            panicf("%s: %s\n", path, chess_error_string(error));
+        }
+
+        // a quick summary so a broken table stands out
+        size_t wins = 0, draws = 0, losses = 0;
+        int longest = 0;
+        for (size_t index = 0; index < table->size; index++)
+        {
+            uint8_t value = table->values[index];
+            if (value == TABLEBASE_INVALID)
+            {
+                continue;
+            }
+            if (value == TABLEBASE_DRAW)
+            {
+                draws++;
+                continue;
+            }
+            int plies = value & ~TABLEBASE_LOSS;
+            if (value & TABLEBASE_LOSS)
+            {
+                losses++;
+            }
+            else
+            {
+                wins++;
+            }
+            if (plies > longest)
+            {
+                longest = plies;
+            }
+        }
+        fprintf(stderr, "%s: %zu wins %zu draws %zu losses, longest mate %d plies\n", path, wins, draws, losses, longest);
+    }
+
+    tablebase_free(&tablebase);
+    return 0;
+}
@@ -0,0 +1,366 @@
+#include "board.h"
+#include "eval.h"
+#include "evalbatch.h"
+#include "panic.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+// chess-tune [-o FILE] [--weights FILE] [--threads N] [--passes N] CORPUS...
+// fits the evaluation weights to a corpus of positions with known results (Texel's method): the
+// static evaluation, squashed into an expected score, should predict how the game actually ended.
+// each corpus line is a FEN followed by the result for white: 1-0, 0-1 or 1/2-1/2 (1, 0 or 0.5 and
+// EPD style quoting like "1-0"; also work). the weights are written to FILE for chess-analysis
+// --weights after every pass, so stopping early still leaves the best found so far
+
+#define TUNE_MAX_THREADS 64
+#define TUNE_LINE_MAX 512
+#define TUNE_DEFAULT_PASSES 50
+#define TUNE_FIRST_STEP 8 // centipawns each weight is nudged by, halved whenever a pass finds nothing
+
+// one thread's share of the corpus
+struct tune_slice
+{
+    struct evalbatch batch;
+    float *results; // for white: 1 win, 0.5 draw, 0 loss
+    const double *scale;
+    const struct eval_weights *weights; // the ones tune_error is trying
+    double error; // sum of squared errors from the last tune_slice_error
+    pthread_t thread;
+};
+
+struct tune_corpus
+{
+    struct tune_slice slices[TUNE_MAX_THREADS];
+    int slice_count;
+    size_t positions, skipped;
+    double scale; // K: how sharply an evaluation turns into an expected result
+};
+
+// the result token at the end of a line, without quotes or the EPD semicolon. false if it isn't one
+static bool tune_parse_result(char *token, float *result)
+{
+    token += strspn(token, "\"[");
+    token[strcspn(token, "\";]")] = '\0';
+    if (strcmp(token, "1-0") == 0 || strcmp(token, "1") == 0 || strcmp(token, "1.0") == 0)
+    {
+        *result = 1.0f;
+    }
+    else if (strcmp(token, "0-1") == 0 || strcmp(token, "0") == 0 || strcmp(token, "0.0") == 0)
+    {
+        *result = 0.0f;
+    }
+    else if (strcmp(token, "1/2-1/2") == 0 || strcmp(token, "0.5") == 0)
+    {
+        *result = 0.5f;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+static size_t tune_count_lines(int file_count, char **paths)
+{
+    size_t lines = 0;
+    for (int i = 0; i < file_count; i++)
+    {
+        FILE *file = fopen(paths[i], "r");
+        if (file == NULL)
+        {
+            panicf("%s: can't open\n", paths[i]);
+        }
+        char line[TUNE_LINE_MAX];
+        while (fgets(line, sizeof(line), file) != NULL)
+        {
+            lines++;
+        }
+        fclose(file);
+    }
+    return lines;
+}
+
+// deals the positions out round robin, so every slice gets a similar mix
+static void tune_load(struct tune_corpus *corpus, int file_count, char **paths, int threads)
+{
+    size_t lines = tune_count_lines(file_count, paths);
+    corpus->slice_count = threads;
+    for (int i = 0; i < threads; i++)
+    {
+        struct tune_slice *slice = &corpus->slices[i];
+        size_t capacity = lines / (size_t)threads + 1;
+        slice->results = malloc(capacity * sizeof(float));
+        slice->scale = &corpus->scale;
+        if (slice->results == NULL || !evalbatch_init(&slice->batch, capacity))
+        {
+            panicf("out of memory\n");
+        }
+    }
+
+    for (int i = 0; i < file_count; i++)
+    {
+        FILE *file = fopen(paths[i], "r");
+        if (file == NULL)
+        {
+            panicf("%s: can't open\n", paths[i]);
+        }
+        char line[TUNE_LINE_MAX];
+        while (fgets(line, sizeof(line), file) != NULL)
+        {
+            line[strcspn(line, "\r\n")] = '\0';
+            char *last_space = strrchr(line, ' ');
+            float result;
+            if (last_space == NULL || !tune_parse_result(last_space + 1, &result))
+            {
+                corpus->skipped++;
+                continue;
+            }
+            *last_space = '\0';
+
+            // positions in check aren't quiet, the static evaluation says little about them
+            struct chess_board board;
+            if (board_set_fen(&board, line) != CHESS_OK || board_in_check(&board))
+            {
+                corpus->skipped++;
+                continue;
+            }
+            struct tune_slice *slice = &corpus->slices[corpus->positions % (size_t)threads];
+            slice->results[slice->batch.count] = result;
+            evalbatch_add(&slice->batch, &board);
+            corpus->positions++;
+        }
+        fclose(file);
+    }
+}
+
+static void *tune_slice_error(void *data)
+{
+    struct tune_slice *slice = data;
+    evalbatch_load_weights(&slice->batch, slice->weights);
+    evalbatch_run(&slice->batch, EVALBATCH_AUTO);
+
+    double error = 0.0;
+    for (size_t i = 0; i < slice->batch.count; i++)
+    {
+        double white_score = (double)(slice->batch.scores[i] * slice->batch.signs[i]);
+        double expected = 1.0 / (1.0 + pow(10.0, -*slice->scale * white_score / 400.0));
+        double miss = slice->results[i] - expected;
+        error += miss * miss;
+    }
+    slice->error = error;
+    return NULL;
+}
+
+// mean squared error of the whole corpus under weights, every slice on its own thread
+static double tune_error(struct tune_corpus *corpus, const struct eval_weights *weights)
+{
+    for (int i = 0; i < corpus->slice_count; i++)
+    {
+        corpus->slices[i].weights = weights;
+    }
+    int started = 1;
+    for (; started < corpus->slice_count; started++)
+    {
+        if (pthread_create(&corpus->slices[started].thread, NULL, tune_slice_error, &corpus->slices[started]) != 0)
+        {
+            break;
+        }
+    }
+    tune_slice_error(&corpus->slices[0]);
+    for (int i = started; i < corpus->slice_count; i++) // no thread for these, do them here
+    {
+        tune_slice_error(&corpus->slices[i]);
+    }
+
+    double error = corpus->slices[0].error;
+    for (int i = 1; i < corpus->slice_count; i++)
+    {
+        if (i < started)
+        {
+            pthread_join(corpus->slices[i].thread, NULL);
+        }
+        error += corpus->slices[i].error;
+    }
+    return error / (double)corpus->positions;
+}
+
+// K is fitted once to the starting weights, then held still while they move
+static void tune_fit_scale(struct tune_corpus *corpus, const struct eval_weights *weights)
+{
+    double best_scale = 1.0, best_error = INFINITY;
+    for (double step = 0.1, low = 0.1, high = 3.0; step >= 0.001; step /= 10)
+    {
+        for (double scale = low; scale <= high + step / 2; scale += step)
+        {
+            corpus->scale = scale;
+            double error = tune_error(corpus, weights);
+            if (error < best_error)
+            {
+                best_error = error;
+                best_scale = scale;
+            }
+        }
+        low = best_scale - step > step / 10 ? best_scale - step : step / 10;
+        high = best_scale + step;
+    }
+    corpus->scale = best_scale;
+}
+
+// every weight the tuner may move. pawns never stand on the first or last rank, and the king's
+// material value cancels out, so those stay put
+static int tune_collect_weights(struct eval_weights *weights, int **tuned)
+{
+    int count = 0;
+    for (int piece = PIECE_PAWN; piece < PIECE_KING; piece++)
+    {
+        tuned[count++] = &weights->material_mg[piece];
+        tuned[count++] = &weights->material_eg[piece];
+    }
+    for (int piece = PIECE_PAWN; piece <= PIECE_KING; piece++)
+    {
+        for (int square = 0; square < 64; square++)
+        {
+            if (piece == PIECE_PAWN && (square < 8 || square >= 56))
+            {
+                continue;
+            }
+            tuned[count++] = &weights->pst_mg[piece][square];
+            tuned[count++] = &weights->pst_eg[piece][square];
+        }
+    }
+    return count;
+}
+
+static void tune_save(const char *path, const struct eval_weights *weights)
+{
+    enum chess_error error = eval_save_weights(path, weights);
+    if (error)
+    {
+        panicf("%s: %s\n", path, chess_error_string(error));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = "weights.txt";
+    int passes = TUNE_DEFAULT_PASSES;
+    int threads = 1;
+#if !defined(_WIN32) && defined(_SC_NPROCESSORS_ONLN)
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    struct eval_weights weights;
+    eval_default_weights(&weights);
+
+    char **corpus_paths = malloc((size_t)argc * sizeof(char *));
+    int corpus_count = 0;
+    if (corpus_paths == NULL)
+    {
+        panicf("out of memory\n");
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (strcmp(argv[i], "--weights") == 0 && i + 1 < argc) // start from an earlier run's weights
+        {
+            i++;
+            enum chess_error error = eval_load_weights(argv[i], &weights);
+            if (error)
+            {
+                panicf("%s: %s\n", argv[i], chess_error_string(error));
+            }
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--passes") == 0 && i + 1 < argc)
+        {
+            passes = atoi(argv[++i]);
+        }
+        else if (argv[i][0] != '-')
+        {
+            corpus_paths[corpus_count++] = argv[i];
+        }
+        else
+        {
+            corpus_count = 0;
+            break;
+        }
+    }
+    if (corpus_count == 0)
+    {
+        panicf("usage: %s [-o FILE] [--weights FILE] [--threads N] [--passes N] CORPUS...\n", argv[0]);
+    }
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+    if (threads > TUNE_MAX_THREADS)
+    {
+        threads = TUNE_MAX_THREADS;
+    }
+
+    static struct tune_corpus corpus;
+    tune_load(&corpus, corpus_count, corpus_paths, threads);
+    if (corpus.positions == 0)
+    {
+        panicf("no usable positions in the corpus\n");
+    }
+    tune_fit_scale(&corpus, &weights);
+    double best_error = tune_error(&corpus, &weights);
+    fprintf(stderr, "positions %zu skipped %zu threads %d K %.3f error %.6f\n", corpus.positions, corpus.skipped, threads, corpus.scale, best_error);
+
+    // local search: nudge each weight up, then down, and keep whichever lowers the error
+    int *tuned[sizeof(struct eval_weights) / sizeof(int)];
+    int tuned_count = tune_collect_weights(&weights, tuned);
+    int step = TUNE_FIRST_STEP;
+    for (int pass = 1; pass <= passes && step > 0; pass++)
+    {
+        int changed = 0;
+        for (int i = 0; i < tuned_count; i++)
+        {
+            int original = *tuned[i];
+            *tuned[i] = original + step;
+            double error = tune_error(&corpus, &weights);
+            if (error >= best_error)
+            {
+                *tuned[i] = original - step;
+                error = tune_error(&corpus, &weights);
+            }
+            if (error < best_error)
+            {
+                best_error = error;
+                changed++;
+            }
+            else
+            {
+                *tuned[i] = original;
+            }
+        }
+
+        tune_save(output, &weights);
+        fprintf(stderr, "pass %d step %d changed %d error %.6f\n", pass, step, changed, best_error);
+        if (changed == 0)
+        {
+            step /= 2;
+        }
+    }
+
+    tune_save(output, &weights);
+    for (int i = 0; i < corpus.slice_count; i++)
+    {
+        evalbatch_free(&corpus.slices[i].batch);
+        free(corpus.slices[i].results);
+    }
+    free(corpus_paths);
+    return 0;
+}
@@ -0,0 +1,436 @@
+#include "uci.h"
+#include "board.h"
+#include "parser.h"
+#include "search.h"
+#include "history.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UCI_LINE_MAX 16384
+#define UCI_MAX_TOKENS 2048
+
+// everything that lives for the whole session
+struct uci_engine
+{
+    struct chess_board board;
+    struct history history; // how the game got to board, so the search steers clear of repetitions when ahead
+    struct history scratch; // where "position" builds the next history, swapped in only if every move is good
+    struct search_context context;
+    int table_mb;
+    int threads;
+    const struct tablebase *tablebase;
+    const struct eval_weights *weights;
+    struct search_pruning pruning;
+
+    pthread_t thread;
+    bool searching; // a worker thread exists that hasn't been joined yet
+    int depth;      // depth limit for the search in progress
+    bool infinite;  // "go infinite" or "go ponder": bestmove waits for "stop" even if the search ends first
+    long long start_ms;
+
+    // uci_stop signals stopped under lock once context.stop is set, for an infinite search that's waiting
+    pthread_mutex_t lock;
+    pthread_cond_t stopped;
+};
+
+// splits line in place on whitespace, returns the number of tokens
+static int uci_tokenize(char *line, char **tokens)
+{
+    int count = 0;
+    char *cursor = line;
+
+    while (*cursor != '\0' && count < UCI_MAX_TOKENS)
+    {
+        while (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r')
+        {
+            *cursor++ = '\0';
+        }
+        if (*cursor == '\0')
+        {
+            break;
+        }
+        tokens[count++] = cursor;
+        while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '\n' && *cursor != '\r')
+        {
+            cursor++;
+        }
+    }
+
+    return count;
+}
+
+// writes a search score the way UCI wants it: centipawns, or moves until mate
+static void uci_format_score(int score, char *text, size_t size)
+{
+    if (score >= SEARCH_MATE - SEARCH_MAX_PLY)
+    {
+        snprintf(text, size, "mate %d", (SEARCH_MATE - score + 1) / 2);
+    }
+    else if (score <= -SEARCH_MATE + SEARCH_MAX_PLY)
+    {
+        snprintf(text, size, "mate -%d", (SEARCH_MATE + score) / 2);
+    }
+    else
+    {
+        snprintf(text, size, "cp %d", score);
+    }
+}
+
+static void uci_print_info(void *data, int depth, int score, const struct chess_move *best_move, const struct search_stats *stats)
+{
+    struct uci_engine *engine = data;
+
+    struct chess_move line[SEARCH_MAX_PLY];
+    int length = search_principal_variation(&engine->context, &engine->board, line, depth);
+    if (length == 0) // the table entry got overwritten, at least report the move itself
+    {
+        line[0] = *best_move;
+        length = 1;
+    }
+
+    char pv[SEARCH_MAX_PLY * 6 + 1];
+    int used = 0;
+    for (int i = 0; i < length; i++)
+    {
+        char move_text[6];
+        format_move_coordinate(&line[i], move_text);
+        used += snprintf(pv + used, sizeof(pv) - used, i ? " %s" : "%s", move_text);
+    }
+
+    char score_text[32];
+    uci_format_score(score, score_text, sizeof(score_text));
+
+    printf("info depth %d score %s nodes %llu time %lld pv %s\n", depth, score_text, stats->nodes + stats->qnodes, search_now_ms() - engine->start_ms, pv);
+    fflush(stdout);
+}
+
+static void *uci_search_thread(void *data)
+{
+    struct uci_engine *engine = data;
+    struct chess_move best_move;
+    int score;
+
+    bool found = search_best_move(&engine->context, &engine->board, engine->depth, &best_move, &score);
+
+    // a forced mate or the depth limit can end the search early, but UCI only allows bestmove
+    // after "stop" once the GUI asked for an infinite search
+    if (engine->infinite)
+    {
+        pthread_mutex_lock(&engine->lock);
+        while (!atomic_load(&engine->context.stop))
+        {
+            pthread_cond_wait(&engine->stopped, &engine->lock);
+        }
+        pthread_mutex_unlock(&engine->lock);
+    }
+
+    if (found)
+    {
+        char move_text[6];
+        format_move_coordinate(&best_move, move_text);
+        printf("bestmove %s\n", move_text);
+    }
+    else
+    {
+        printf("bestmove 0000\n"); // game over, nothing to play
+    }
+    fflush(stdout);
+    return NULL;
+}
+
+// stops the search in progress (if any) and waits for its bestmove
+static void uci_stop(struct uci_engine *engine)
+{
+    if (!engine->searching)
+    {
+        return;
+    }
+    pthread_mutex_lock(&engine->lock);
+    atomic_store(&engine->context.stop, true);
+    pthread_cond_broadcast(&engine->stopped);
+    pthread_mutex_unlock(&engine->lock);
+    pthread_join(engine->thread, NULL);
+    engine->searching = false;
+}
+
+static void uci_position(struct uci_engine *engine, char **tokens, int count)
+{
+    struct chess_board board;
+    int index = 1;
+
+    if (index < count && strcmp(tokens[index], "startpos") == 0)
+    {
+        board_initialize(&board);
+        index++;
+    }
+    else if (index < count && strcmp(tokens[index], "fen") == 0)
+    {
+        // glue the FEN fields back together, they run up to "moves" or the end of the line
+        char fen[256] = "";
+        index++;
+        while (index < count && strcmp(tokens[index], "moves") != 0)
+        {
+            strncat(fen, tokens[index], sizeof(fen) - strlen(fen) - 2);
+            strcat(fen, " ");
+            index++;
+        }
+        if (board_set_fen(&board, fen) != CHESS_OK)
+        {
+            printf("info string bad fen %s\n", fen);
+            return;
+        }
+    }
+    else
+    {
+        return;
+    }
+
+    // a rejected command leaves the old position and its history as they were
+    history_reset(&engine->scratch, &board);
+    if (index < count && strcmp(tokens[index], "moves") == 0)
+    {
+        for (index++; index < count; index++)
+        {
+            struct chess_move move;
+            if (!parse_move_coordinate(&board, tokens[index], &move))
+            {
+                printf("info string illegal move %s\n", tokens[index]);
+                return;
+            }
+            board_apply_move(&board, &move);
+            if (!history_push(&engine->scratch, &board, &move))
+            {
+                printf("info string out of memory\n");
+                return;
+            }
+        }
+    }
+
+    // swap the contents, context.game keeps pointing at engine->history
+    struct history previous = engine->history;
+    engine->history = engine->scratch;
+    engine->scratch = previous;
+    engine->board = board;
+}
+
+static void uci_go(struct uci_engine *engine, char **tokens, int count)
+{
+    int depth = SEARCH_MAX_PLY - 1;
+    long long move_time = 0;
+    long long time_left[2] = {0, 0};
+    long long increment[2] = {0, 0};
+    int moves_to_go = 30;
+    bool infinite = false;
+
+    for (int i = 1; i < count; i++)
+    {
+        bool has_value = (i + 1 < count);
+        if (strcmp(tokens[i], "depth") == 0 && has_value)
+        {
+            depth = atoi(tokens[++i]);
+        }
+        else if (strcmp(tokens[i], "movetime") == 0 && has_value)
+        {
+            move_time = atoll(tokens[++i]);
+        }
+        else if (strcmp(tokens[i], "wtime") == 0 && has_value)
+        {
+            time_left[PLAYER_WHITE] = atoll(tokens[++i]);
+        }
+        else if (strcmp(tokens[i], "btime") == 0 && has_value)
+        {
+            time_left[PLAYER_BLACK] = atoll(tokens[++i]);
+        }
+        else if (strcmp(tokens[i], "winc") == 0 && has_value)
+        {
+            increment[PLAYER_WHITE] = atoll(tokens[++i]);
+        }
+        else if (strcmp(tokens[i], "binc") == 0 && has_value)
+        {
+            increment[PLAYER_BLACK] = atoll(tokens[++i]);
+        }
+        else if (strcmp(tokens[i], "movestogo") == 0 && has_value)
+        {
+            moves_to_go = atoi(tokens[++i]);
+            if (moves_to_go < 1)
+            {
+                moves_to_go = 1;
+            }
+        }
+        else if (strcmp(tokens[i], "infinite") == 0 || strcmp(tokens[i], "ponder") == 0) // no limits, we run until "stop"
+        {
+            infinite = true;
+        }
+    }
+
+    enum chess_player player = engine->board.next_move_player;
+    if (move_time == 0 && time_left[player] > 0) // spread the clock over the moves still to play
+    {
+        move_time = time_left[player] / moves_to_go + increment[player] / 2;
+        if (move_time > time_left[player] - 50)
+        {
+            move_time = time_left[player] - 50;
+        }
+        if (move_time < 10)
+        {
+            move_time = 10;
+        }
+    }
+
+    engine->start_ms = search_now_ms();
+    engine->depth = depth;
+    engine->infinite = infinite;
+    engine->context.deadline_ms = move_time ? engine->start_ms + move_time : 0;
+    atomic_store(&engine->context.stop, false);
+
+    if (pthread_create(&engine->thread, NULL, uci_search_thread, engine) != 0)
+    {
+        engine->infinite = false; // nobody could send "stop" while this thread waits for it
+        uci_search_thread(engine); // no thread to be had, search on this one instead
+        return;
+    }
+    engine->searching = true;
+}
+
+static void uci_set_option(struct uci_engine *engine, char **tokens, int count)
+{
+    // setoption name Hash value <megabytes>
+    if (count >= 5 && strcmp(tokens[1], "name") == 0 && strcmp(tokens[2], "Hash") == 0 && strcmp(tokens[3], "value") == 0)
+    {
+        int table_mb = atoi(tokens[4]);
+        if (table_mb < 1)
+        {
+            table_mb = 1;
+        }
+
+        // the old context stays until the new one exists, so a failure leaves the engine as it was
+        struct search_context context;
+        if (!search_context_init(&context, (size_t)table_mb))
+        {
+            printf("info string not enough memory for %d MB, keeping %d MB\n", table_mb, engine->table_mb);
+            return;
+        }
+        search_context_free(&engine->context);
+        engine->context = context;
+        engine->context.on_iteration = uci_print_info;
+        engine->context.on_iteration_data = engine;
+        engine->context.tablebase = engine->tablebase;
+        engine->context.pruning = engine->pruning;
+        search_context_set_weights(&engine->context, engine->weights);
+        engine->context.game = &engine->history;
+        engine->table_mb = table_mb;
+        if (!search_context_set_threads(&engine->context, engine->threads)) // the helpers shared the old table
+        {
+            printf("info string not enough memory for %d threads, using 1\n", engine->threads);
+            engine->threads = 1;
+        }
+    }
+    // setoption name Threads value <count>
+    else if (count >= 5 && strcmp(tokens[1], "name") == 0 && strcmp(tokens[2], "Threads") == 0 && strcmp(tokens[3], "value") == 0)
+    {
+        int threads = atoi(tokens[4]);
+        if (threads < 1)
+        {
+            threads = 1;
+        }
+        if (!search_context_set_threads(&engine->context, threads))
+        {
+            printf("info string not enough memory for %d threads, using 1\n", threads);
+            threads = 1;
+        }
+        engine->threads = threads;
+    }
+}
+
+int uci_main(int table_mb, int threads, const struct search_pruning *pruning, const struct tablebase *tablebase, const struct eval_weights *weights)
+{
+    struct uci_engine engine = {0};
+    char line[UCI_LINE_MAX];
+    char *tokens[UCI_MAX_TOKENS];
+
+    board_initialize(&engine.board);
+    pthread_mutex_init(&engine.lock, NULL);
+    pthread_cond_init(&engine.stopped, NULL);
+    engine.table_mb = table_mb;
+    engine.threads = threads;
+    engine.tablebase = tablebase;
+    engine.weights = weights;
+    engine.pruning = *pruning;
+    if (!search_context_init(&engine.context, (size_t)table_mb) || !search_context_set_threads(&engine.context, threads) || !history_init(&engine.history, HISTORY_GAME_PLIES) ||
+        !history_init(&engine.scratch, HISTORY_GAME_PLIES))
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    history_reset(&engine.history, &engine.board);
+    engine.context.on_iteration = uci_print_info;
+    engine.context.on_iteration_data = &engine;
+    engine.context.tablebase = tablebase;
+    engine.context.pruning = *pruning;
+    search_context_set_weights(&engine.context, weights);
+    engine.context.game = &engine.history;
+
+    while (fgets(line, sizeof(line), stdin) != NULL)
+    {
+        int count = uci_tokenize(line, tokens);
+        if (count == 0)
+        {
+            continue;
+        }
+        const char *command = tokens[0];
+
+        if (strcmp(command, "uci") == 0)
+        {
+            printf("id name chess-analysis\n");
+            printf("id author APSC 143 chess-analysis\n");
+            printf("option name Hash type spin default %d min 1 max 4096\n", SEARCH_DEFAULT_TABLE_MB);
+            printf("option name Threads type spin default 1 min 1 max %d\n", SEARCH_MAX_THREADS);
+            printf("uciok\n");
+        }
+        else if (strcmp(command, "isready") == 0)
+        {
+            printf("readyok\n");
+        }
+        else if (strcmp(command, "ucinewgame") == 0)
+        {
+            uci_stop(&engine);
+            search_context_clear(&engine.context);
+            board_initialize(&engine.board);
+            history_reset(&engine.history, &engine.board);
+        }
+        else if (strcmp(command, "setoption") == 0)
+        {
+            uci_stop(&engine);
+            uci_set_option(&engine, tokens, count);
+        }
+        else if (strcmp(command, "position") == 0)
+        {
+            uci_stop(&engine);
+            uci_position(&engine, tokens, count);
+        }
+        else if (strcmp(command, "go") == 0)
+        {
+            uci_stop(&engine);
+            uci_go(&engine, tokens, count);
+        }
+        else if (strcmp(command, "stop") == 0)
+        {
+            uci_stop(&engine);
+        }
+        else if (strcmp(command, "quit") == 0)
+        {
+            break;
+        }
+        fflush(stdout);
+    }
+
+    uci_stop(&engine);
+    search_context_free(&engine.context);
+    history_free(&engine.history);
+    history_free(&engine.scratch);
+    pthread_cond_destroy(&engine.stopped);
+    pthread_mutex_destroy(&engine.lock);
+    return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef APSC143__UCI_H
+#define APSC143__UCI_H
+
+#include "search.h"
+#include "tablebase.h"
+
+// Runs the engine as a long lived UCI process: reads commands from standard
+// input and answers on standard output until "quit" or end of input. The
+// transposition table, move ordering tables and search frames are allocated
+// once and stay warm across "position"/"go" requests; "ucinewgame" clears
+// them. Searches run on a worker thread so "stop" and "isready" are answered
+// while thinking, on threads threads (the Threads option changes it) with
+// pruning (search_context.pruning); after
+// "go infinite" or "go ponder", bestmove waits for "stop" even if the search
+// is over sooner. Positions
+// covered by tablebase (may be empty) are answered from the tables, the rest
+// are evaluated with weights (NULL for the compiled-in ones). Returns the
+// process exit status.
+int uci_main(int table_mb, int threads, const struct search_pruning *pruning, const struct tablebase *tablebase, const struct eval_weights *weights);
+
+#endif